@@ -0,0 +1,340 @@
+#include "LegacyParse.h"
+
+#include "infra/ImapParse.h"
+
+#include <algorithm>
+#include <cctype>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+std::string trim_str(const std::string& s) {
+  std::size_t b = 0;
+  while (b < s.size() && std::isspace(static_cast<unsigned char>(s[b]))) b++;
+  std::size_t e = s.size();
+  while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) e--;
+  return s.substr(b, e - b);
+}
+
+std::string to_lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return s;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return 10 + c - 'a';
+  if (c >= 'A' && c <= 'F') return 10 + c - 'A';
+  return -1;
+}
+
+std::string html_entity_decode(std::string text) {
+  auto replace_all = [](std::string& s, const std::string& from, const std::string& to) {
+    std::size_t p = 0;
+    while ((p = s.find(from, p)) != std::string::npos) {
+      s.replace(p, from.size(), to);
+      p += to.size();
+    }
+  };
+  replace_all(text, "&amp;",  "&");
+  replace_all(text, "&lt;",   "<");
+  replace_all(text, "&gt;",   ">");
+  replace_all(text, "&quot;", "\"");
+  replace_all(text, "&#39;",  "'");
+  return text;
+}
+
+std::string sanitize_url(std::string url) {
+  while (!url.empty()) {
+    char c = url.back();
+    if (c == '.' || c == ',' || c == ')' || c == ']' || c == '}' || c == ';') {
+      url.pop_back();
+      continue;
+    }
+    break;
+  }
+  return url;
+}
+
+std::string extract_domain(const std::string& url) {
+  static const std::regex re(R"(^https?://([^/:?#]+))", std::regex::icase);
+  std::smatch m;
+  if (!std::regex_search(url, m, re)) return "";
+  std::string host = m[1].str();
+  std::transform(host.begin(), host.end(), host.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return host;
+}
+
+double estimate_form_link_confidence(const std::string& url) {
+  std::string lower = to_lower(url);
+  if (lower.find("forms.yandex.") != std::string::npos) {
+    if (lower.find("/admin/")   != std::string::npos) return 0.0;
+    if (lower.find("/answers/") != std::string::npos) return 0.0;
+    if (lower.find("/success")  != std::string::npos) return 0.0;
+    if (lower.find("/results/") != std::string::npos) return 0.0;
+    return 0.95;
+  }
+  if (lower.find("docs.google.com/forms") != std::string::npos) {
+    if (lower.find("/viewanalytics") != std::string::npos) return 0.0;
+    if (lower.find("/closedform")    != std::string::npos) return 0.0;
+    return 0.95;
+  }
+  if (lower.find("forms.gle")           != std::string::npos) return 0.95;
+  if (lower.find("forms.office.com")    != std::string::npos) return 0.95;
+  if (lower.find("forms.microsoft.com") != std::string::npos) return 0.95;
+  if (lower.find("portal.hse.ru/poll")  != std::string::npos) return 0.9;
+  if (lower.find("lms.hse.ru")          != std::string::npos) return 0.85;
+  if (lower.find("smartlms.hse.ru")     != std::string::npos) return 0.85;
+  if (lower.find("form") != std::string::npos ||
+      lower.find("poll") != std::string::npos) return 0.6;
+  return 0.2;
+}
+
+void collect_links(const std::string& text,
+                   std::vector<message_link>& result,
+                   std::set<std::string>& seen) {
+  static const std::regex url_regex(R"((https?://[^\s"'<>]+))", std::regex::icase);
+  auto begin = std::sregex_iterator(text.begin(), text.end(), url_regex);
+  for (auto it = begin; it != std::sregex_iterator(); ++it) {
+    std::string url = sanitize_url(html_entity_decode((*it)[1].str()));
+    if (url.empty() || !seen.insert(url).second) continue;
+    message_link item;
+    item.url        = url;
+    item.domain     = extract_domain(url);
+    item.confidence = estimate_form_link_confidence(url);
+    result.push_back(std::move(item));
+  }
+}
+
+void collect_href_links(const std::string& html,
+                        std::vector<message_link>& result,
+                        std::set<std::string>& seen) {
+  static const std::regex href_regex(
+      R"(href\s*=\s*["'](https?://[^"']+)["'])", std::regex::icase);
+  auto begin = std::sregex_iterator(html.begin(), html.end(), href_regex);
+  for (auto it = begin; it != std::sregex_iterator(); ++it) {
+    std::string url = sanitize_url(html_entity_decode((*it)[1].str()));
+    if (url.empty() || !seen.insert(url).second) continue;
+    message_link item;
+    item.url        = url;
+    item.domain     = extract_domain(url);
+    item.confidence = estimate_form_link_confidence(url);
+    result.push_back(std::move(item));
+  }
+}
+
+}
+
+std::string legacy_extract_part_by_content_type(const std::string& raw,
+                                                 const std::string& content_type) {
+  std::string lower  = to_lower(raw);
+  std::string needle = "content-type: " + content_type;
+  std::size_t pos    = lower.find(needle);
+  if (pos == std::string::npos) return "";
+
+  std::size_t body_start = raw.find("\r\n\r\n", pos);
+  std::size_t sep        = 4;
+  if (body_start == std::string::npos) { body_start = raw.find("\n\n", pos); sep = 2; }
+  if (body_start == std::string::npos) return "";
+  body_start += sep;
+
+  std::size_t end = raw.find("\r\n--", body_start);
+  if (end == std::string::npos) end = raw.find("\n--", body_start);
+  std::string part = raw.substr(body_start,
+      end == std::string::npos ? std::string::npos : end - body_start);
+
+  std::size_t qp_hdr = lower.rfind("content-transfer-encoding:", body_start);
+  if (qp_hdr != std::string::npos && qp_hdr > pos) {
+    std::string enc_region = lower.substr(qp_hdr, body_start - qp_hdr);
+    if (enc_region.find("quoted-printable") != std::string::npos)
+      part = legacy_quoted_printable_decode(part, false);
+    else if (enc_region.find("base64") != std::string::npos)
+      part = legacy_base64_decode(part);
+  }
+  return trim_str(part);
+}
+
+std::vector<attachment> legacy_extract_attachment_metadata(const std::string& raw) {
+  std::vector<attachment> result;
+  std::string lower = to_lower(raw);
+  std::size_t search_from = 0;
+  while (true) {
+    std::size_t disp_pos = lower.find("content-disposition:", search_from);
+    if (disp_pos == std::string::npos) break;
+    std::size_t line_end = lower.find('\n', disp_pos);
+    if (line_end == std::string::npos) break;
+    std::string disp_line  = raw.substr(disp_pos, line_end - disp_pos);
+    std::string disp_lower = to_lower(disp_line);
+    search_from = line_end + 1;
+
+    bool is_att    = disp_lower.find("attachment") != std::string::npos;
+    bool is_inline = disp_lower.find("inline")     != std::string::npos;
+    if (!is_att && !is_inline) continue;
+
+    attachment att;
+    att.disposition = is_att ? "attachment" : "inline";
+
+    static const std::regex fn_re(R"(filename\*?=\"?([^\";\r\n]+)\"?)",
+                                   std::regex::icase);
+    std::smatch fn_m;
+    if (std::regex_search(disp_line, fn_m, fn_re)) {
+      att.filename = trim_str(fn_m[1].str());
+      att.filename = decode_mime_header(att.filename);
+    }
+
+    std::size_t back_start  = disp_pos > 800 ? disp_pos - 800 : 0;
+    std::string back_lower  = lower.substr(back_start, disp_pos - back_start);
+    std::size_t ct_rel      = back_lower.rfind("content-type:");
+    if (ct_rel != std::string::npos) {
+      std::size_t ct_abs  = back_start + ct_rel;
+      std::size_t ct_end  = lower.find('\n', ct_abs);
+      std::string ct_line = ct_end != std::string::npos
+          ? raw.substr(ct_abs, ct_end - ct_abs) : raw.substr(ct_abs);
+      auto semi           = ct_line.find(';');
+      att.mime_type       = to_lower(trim_str(ct_line.substr(14,
+          semi == std::string::npos ? std::string::npos : semi - 14)));
+
+      if (att.mime_type.rfind("image/", 0) == 0) att.safe_to_preview = true;
+      if (att.mime_type == "application/pdf")    att.safe_to_preview = true;
+
+      std::size_t cid_pos = back_lower.rfind("content-id:");
+      if (cid_pos != std::string::npos) {
+        std::size_t cid_abs  = back_start + cid_pos;
+        std::size_t cid_end  = lower.find('\n', cid_abs);
+        std::string cid_line = cid_end != std::string::npos
+            ? raw.substr(cid_abs, cid_end - cid_abs) : raw.substr(cid_abs);
+        std::string cid_val  = trim_str(cid_line.substr(11));
+        if (!cid_val.empty() && cid_val.front() == '<') cid_val = cid_val.substr(1);
+        if (!cid_val.empty() && cid_val.back()  == '>') cid_val.pop_back();
+        att.content_id = cid_val;
+      }
+    }
+
+    if (!att.filename.empty() || !att.content_id.empty() || is_att)
+      result.push_back(std::move(att));
+  }
+  return result;
+}
+
+std::string legacy_base64_decode(const std::string& input) {
+  static const std::string alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  int val = 0, bits = -8;
+  for (unsigned char c : input) {
+    if (std::isspace(c)) continue;
+    if (c == '=') break;
+    auto pos = alphabet.find(static_cast<char>(c));
+    if (pos == std::string::npos) continue;
+    val = (val << 6) + static_cast<int>(pos);
+    bits += 6;
+    if (bits >= 0) {
+      out.push_back(static_cast<char>((val >> bits) & 0xFF));
+      bits -= 8;
+    }
+  }
+  return out;
+}
+
+std::string legacy_quoted_printable_decode(const std::string& input, bool header_mode) {
+  std::string out;
+  for (std::size_t i = 0; i < input.size(); ++i) {
+    char c = input[i];
+    if (header_mode && c == '_') { out.push_back(' '); continue; }
+    if (c == '=' && i + 2 < input.size()) {
+      if (input[i+1] == '\r' && input[i+2] == '\n') { i += 2; continue; }
+      if (input[i+1] == '\n') { i += 1; continue; }
+      int hi = hex_value(input[i+1]);
+      int lo = hex_value(input[i+2]);
+      if (hi >= 0 && lo >= 0) {
+        out.push_back(static_cast<char>((hi << 4) | lo));
+        i += 2;
+        continue;
+      }
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
+std::vector<message_link> legacy_extract_links(const std::string& text, const std::string& html) {
+  std::vector<message_link> result;
+  std::set<std::string> seen;
+  collect_links(text, result, seen);
+  collect_links(html, result, seen);
+  collect_href_links(html, result, seen);
+  return result;
+}
+
+std::string legacy_strip_html_tags(const std::string& html_in) {
+  std::string html = html_in;
+  html = std::regex_replace(html, std::regex("<(script|style)[^>]*>[\\s\\S]*?</\\1>",
+                                             std::regex::icase), " ");
+  html = std::regex_replace(html, std::regex("<br\\s*/?>",  std::regex::icase), "\n");
+  html = std::regex_replace(html, std::regex("</p>",        std::regex::icase), "\n");
+  html = std::regex_replace(html, std::regex("<[^>]+>",     std::regex::icase), " ");
+  return trim_str(html);
+}
+
+std::string legacy_utf8_lower(const std::string& input) {
+  std::string out;
+  out.reserve(input.size());
+  for (size_t i = 0; i < input.size(); ) {
+    unsigned char c = static_cast<unsigned char>(input[i]);
+    if (c < 0x80) {
+      out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      ++i;
+    } else if (c == 0xD0 && i + 1 < input.size()) {
+      unsigned char c2 = static_cast<unsigned char>(input[i + 1]);
+      if (c2 == 0x81) {
+        out += '\xD1'; out += '\x91';
+      } else if (c2 >= 0x90 && c2 <= 0x9F) {
+        out += '\xD0'; out += static_cast<char>(c2 + 0x20);
+      } else if (c2 >= 0xA0 && c2 <= 0xAF) {
+        out += '\xD1'; out += static_cast<char>(c2 - 0x20);
+      } else {
+        out += static_cast<char>(c); out += static_cast<char>(c2);
+      }
+      i += 2;
+    } else {
+      size_t len = 1;
+      if ((c & 0xE0) == 0xC0) len = 2;
+      else if ((c & 0xF0) == 0xE0) len = 3;
+      else if ((c & 0xF8) == 0xF0) len = 4;
+      for (size_t j = 0; j < len && i + j < input.size(); ++j)
+        out += input[i + j];
+      i += len;
+    }
+  }
+  return out;
+}
+
+std::string legacy_lower_copy(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  const std::vector<std::pair<std::string, std::string>> ru = {
+      {"\xD0\x90", "\xD0\xB0"}, {"\xD0\x91", "\xD0\xB1"}, {"\xD0\x92", "\xD0\xB2"}, {"\xD0\x93", "\xD0\xB3"},
+      {"\xD0\x94", "\xD0\xB4"}, {"\xD0\x95", "\xD0\xB5"}, {"\xD0\x81", "\xD1\x91"}, {"\xD0\x96", "\xD0\xB6"},
+      {"\xD0\x97", "\xD0\xB7"}, {"\xD0\x98", "\xD0\xB8"}, {"\xD0\x99", "\xD0\xB9"}, {"\xD0\x9A", "\xD0\xBA"},
+      {"\xD0\x9B", "\xD0\xBB"}, {"\xD0\x9C", "\xD0\xBC"}, {"\xD0\x9D", "\xD0\xBD"}, {"\xD0\x9E", "\xD0\xBE"},
+      {"\xD0\x9F", "\xD0\xBF"}, {"\xD0\xA0", "\xD1\x80"}, {"\xD0\xA1", "\xD1\x81"}, {"\xD0\xA2", "\xD1\x82"},
+      {"\xD0\xA3", "\xD1\x83"}, {"\xD0\xA4", "\xD1\x84"}, {"\xD0\xA5", "\xD1\x85"}, {"\xD0\xA6", "\xD1\x86"},
+      {"\xD0\xA7", "\xD1\x87"}, {"\xD0\xA8", "\xD1\x88"}, {"\xD0\xA9", "\xD1\x89"}, {"\xD0\xAA", "\xD1\x8A"},
+      {"\xD0\xAB", "\xD1\x8B"}, {"\xD0\xAC", "\xD1\x8C"}, {"\xD0\xAD", "\xD1\x8D"}, {"\xD0\xAE", "\xD1\x8E"},
+      {"\xD0\xAF", "\xD1\x8F"}
+  };
+  for (const auto& [from, to] : ru) {
+    size_t pos = 0;
+    while ((pos = text.find(from, pos)) != std::string::npos) {
+      text.replace(pos, from.size(), to);
+      pos += to.size();
+    }
+  }
+  return text;
+}
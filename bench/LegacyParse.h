@@ -0,0 +1,24 @@
+#pragma once
+
+#include "domain/Message.h"
+
+#include <string>
+#include <vector>
+
+
+std::string legacy_extract_part_by_content_type(const std::string& raw,
+                                                const std::string& content_type);
+
+std::vector<attachment> legacy_extract_attachment_metadata(const std::string& raw);
+
+std::string legacy_base64_decode(const std::string& input);
+
+std::string legacy_quoted_printable_decode(const std::string& input, bool header_mode);
+
+std::vector<message_link> legacy_extract_links(const std::string& text, const std::string& html);
+
+std::string legacy_strip_html_tags(const std::string& html_in);
+
+std::string legacy_utf8_lower(const std::string& input);
+
+std::string legacy_lower_copy(std::string text);
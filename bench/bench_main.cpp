@@ -0,0 +1,659 @@
+#include "LegacyParse.h"
+
+#include "domain/RuleEngine.h"
+#include "infra/HtmlText.h"
+#include "infra/ImapParse.h"
+#include "infra/LinkScan.h"
+#include "infra/MimeParse.h"
+#include "infra/Storage.h"
+#include "infra/TransferDecode.h"
+#include "util/CaseFold.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+static volatile std::size_t g_sink = 0;
+
+template <typename Fn>
+static double run_bench(const char* name, std::size_t bytes_per_iter, int iterations, Fn fn) {
+  fn();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) fn();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  double mb_s = ns > 0 ? static_cast<double>(bytes_per_iter) / ns * 1e3 : 0.0;
+  std::printf("  %-44s %12.0f ns/iter %10.1f MB/s\n", name, ns, mb_s);
+  return ns;
+}
+
+
+static std::string base64_encode(const std::string& in) {
+  static const char* alphabet =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  std::size_t line = 0;
+  for (std::size_t i = 0; i < in.size(); i += 3) {
+    unsigned v = static_cast<unsigned char>(in[i]) << 16;
+    if (i + 1 < in.size()) v |= static_cast<unsigned char>(in[i + 1]) << 8;
+    if (i + 2 < in.size()) v |= static_cast<unsigned char>(in[i + 2]);
+    out.push_back(alphabet[(v >> 18) & 63]);
+    out.push_back(alphabet[(v >> 12) & 63]);
+    out.push_back(i + 1 < in.size() ? alphabet[(v >> 6) & 63] : '=');
+    out.push_back(i + 2 < in.size() ? alphabet[v & 63] : '=');
+    if ((line += 4) >= 76) {
+      out += "\r\n";
+      line = 0;
+    }
+  }
+  return out;
+}
+
+static std::string qp_encode(const std::string& in) {
+  static const char* hex = "0123456789ABCDEF";
+  std::string out;
+  std::size_t line = 0;
+  for (unsigned char c : in) {
+    if (c == '\n') {
+      out += "\r\n";
+      line = 0;
+      continue;
+    }
+    if (line >= 72) {
+      out += "=\r\n";
+      line = 0;
+    }
+    if (c >= 128 || c == '=') {
+      out.push_back('=');
+      out.push_back(hex[c >> 4]);
+      out.push_back(hex[c & 15]);
+      line += 3;
+    } else {
+      out.push_back(static_cast<char>(c));
+      ++line;
+    }
+  }
+  return out;
+}
+
+static std::vector<std::string> synthetic_corpus() {
+  std::string ru =
+      "\xD0\x97\xD0\xB4\xD1\x80\xD0\xB0\xD0\xB2\xD1\x81\xD1\x82\xD0\xB2\xD1\x83\xD0\xB9\xD1\x82\xD0\xB5! "
+      "\xD0\x9F\xD1\x80\xD0\xBE\xD1\x81\xD0\xB8\xD0\xBC \xD0\xB7\xD0\xB0\xD0\xBF\xD0\xBE\xD0\xBB\xD0\xBD\xD0\xB8\xD1\x82\xD1\x8C "
+      "\xD1\x84\xD0\xBE\xD1\x80\xD0\xBC\xD1\x83 https://forms.yandex.ru/u/abc123/ \xD0\xB4\xD0\xBE \xD0\xBF\xD1\x8F\xD1\x82\xD0\xBD\xD0\xB8\xD1\x86\xD1\x8B.\n";
+  std::string text;
+  for (int i = 0; i < 40; ++i) text += ru;
+  std::string html = "<html><body>";
+  for (int i = 0; i < 60; ++i)
+    html += "<p>Item " + std::to_string(i) + " <a href=\"https://example.com/news/" +
+            std::to_string(i) + "\">read more</a></p>\n";
+  html += "</body></html>\n";
+  std::string pdf = "%PDF-1.4\n";
+  for (int i = 0; i < 12000; ++i) pdf += static_cast<char>((i * 131) & 0xFF);
+  std::string png = "\x89PNG\r\n";
+  for (int i = 0; i < 4000; ++i) png += static_cast<char>((i * 17) & 0xFF);
+
+  std::string headers =
+      "Return-Path: <dean@university.edu>\r\n"
+      "Received: from mx.university.edu (mx.university.edu [10.0.0.1])\r\n\tby imap.example.com; Mon, 4 May 2026 09:00:00 +0300\r\n"
+      "From: Dean Office <dean@university.edu>\r\n"
+      "To: student@example.com\r\n"
+      "Subject: =?UTF-8?B?0JLQsNC20L3QvtC1INGD0LLQtdC00L7QvNC70LXQvdC40LU=?=\r\n"
+      "Date: Mon, 4 May 2026 09:00:00 +0300\r\n"
+      "Message-ID: <bench@university.edu>\r\n"
+      "MIME-Version: 1.0\r\n";
+
+  std::vector<std::string> corpus;
+  corpus.push_back(headers +
+      "Content-Type: text/plain; charset=utf-8\r\n"
+      "Content-Transfer-Encoding: quoted-printable\r\n\r\n" + qp_encode(text));
+
+  corpus.push_back(headers +
+      "Content-Type: multipart/alternative; boundary=\"alt-1\"\r\n\r\n"
+      "--alt-1\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Transfer-Encoding: quoted-printable\r\n\r\n" +
+      qp_encode(text) + "\r\n"
+      "--alt-1\r\nContent-Type: text/html; charset=utf-8\r\nContent-Transfer-Encoding: base64\r\n\r\n" +
+      base64_encode(html) + "\r\n--alt-1--\r\n");
+
+  corpus.push_back(headers +
+      "Content-Type: multipart/mixed; boundary=\"mix-1\"\r\n\r\n"
+      "This is a multi-part message in MIME format.\r\n"
+      "--mix-1\r\nContent-Type: multipart/related; boundary=\"rel-1\"\r\n\r\n"
+      "--rel-1\r\nContent-Type: multipart/alternative; boundary=\"alt-2\"\r\n\r\n"
+      "--alt-2\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Transfer-Encoding: 8bit\r\n\r\n" +
+      text + "\r\n"
+      "--alt-2\r\nContent-Type: text/html; charset=utf-8\r\nContent-Transfer-Encoding: quoted-printable\r\n\r\n" +
+      qp_encode(html) + "\r\n--alt-2--\r\n"
+      "--rel-1\r\nContent-Type: image/png\r\nContent-ID: <logo@bench>\r\n"
+      "Content-Disposition: inline; filename=\"logo.png\"\r\nContent-Transfer-Encoding: base64\r\n\r\n" +
+      base64_encode(png) + "\r\n--rel-1--\r\n"
+      "--mix-1\r\nContent-Type: application/pdf; name=\"schedule.pdf\"\r\n"
+      "Content-Disposition: attachment; filename=\"schedule.pdf\"\r\nContent-Transfer-Encoding: base64\r\n\r\n" +
+      base64_encode(pdf) + "\r\n--mix-1--\r\n");
+  return corpus;
+}
+
+static std::vector<std::string> load_corpus(const std::string& dir) {
+  std::vector<std::string> corpus;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (!entry.is_regular_file() || entry.path().extension() != ".eml") continue;
+    std::ifstream in(entry.path(), std::ios::binary);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    corpus.push_back(ss.str());
+  }
+  return corpus;
+}
+
+
+static void bench_mime(const std::vector<std::string>& corpus) {
+  std::size_t bytes = 0;
+  for (const auto& raw : corpus) bytes += raw.size();
+  std::printf("mime: %zu messages, %zu bytes\n", corpus.size(), bytes);
+
+  int mismatches = 0;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    if (mime_part_text(raw, tree, "text/plain") != legacy_extract_part_by_content_type(raw, "text/plain"))
+      ++mismatches;
+  }
+  std::printf("  text/plain differs from legacy on %d message(s)\n", mismatches);
+
+  const int iterations = 200;
+  double legacy = run_bench("legacy extract_part x2 + attachments", bytes, iterations, [&]() {
+    for (const auto& raw : corpus) {
+      g_sink = g_sink + legacy_extract_part_by_content_type(raw, "text/plain").size();
+      g_sink = g_sink + legacy_extract_part_by_content_type(raw, "text/html").size();
+      g_sink = g_sink + legacy_extract_attachment_metadata(raw).size();
+    }
+  });
+  double tree_only = run_bench("mime_parse (tree only)", bytes, iterations, [&]() {
+    for (const auto& raw : corpus) g_sink = g_sink + mime_parse(raw).parts.size();
+  });
+  double full = run_bench("mime_parse + text/html + attachments", bytes, iterations, [&]() {
+    for (const auto& raw : corpus) {
+      mime_tree tree = mime_parse(raw);
+      g_sink = g_sink + mime_part_text(raw, tree, "text/plain").size();
+      g_sink = g_sink + mime_part_text(raw, tree, "text/html").size();
+      g_sink = g_sink + mime_attachments(tree).size();
+    }
+  });
+  std::printf("  speedup: %.2fx (tree only %.2fx)\n", legacy / full, legacy / tree_only);
+}
+
+
+static void bench_decode(const std::vector<std::string>& corpus) {
+  std::vector<std::string> base64_parts, qp_parts;
+  std::size_t base64_bytes = 0, qp_bytes = 0;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    for (const auto& part : tree.parts) {
+      if (!part.children.empty() || part.body_end <= part.body_offset) continue;
+      std::string body = raw.substr(part.body_offset, part.body_end - part.body_offset);
+      if (part.encoding == "base64") {
+        base64_bytes += body.size();
+        base64_parts.push_back(std::move(body));
+      } else if (part.encoding == "quoted-printable") {
+        qp_bytes += body.size();
+        qp_parts.push_back(std::move(body));
+      }
+    }
+  }
+  std::printf("decode (%s): %zu base64 parts / %zu bytes, %zu qp parts / %zu bytes\n",
+              transfer_decode_isa(), base64_parts.size(), base64_bytes, qp_parts.size(), qp_bytes);
+
+  int mismatches = 0;
+  for (const auto& body : base64_parts)
+    if (base64_decode(body) != legacy_base64_decode(body)) ++mismatches;
+  for (const auto& body : qp_parts)
+    if (quoted_printable_decode(body, false) != legacy_quoted_printable_decode(body, false)) ++mismatches;
+  std::printf("  output differs from legacy on %d part(s)\n", mismatches);
+
+  auto gb_s = [](std::size_t bytes, double ns) { return ns > 0 ? static_cast<double>(bytes) / ns : 0.0; };
+  const int iterations = 200;
+  if (!base64_parts.empty()) {
+    double legacy = run_bench("legacy base64_decode", base64_bytes, iterations, [&]() {
+      for (const auto& body : base64_parts) g_sink = g_sink + legacy_base64_decode(body).size();
+    });
+    double scalar = run_bench("base64_decode (table, scalar)", base64_bytes, iterations, [&]() {
+      for (const auto& body : base64_parts) g_sink = g_sink + base64_decode(body, false).size();
+    });
+    double simd = run_bench("base64_decode (dispatched)", base64_bytes, iterations, [&]() {
+      for (const auto& body : base64_parts) g_sink = g_sink + base64_decode(body).size();
+    });
+    std::printf("  base64: %.2f -> %.2f GB/s scalar, %.2f GB/s dispatched (%.1fx)\n",
+                gb_s(base64_bytes, legacy), gb_s(base64_bytes, scalar), gb_s(base64_bytes, simd),
+                legacy / simd);
+  }
+  if (!qp_parts.empty()) {
+    double legacy = run_bench("legacy quoted_printable_decode", qp_bytes, iterations, [&]() {
+      for (const auto& body : qp_parts) g_sink = g_sink + legacy_quoted_printable_decode(body, false).size();
+    });
+    double fast = run_bench("quoted_printable_decode", qp_bytes, iterations, [&]() {
+      for (const auto& body : qp_parts) g_sink = g_sink + quoted_printable_decode(body, false).size();
+    });
+    std::printf("  qp: %.2f -> %.2f GB/s (%.1fx)\n",
+                gb_s(qp_bytes, legacy), gb_s(qp_bytes, fast), legacy / fast);
+  }
+}
+
+
+static void bench_links(const std::vector<std::string>& corpus) {
+  std::vector<std::pair<std::string, std::string>> bodies;
+  std::size_t bytes = 0;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    bodies.emplace_back(mime_part_text(raw, tree, "text/plain"), mime_part_text(raw, tree, "text/html"));
+    bytes += bodies.back().first.size() + bodies.back().second.size();
+  }
+  std::printf("links: %zu bodies, %zu bytes\n", bodies.size(), bytes);
+
+  int mismatches = 0;
+  for (const auto& [text, html] : bodies) {
+    auto fast = extract_links(text, html);
+    auto legacy = legacy_extract_links(text, html);
+    bool same = fast.size() == legacy.size();
+    for (std::size_t i = 0; same && i < fast.size(); ++i)
+      same = fast[i].url == legacy[i].url && fast[i].domain == legacy[i].domain &&
+             fast[i].confidence == legacy[i].confidence;
+    if (!same) ++mismatches;
+  }
+  std::printf("  links differ from legacy on %d message(s)\n", mismatches);
+
+  const int iterations = 200;
+  double legacy = run_bench("legacy extract_links (regex)", bytes, iterations, [&]() {
+    for (const auto& [text, html] : bodies) g_sink = g_sink + legacy_extract_links(text, html).size();
+  });
+  double fast = run_bench("extract_links (scanner)", bytes, iterations, [&]() {
+    for (const auto& [text, html] : bodies) g_sink = g_sink + extract_links(text, html).size();
+  });
+  std::printf("  speedup: %.2fx\n", legacy / fast);
+}
+
+
+static std::string marketing_html() {
+  std::string html = "<html><head><style>";
+  for (int i = 0; i < 400; ++i) html += ".c" + std::to_string(i) + " { color: #333; padding: 4px; }\n";
+  html += "</style><script>var tracking = {a: 1};</script></head><body><table>";
+  for (int i = 0; i < 600; ++i)
+    html += "<tr><td class=\"c1\">Offer&nbsp;" + std::to_string(i) +
+            " &mdash; <a href=\"https://shop.example.com/item?id=" + std::to_string(i) +
+            "&amp;utm_source=mail\">buy now</a></td></tr>\n";
+  html += "</table><p>Unsubscribe: https://shop.example.com/unsubscribe</p></body></html>";
+  return html;
+}
+
+static void bench_html(const std::vector<std::string>& corpus) {
+  std::vector<std::string> pages;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    std::string html = mime_part_text(raw, tree, "text/html");
+    if (!html.empty()) pages.push_back(std::move(html));
+  }
+  pages.push_back(marketing_html());
+  std::size_t bytes = 0;
+  for (const auto& html : pages) bytes += html.size();
+  std::printf("html: %zu pages, %zu bytes\n", pages.size(), bytes);
+
+  const int iterations = 50;
+  double legacy = run_bench("legacy strip_html_tags + links + snippet", bytes, iterations, [&]() {
+    for (const auto& html : pages) {
+      std::string text = legacy_strip_html_tags(html);
+      g_sink = g_sink + snippet_from_body(text).size();
+      g_sink = g_sink + legacy_extract_links(text, html).size();
+    }
+  });
+  double fast = run_bench("html_to_text (text + snippet + links)", bytes, iterations, [&]() {
+    for (const auto& html : pages) {
+      link_collector links;
+      html_text_result r = html_to_text(html, &links);
+      g_sink = g_sink + r.text.size() + r.snippet.size() + links.links.size();
+    }
+  });
+  std::printf("  speedup: %.2fx\n", legacy / fast);
+}
+
+
+static void bench_case_fold(const std::vector<std::string>& corpus) {
+  const std::string mixed =
+      "\xD0\x92\xD0\x90\xD0\x96\xD0\x9D\xD0\x9E: \xD0\x9F\xD0\xB5\xD1\x80\xD0\xB5\xD1\x81\xD0\xB4\xD0\xB0\xD1\x87\xD0\xB0 "
+      "Exam SCHEDULE for Group B-21, Room 404. \xD0\x97\xD0\xB0\xD0\xBF\xD0\xBE\xD0\xBB\xD0\xBD\xD0\xB8\xD1\x82\xD0\xB5 "
+      "Google Form https://forms.gle/AbCdEf \xD0\x94\xD0\x9E \xD0\x9F\xD0\xAF\xD0\xA2\xD0\x9D\xD0\x98\xD0\xA6\xD0\xAB.\n";
+  std::vector<std::string> texts;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    std::string text = mime_part_text(raw, tree, "text/plain");
+    if (!text.empty()) texts.push_back(std::move(text));
+  }
+  std::string paragraph;
+  for (int i = 0; i < 200; ++i) paragraph += mixed;
+  texts.push_back(paragraph);
+  std::size_t bytes = 0;
+  for (const auto& t : texts) bytes += t.size();
+  std::printf("case fold: %zu texts, %zu bytes, isa=%s\n", texts.size(), bytes, case_fold_isa());
+
+  const int iterations = 200;
+  double form_engine = run_bench("legacy lower_copy (tolower + ru table)", bytes, iterations / 10, [&]() {
+    for (const auto& t : texts) g_sink = g_sink + legacy_lower_copy(t).size();
+  });
+  double noop = run_bench("legacy utf8_lower", bytes, iterations, [&]() {
+    for (const auto& t : texts) g_sink = g_sink + legacy_utf8_lower(t).size();
+  });
+  double copy = run_bench("case_fold (new string)", bytes, iterations, [&]() {
+    for (const auto& t : texts) g_sink = g_sink + case_fold(t).size();
+  });
+  std::string buf;
+  double append = run_bench("case_fold_append (reused buffer)", bytes, iterations, [&]() {
+    for (const auto& t : texts) {
+      buf.clear();
+      case_fold_append(buf, t);
+      g_sink = g_sink + buf.size();
+    }
+  });
+  std::printf("  speedup vs utf8_lower: %.2fx (new string), %.2fx (reused buffer); vs lower_copy: %.2fx\n",
+              noop / copy, noop / append, form_engine / append);
+}
+
+static std::vector<rule> synthetic_rules(int count) {
+  static const char* words[] = {"deadline", "exam", "schedule", "invoice", "webinar", "survey",
+                                "grant", "scholarship", "dormitory", "library", "password", "meeting"};
+  std::vector<rule> rules;
+  for (int i = 0; i < count; ++i) {
+    rule r;
+    r.id = "r" + std::to_string(i);
+    r.match = match_mode::any;
+    condition any;
+    any.field = "body";
+    any.op = cond_op::contains_any_i;
+    for (int k = 0; k < 8; ++k)
+      any.values.push_back(std::string(words[(i + k) % 12]) + " " + std::to_string((i * 7 + k) % 50));
+    r.conditions.push_back(any);
+    condition subject;
+    subject.field = "subject";
+    subject.op = cond_op::contains;
+    subject.value = "Notice #" + std::to_string(i);
+    r.conditions.push_back(subject);
+    rules.push_back(std::move(r));
+  }
+  return rules;
+}
+
+static void bench_rules(const std::vector<std::string>& corpus) {
+  std::vector<message> messages;
+  std::size_t bytes = 0;
+  for (const auto& raw : corpus) {
+    mime_tree tree = mime_parse(raw);
+    message msg;
+    msg.subject = "Notice #7";
+    msg.body = mime_part_text(raw, tree, "text/plain");
+    if (msg.body.empty()) msg.body = mime_part_text(raw, tree, "text/html");
+    bytes += msg.body.size();
+    messages.push_back(std::move(msg));
+  }
+
+  rule_engine engine;
+  for (int count : {20, 200}) {
+    std::vector<rule> rules = synthetic_rules(count);
+    auto direct = compile_rules(rules, false);
+    auto multi = compile_rules(rules, true);
+    int mismatches = 0;
+    for (const auto& msg : messages)
+      if (engine.apply(msg, *direct).matched_rule_ids != engine.apply(msg, *multi).matched_rule_ids) ++mismatches;
+    std::printf("rules: %d rules x %zu messages, %zu automaton states, %d mismatch(es)\n", count, messages.size(),
+                multi->matchers.empty() ? std::size_t{0} : multi->matchers[0].folded.state_count(), mismatches);
+
+    const int iterations = count > 100 ? 20 : 200;
+    double per_needle = run_bench("apply, per-needle scans", bytes, iterations, [&]() {
+      for (const auto& msg : messages) g_sink = g_sink + engine.apply(msg, *direct).matched_rule_ids.size();
+    });
+    double automaton = run_bench("apply, one automaton pass per field", bytes, iterations, [&]() {
+      for (const auto& msg : messages) g_sink = g_sink + engine.apply(msg, *multi).matched_rule_ids.size();
+    });
+    std::printf("  speedup: %.2fx\n", per_needle / automaton);
+  }
+}
+
+
+// Web UI reads (list + unread counter) hammered from several threads while
+// one thread ingests; read_connections=0 is the old single-handle layout.
+static void bench_storage() {
+  const int emails = 1500;
+  const int reader_threads = 4;
+  std::printf("storage: %d emails ingested, %d concurrent readers, %u cores\n", emails, reader_threads,
+              std::thread::hardware_concurrency());
+
+  for (int read_connections : {0, 3}) {
+    std::string path = (std::filesystem::temp_directory_path() / "ctl_bench_storage.db").string();
+    for (const char* suffix : {"", "-wal", "-shm"}) std::filesystem::remove(path + suffix);
+    std::string err;
+    std::unique_ptr<storage> store(make_sqlite_storage(path, &err, read_connections));
+    if (!store) {
+      std::printf("  storage open failed: %s\n", err.c_str());
+      return;
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<long long> reads{0};
+    std::atomic<long long> read_ns{0};
+    std::atomic<long long> worst_ns{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < reader_threads; ++t) {
+      readers.emplace_back([&]() {
+        email_list_filter filter;
+        while (!done.load()) {
+          auto start = std::chrono::steady_clock::now();
+          g_sink = g_sink + store->list_emails(filter, 50, 0).size();
+          g_sink = g_sink + static_cast<std::size_t>(store->count_unread_important());
+          long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start).count();
+          reads.fetch_add(1);
+          read_ns.fetch_add(ns);
+          long long prev = worst_ns.load();
+          while (ns > prev && !worst_ns.compare_exchange_weak(prev, ns)) {}
+        }
+      });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < emails; ++i) {
+      stored_email e;
+      e.mailbox_id = "main";
+      e.uid = std::to_string(i + 1);
+      e.from_addr = "dean@university.edu";
+      e.subject = "Exam schedule " + std::to_string(i);
+      e.date_iso = "2026-05-04T09:00:00Z";
+      e.snippet = "Please fill the form before Friday";
+      e.body_text = std::string(2000, 'x');
+      e.importance_level = i % 3 == 0 ? "high" : "low";
+      e.status = "new";
+      store->save_email_message(e);
+      event_record ev;
+      ev.level = "info";
+      ev.type = "mail_stored";
+      store->append_event(ev, 200);
+    }
+    double ingest_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    done.store(true);
+    for (auto& t : readers) t.join();
+    store.reset();
+    for (const char* suffix : {"", "-wal", "-shm"}) std::filesystem::remove(path + suffix);
+
+    long long n = reads.load();
+    std::printf("  read_connections=%d  ingest %8.1f ms  reads %7lld (%8.0f/s)  avg %8.0f us  worst %8.0f us\n",
+                read_connections, ingest_ms, n, n / (ingest_ms / 1e3),
+                n ? read_ns.load() / 1e3 / n : 0.0, worst_ns.load() / 1e3);
+  }
+}
+
+// Poll cycles of 50 messages: every write committed on its own versus the
+// poll path, which stores the cycle in one batch and commits classification,
+// processed marks and the checkpoint together in a second one.
+static void bench_ingest_batches() {
+  const int emails = 1000;
+  const int cycle = 50;
+  std::printf("ingest: %d messages in cycles of %d, email + classification + processed mark,"
+              " one checkpoint per cycle\n", emails, cycle);
+  double single = 0;
+  for (bool batched : {false, true}) {
+    std::string path = (std::filesystem::temp_directory_path() / "ctl_bench_ingest.db").string();
+    for (const char* suffix : {"", "-wal", "-shm"}) std::filesystem::remove(path + suffix);
+    std::string err;
+    std::unique_ptr<storage> store(make_sqlite_storage(path, &err));
+    if (!store) {
+      std::printf("  storage open failed: %s\n", err.c_str());
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < emails; i += cycle) {
+      int end = std::min(emails, i + cycle);
+      std::vector<std::string> ids;
+      {
+        std::unique_ptr<storage_batch> unit;
+        if (batched) unit = std::make_unique<storage_batch>(*store);
+        for (int j = i; j < end; ++j) {
+          stored_email e;
+          e.mailbox_id = "main";
+          e.uid = std::to_string(j + 1);
+          e.subject = "Exam schedule " + std::to_string(j);
+          e.date_iso = "2026-05-04T09:00:00Z";
+          e.body_text = std::string(2000, 'x');
+          ids.push_back(store->save_email_message(e));
+        }
+      }
+      std::unique_ptr<storage_deferral> deferred;
+      if (batched) deferred = std::make_unique<storage_deferral>(*store);
+      for (int j = i; j < end; ++j) {
+        store->update_email_classification(ids[j - i], "{}", "low", 0.1, "other", "new");
+        message msg;
+        msg.mailbox_id = "main";
+        msg.uid = std::to_string(j + 1);
+        store->mark_processed(msg, "processed");
+      }
+      std::unique_ptr<storage_batch> batch;
+      if (batched) {
+        batch = std::make_unique<storage_batch>(*store);
+        deferred->flush();
+      }
+      mailbox_checkpoint cp;
+      cp.mailbox_id = "main";
+      cp.last_seen_uid = static_cast<std::uint64_t>(end);
+      store->save_checkpoint(cp);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    store.reset();
+    for (const char* suffix : {"", "-wal", "-shm"}) std::filesystem::remove(path + suffix);
+    if (!batched) single = ms;
+    std::printf("  %-22s %8.1f ms  %7.0f us/message", batched ? "poll path batches" : "commit every write",
+                ms, ms * 1e3 / emails);
+    if (batched && ms > 0) std::printf("  speedup %.2fx", single / ms);
+    std::printf("\n");
+  }
+}
+
+// Dedup for one fetched batch: a lookup per UID versus one set query.
+static void bench_dedup() {
+  const int processed = 5000;
+  const int batch = 200;
+  std::string err;
+  std::unique_ptr<storage> store(make_sqlite_storage(":memory:", &err));
+  if (!store) {
+    std::printf("  storage open failed: %s\n", err.c_str());
+    return;
+  }
+  {
+    storage_batch unit(*store);
+    for (int i = 0; i < processed; ++i) {
+      message msg;
+      msg.mailbox_id = "main";
+      msg.uid = std::to_string(i + 1);
+      store->mark_processed(msg, "processed");
+    }
+  }
+  std::vector<std::string> uids;
+  for (int i = 0; i < batch; ++i) uids.push_back(std::to_string(processed - batch / 2 + i + 1));
+  std::printf("dedup: %d processed, %d fetched UIDs, half new\n", processed, batch);
+
+  double per_uid = run_bench("is_processed per UID", 0, 200, [&]() {
+    for (const auto& uid : uids) g_sink = g_sink + store->is_processed("main", uid);
+  });
+  double set_based = run_bench("filter_unprocessed", 0, 200, [&]() {
+    g_sink = g_sink + store->filter_unprocessed("main", uids).size();
+  });
+  std::printf("  speedup: %.2fx\n", per_uid / set_based);
+}
+
+// Walks every page of the unread view; OFFSET re-reads all earlier pages,
+// the keyset cursor seeks straight to the next one.
+static void bench_mail_pages() {
+  const int emails = 4000;
+  const int page = 50;
+  std::string err;
+  std::unique_ptr<storage> store(make_sqlite_storage(":memory:", &err));
+  if (!store) {
+    std::printf("  storage open failed: %s\n", err.c_str());
+    return;
+  }
+  for (int i = 0; i < emails; ++i) {
+    stored_email e;
+    e.mailbox_id = "main";
+    e.uid = std::to_string(i + 1);
+    e.subject = "Notice " + std::to_string(i);
+    char date[32];
+    std::snprintf(date, sizeof(date), "2026-%02d-%02dT%02d:00:00Z", 1 + i % 12, 1 + i % 28, i % 24);
+    e.date_iso = date;
+    e.body_text = std::string(2000, 'x');
+    e.classification_json = "{}";
+    store->save_email_message(e);
+  }
+  std::printf("mail pages: %d emails, %d per page\n", emails, page);
+
+  email_list_filter filter;
+  filter.status = "unread";
+  double by_offset = run_bench("walk all pages, LIMIT/OFFSET", 0, 5, [&]() {
+    for (int offset = 0;; offset += page) {
+      auto rows = store->list_emails(filter, page, offset);
+      g_sink = g_sink + rows.size();
+      if (static_cast<int>(rows.size()) < page) break;
+    }
+  });
+  double by_cursor = run_bench("walk all pages, keyset cursor", 0, 5, [&]() {
+    email_list_filter cursor = filter;
+    for (;;) {
+      auto rows = store->list_emails(cursor, page, 0);
+      g_sink = g_sink + rows.size();
+      if (static_cast<int>(rows.size()) < page) break;
+      cursor.before_id = rows.back().id;
+    }
+  });
+  std::printf("  speedup: %.2fx\n", by_offset / by_cursor);
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> corpus;
+  if (argc > 1) corpus = load_corpus(argv[1]);
+  if (corpus.empty()) corpus = synthetic_corpus();
+  bench_mime(corpus);
+  bench_decode(corpus);
+  bench_links(corpus);
+  bench_html(corpus);
+  bench_case_fold(corpus);
+  bench_rules(corpus);
+  bench_storage();
+  bench_ingest_batches();
+  bench_dedup();
+  bench_mail_pages();
+  return 0;
+}
@@ -7,9 +7,11 @@
 #include "../infra/GoogleFormsProvider.h"
 #include "../infra/YandexFormsProvider.h"
 #include "../util/Json.h"
+#include "../util/MailDate.h"
 #include "../infra/UrlPolicy.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cctype>
 #include <cstdint>
@@ -404,12 +406,20 @@ app::app(app_config cfg,
     }
   }
 
+  for (auto& mailbox : mailboxes) {
+    if (!mailbox.client || !this->storage_ptr) continue;
+    std::string mailbox_id = mailbox.cfg.mailbox_id.empty() ? "main" : mailbox.cfg.mailbox_id;
+    mailbox.client->set_prescreen([this, mailbox_id](const std::vector<std::string>& uids) {
+      return this->storage_ptr->filter_unprocessed(mailbox_id, uids);
+    });
+  }
+
   telegram_bot_ptr = std::make_unique<telegram_bot>(this->cfg.telegram);
   browser_ptr = std::make_unique<browser_worker_client>(this->cfg.browser_worker);
   if (this->cfg.llm.enabled) {
     auto total_memory_gb = detect_total_memory_gb();
     if (total_memory_gb && *total_memory_gb < this->cfg.llm.min_memory_gb) {
-      llm_ptr = make_noop_llm_client();
+      llm_ptr = make_noop_llm_client(this->cfg.llm);
       nlohmann::json data = llm_memory_json(this->cfg.llm, total_memory_gb);
       data["model"] = this->cfg.llm.model;
       append_event(
@@ -435,7 +445,7 @@ app::app(app_config cfg,
       llm_ptr = make_ollama_client(this->cfg.llm);
     }
   } else {
-    llm_ptr = make_noop_llm_client();
+    llm_ptr = make_noop_llm_client(this->cfg.llm);
   }
   classifier_ptr = std::make_unique<email_classifier>(*llm_ptr);
   workflow_ptr = std::make_unique<workflow_engine>(
@@ -472,12 +482,32 @@ app::app(app_config cfg,
 
 void app::start_async_services() {
   if (dialog_manager_ptr) dialog_manager_ptr->start();
+  for (auto& mailbox : mailboxes) {
+    if (mailbox.client) mailbox.client->start_push([this]() { wake_poll(); });
+  }
+  if (storage_ptr && !backfill_thread.joinable()) {
+    backfill_stop = false;
+    backfill_thread = std::thread([this]() { backfill_loop(); });
+  }
 }
 
 void app::stop_async_services() {
+  backfill_stop = true;
+  if (backfill_thread.joinable()) backfill_thread.join();
+  for (auto& mailbox : mailboxes) {
+    if (mailbox.client) mailbox.client->stop_push();
+  }
   if (dialog_manager_ptr) dialog_manager_ptr->stop();
 }
 
+void app::wake_poll() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mu);
+    wake_pending = true;
+  }
+  wake_cv.notify_one();
+}
+
 void app::append_event(std::string level,
                        std::string type,
                        std::string message_text,
@@ -516,11 +546,13 @@ mailbox_checkpoint app::ensure_checkpoint(mailbox_runtime& mailbox) {
           reset.last_seen_uid = 0;
           reset.started_at = now_iso();
           reset.updated_at = reset.started_at;
+          apply_backfill_policy(mailbox, reset);
           storage_ptr->save_checkpoint(reset);
+          storage_ptr->set_checkpoint_backfill(mailbox_id, reset.backfill_until_uid);
           std::lock_guard<std::mutex> lock(mu);
-          mailbox.last_seen_uid = 0;
+          mailbox.last_seen_uid = reset.last_seen_uid;
           status.mailbox_id = mailbox_id;
-          status.last_seen_uid = 0;
+          status.last_seen_uid = reset.last_seen_uid;
           return reset;
         }
         if (existing->uid_validity.empty()) {
@@ -541,6 +573,7 @@ mailbox_checkpoint app::ensure_checkpoint(mailbox_runtime& mailbox) {
   checkpoint.last_seen_uid = 0;
   checkpoint.started_at = now_iso();
   checkpoint.updated_at = checkpoint.started_at;
+  apply_backfill_policy(mailbox, checkpoint);
   storage_ptr->save_checkpoint(checkpoint);
 
   {
@@ -554,11 +587,103 @@ mailbox_checkpoint app::ensure_checkpoint(mailbox_runtime& mailbox) {
       "info",
       "checkpoint_initialized",
       "Mailbox checkpoint initialized",
-      {{"mailbox_id", checkpoint.mailbox_id}, {"last_seen_uid", checkpoint.last_seen_uid}}
+      {{"mailbox_id", checkpoint.mailbox_id}, {"last_seen_uid", checkpoint.last_seen_uid},
+       {"backfill_until_uid", checkpoint.backfill_until_uid}}
   );
   return checkpoint;
 }
 
+void app::apply_backfill_policy(mailbox_runtime& mailbox, mailbox_checkpoint& checkpoint) {
+  const std::string& mode = mailbox.cfg.backfill_mode;
+  if (!mailbox.client || mode == "all") return;
+
+  auto mailbox_state = mailbox.client->probe_status();
+  if (!mailbox_state.ok || mailbox_state.uid_next == 0) return;
+
+  checkpoint.last_seen_uid = mailbox_state.uid_next - 1;
+  checkpoint.backfill_until_uid = mode == "none" ? 0 : checkpoint.last_seen_uid;
+  append_event("info", "mail_backfill_planned",
+      "Live polling starts at UIDNEXT, recent history is left to the background backfill",
+      {{"mailbox_id", checkpoint.mailbox_id}, {"mode", mode},
+       {"baseline_uid", checkpoint.last_seen_uid},
+       {"messages", mailbox_state.messages}});
+}
+
+bool app::backfill_mailbox(mailbox_runtime& mailbox) {
+  if (!mailbox.client) return false;
+  std::string mailbox_id = mailbox.cfg.mailbox_id.empty() ? "main" : mailbox.cfg.mailbox_id;
+  auto checkpoint = storage_ptr->load_checkpoint(mailbox_id);
+  if (!checkpoint.has_value() || checkpoint->backfill_until_uid == 0) return false;
+  std::uint64_t until_uid = checkpoint->backfill_until_uid;
+
+  std::vector<std::string> uids;
+  std::string err;
+  bool searched = mailbox.cfg.backfill_mode == "messages"
+      ? mailbox.client->search_last_uids(mailbox.cfg.backfill_messages, uids, err)
+      : mailbox.client->search_uids_since(mailbox.cfg.backfill_days, uids, err);
+  if (!searched) {
+    append_event("warn", "mail_backfill_failed", "Backfill search failed",
+        {{"mailbox_id", mailbox_id}, {"error", err}});
+    return false;
+  }
+
+  uids.erase(std::remove_if(uids.begin(), uids.end(), [&](const std::string& uid) {
+    std::uint64_t n = parse_uid_or_zero(uid);
+    return n == 0 || n > until_uid;
+  }), uids.end());
+  uids = storage_ptr->filter_unprocessed(mailbox_id, uids);
+  std::reverse(uids.begin(), uids.end());
+  append_event("info", "mail_backfill_started", "Background backfill started",
+      {{"mailbox_id", mailbox_id}, {"pending", static_cast<int>(uids.size())},
+       {"until_uid", until_uid}});
+
+  std::shared_ptr<const rule_plan> rules = engine.plan();
+
+  std::size_t batch = static_cast<std::size_t>(std::max(1, mailbox.cfg.fetch_batch_size));
+  int processed = 0;
+  int failed = 0;
+  for (std::size_t i = 0; i < uids.size() && !backfill_stop; i += batch) {
+    while (live_polls > 0 && !backfill_stop) std::this_thread::sleep_for(milliseconds(100));
+    if (backfill_stop) break;
+
+    std::vector<std::string> chunk(uids.begin() + i, uids.begin() + std::min(i + batch, uids.size()));
+    auto fetch_result = mailbox.client->fetch_uids_result(chunk);
+    failed += static_cast<int>(fetch_result.failed_uids.size() + fetch_result.parse_failed_uids.size());
+    {
+      storage_deferral deferred(*storage_ptr);
+      process_messages(mailbox, mailbox_id, fetch_result.messages, *rules);
+    }
+    processed += static_cast<int>(fetch_result.messages.size());
+    std::this_thread::sleep_for(milliseconds(std::max(0, mailbox.cfg.backfill_pause_ms)));
+  }
+  if (backfill_stop) return false;
+
+  if (failed > 0) {
+    append_event("warn", "mail_backfill_incomplete", "Backfill left messages behind, will retry",
+        {{"mailbox_id", mailbox_id}, {"processed", processed}, {"failed", failed}});
+    return true;
+  }
+  storage_ptr->set_checkpoint_backfill(mailbox_id, 0);
+  append_event("info", "mail_backfill_finished", "Background backfill finished",
+      {{"mailbox_id", mailbox_id}, {"processed", processed}});
+  return true;
+}
+
+void app::backfill_loop() {
+  while (!backfill_stop) {
+    for (auto& mailbox : mailboxes) {
+      if (backfill_stop) break;
+      try {
+        backfill_mailbox(mailbox);
+      } catch (const std::exception& ex) {
+        append_event("error", "mail_backfill_failed", "Backfill failed",
+            {{"mailbox_id", mailbox.cfg.mailbox_id}, {"error", ex.what()}});
+      }
+    }
+    for (int i = 0; i < 30 && !backfill_stop; ++i) std::this_thread::sleep_for(seconds(1));
+  }
+}
+
 void app::load_rules_if_changed() {
   std::error_code ec;
   auto mtime = std::filesystem::last_write_time(cfg.rules_file, ec);
@@ -571,8 +696,11 @@ void app::load_rules_if_changed() {
   if (load_rules(cfg.rules_file, loaded, err)) {
     std::string raw;
     json_util::read_file(cfg.rules_file, raw, nullptr);
+    std::shared_ptr<const rule_plan> plan = compile_rules(std::move(loaded));
+    for (const auto& compile_err : plan->errors)
+      append_event("warn", "rules_compile_failed", compile_err, {{"path", cfg.rules_file}});
+    engine.load(plan);
     std::lock_guard<std::mutex> lock(mu);
-    rules = std::move(loaded);
     rules_raw = std::move(raw);
     rules_mtime = mtime;
   } else {
@@ -620,190 +748,282 @@ bool app::send_action(const message& msg, const action& a, std::string& err) {
   return false;
 }
 
-void app::run(bool once) {
-  if (!storage_ptr) {
-    std::cerr << "app not configured" << std::endl;
-    return;
+int app::poll_mailbox(mailbox_runtime& mailbox, const rule_plan& rules) {
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    mailbox.last_check = status.last_check;
   }
 
-  while (true) {
-    load_rules_if_changed();
-    std::vector<rule> rules_copy;
-    {
-      std::lock_guard<std::mutex> lock(mu);
-      rules_copy = rules;
-      status.last_check = now_iso();
-    }
-
-    int matched_total = 0;
-    for (auto& mailbox : mailboxes) {
-      {
-        std::lock_guard<std::mutex> lock(mu);
-        mailbox.last_check = status.last_check;
-      }
-
-      if (!mailbox.client) continue;
-
-      mailbox_checkpoint checkpoint = ensure_checkpoint(mailbox);
-      int matched = 0;
-      std::uint64_t max_seen = checkpoint.last_seen_uid;
-
-      std::uint64_t min_suspect_uid = UINT64_MAX;
+  if (!mailbox.client) return 0;
 
-      std::cout << "[mail] poll mailbox=" << checkpoint.mailbox_id
-                << " last_seen_uid=" << checkpoint.last_seen_uid << std::endl;
+  mailbox.client->begin_cycle();
+  mailbox_checkpoint checkpoint = ensure_checkpoint(mailbox);
+  int matched = 0;
+  std::uint64_t max_seen = checkpoint.last_seen_uid;
 
-      auto fetch_result = mailbox.client->fetch_after_uid_result(checkpoint.last_seen_uid);
+  std::uint64_t min_suspect_uid = UINT64_MAX;
 
-      std::cout << "[mail] fetched mailbox=" << checkpoint.mailbox_id
-                << " searched=" << fetch_result.searched_uids.size()
-                << " messages=" << fetch_result.messages.size()
-                << " failed=" << fetch_result.failed_uids.size()
-                << " parse_failed=" << fetch_result.parse_failed_uids.size() << std::endl;
+  std::cout << "[mail] poll mailbox=" << checkpoint.mailbox_id
+            << " last_seen_uid=" << checkpoint.last_seen_uid << std::endl;
 
+  auto fetch_result = mailbox.client->fetch_delta(checkpoint.last_seen_uid, checkpoint.highest_modseq);
 
-      for (const auto& fuid : fetch_result.failed_uids) {
-        std::uint64_t n = parse_uid_or_zero(fuid);
-        if (n > 0 && n < min_suspect_uid) min_suspect_uid = n;
-        append_event("warn", "imap_fetch_failed",
-            "IMAP FETCH returned a network error — checkpoint not advanced",
-            {{"uid", fuid}, {"mailbox_id", checkpoint.mailbox_id}});
-      }
-
+  std::cout << "[mail] fetched mailbox=" << checkpoint.mailbox_id
+            << " searched=" << fetch_result.searched_uids.size()
+            << " messages=" << fetch_result.messages.size()
+            << " skipped=" << fetch_result.skipped_uids.size()
+            << " failed=" << fetch_result.failed_uids.size()
+            << " parse_failed=" << fetch_result.parse_failed_uids.size() << std::endl;
 
-      for (const auto& pfuid : fetch_result.parse_failed_uids) {
-        std::uint64_t n = parse_uid_or_zero(pfuid);
-        if (n > 0 && n < min_suspect_uid) min_suspect_uid = n;
-        append_event("warn", "imap_message_parse_suspect",
-            "IMAP message had empty subject/from/body — checkpoint not advanced",
-            {{"uid", pfuid}, {"mailbox_id", checkpoint.mailbox_id}});
-      }
 
+  for (const auto& fuid : fetch_result.failed_uids) {
+    std::uint64_t n = parse_uid_or_zero(fuid);
+    if (n > 0 && n < min_suspect_uid) min_suspect_uid = n;
+    append_event("warn", "imap_fetch_failed",
+        "IMAP FETCH returned a network error — checkpoint not advanced",
+        {{"uid", fuid}, {"mailbox_id", checkpoint.mailbox_id}});
+  }
 
-      for (auto msg : fetch_result.messages) {
-        if (msg.mailbox_id.empty() || msg.mailbox_id == "default") {
-          msg.mailbox_id = checkpoint.mailbox_id;
-        }
-        if (msg.provider.empty()) msg.provider = mailbox.cfg.provider;
 
-        std::uint64_t numeric_uid = parse_uid_or_zero(msg.uid);
+  for (const auto& pfuid : fetch_result.parse_failed_uids) {
+    std::uint64_t n = parse_uid_or_zero(pfuid);
+    if (n > 0 && n < min_suspect_uid) min_suspect_uid = n;
+    append_event("warn", "imap_message_parse_suspect",
+        "IMAP message had empty subject/from/body — checkpoint not advanced",
+        {{"uid", pfuid}, {"mailbox_id", checkpoint.mailbox_id}});
+  }
 
-        if (storage_ptr->is_processed(msg.mailbox_id, msg.uid)) {
-          std::cout << "[mail] skip uid=" << msg.uid << " already_processed" << std::endl;
-          if (numeric_uid > max_seen) max_seen = numeric_uid;
-          continue;
-        }
 
-        std::cout << "[mail] process uid=" << msg.uid
-                  << " from=" << msg.from
-                  << " subject=" << msg.subject << std::endl;
+  for (const auto& suid : fetch_result.skipped_uids)
+    max_seen = std::max(max_seen, parse_uid_or_zero(suid));
 
-        append_event("info", "mail_fetched", "Email fetched from IMAP",
-            {{"uid", msg.uid}, {"mailbox_id", msg.mailbox_id},
-             {"subject", msg.subject}, {"from", msg.from},
-             {"links", static_cast<int>(msg.links.size())},
-             {"attachments", static_cast<int>(msg.attachments.size())}});
+  storage_deferral deferred(*storage_ptr);
+  for (int m : process_messages(mailbox, checkpoint.mailbox_id, fetch_result.messages, rules))
+    matched += m;
+  for (const auto& msg : fetch_result.messages)
+    max_seen = std::max(max_seen, parse_uid_or_zero(msg.uid));
 
+  std::uint64_t safe_max = (min_suspect_uid != UINT64_MAX && min_suspect_uid > 0)
+      ? std::min(max_seen, min_suspect_uid - 1)
+      : max_seen;
 
-        std::string email_id;
-        email_analysis analysis;
-        email_decision decision;
-        bool pipeline_ok = false;
+  storage_batch batch(*storage_ptr);
+  deferred.flush();
+  if (!fetch_result.seen_uids.empty() || !fetch_result.unseen_uids.empty() ||
+      !fetch_result.expunged_uids.empty()) {
+    int read = storage_ptr->set_emails_read_by_uid(checkpoint.mailbox_id, fetch_result.seen_uids, true);
+    int unread = storage_ptr->set_emails_read_by_uid(checkpoint.mailbox_id, fetch_result.unseen_uids, false);
+    int archived = storage_ptr->archive_emails_by_uid(checkpoint.mailbox_id, fetch_result.expunged_uids);
+    append_event("info", "mail_flags_synced", "Mailbox flag changes synced",
+        {{"mailbox_id", checkpoint.mailbox_id},
+         {"read", read}, {"unread", unread}, {"archived", archived},
+         {"highest_modseq", fetch_result.highest_modseq}});
+  }
 
-        if (email_ingestion_ptr) {
-          email_id = email_ingestion_ptr->ingest(msg);
-          append_event("info", "mail_stored", "Email stored in database",
-              {{"uid", msg.uid}, {"email_id", email_id}});
-        }
+  bool modseq_changed = fetch_result.highest_modseq != 0 &&
+                        fetch_result.highest_modseq != checkpoint.highest_modseq;
+  if (modseq_changed) checkpoint.highest_modseq = fetch_result.highest_modseq;
 
-        if (!email_id.empty()) {
-          if (attachment_svc_ptr) attachment_svc_ptr->store_attachments(email_id, msg);
-          if (email_classification_ptr) {
-            append_event("info", "mail_classification_started", "Email classification started",
-                {{"uid", msg.uid}, {"email_id", email_id}});
-            analysis = email_classification_ptr->classify(email_id, msg);
-            append_event("info", "mail_classification_finished", "Email classification finished",
-                {{"uid", msg.uid}, {"kind", to_string(analysis.kind)},
-                 {"level", to_string(analysis.level)},
-                 {"confidence", analysis.confidence},
-                 {"should_notify", analysis.should_notify}});
-          }
-          if (email_decision_ptr) {
-            decision = email_decision_ptr->decide(analysis, msg);
-            std::string action_str =
-                decision.action == email_action::notify    ? "notify"    :
-                decision.action == email_action::form_fill ? "form_fill" : "ignore";
-            append_event("info", "mail_decision_created", "Email decision made",
-                {{"uid", msg.uid}, {"action", action_str}, {"reason", decision.reason}});
-          }
-          pipeline_ok = true;
-        }
+  if (safe_max > checkpoint.last_seen_uid) {
+    checkpoint.last_seen_uid = safe_max;
+    checkpoint.updated_at = now_iso();
+    storage_ptr->save_checkpoint(checkpoint);
+    append_event(
+        "info",
+        "checkpoint_updated",
+        "Mailbox checkpoint updated",
+        {{"mailbox_id", checkpoint.mailbox_id}, {"last_seen_uid", checkpoint.last_seen_uid},
+         {"highest_modseq", checkpoint.highest_modseq}}
+    );
+  } else if (modseq_changed) {
+    checkpoint.updated_at = now_iso();
+    storage_ptr->save_checkpoint(checkpoint);
+  }
 
-        if (pipeline_ok) {
-          if (decision.action == email_action::form_fill) {
-
-            auto wf_result = workflow_ptr->handle_message(msg, rules_copy);
-            std::cout << "[mail] form_fill uid=" << msg.uid
-                      << " matched=" << wf_result.matched << std::endl;
-            if (wf_result.matched) matched++;
-          } else if (decision.action == email_action::notify) {
-            if (notification_ptr) {
-              auto stored = storage_ptr->get_email_message(email_id);
-              if (stored) {
-                notification_ptr->notify_email(*stored, analysis);
-                append_event("info", "mail_important_notified", "Telegram notification sent",
-                    {{"uid", msg.uid}, {"email_id", email_id},
-                     {"importance_level", stored->importance_level}});
-              }
-            }
-            storage_ptr->mark_processed(msg, "important_notified");
-            matched++;
-          } else {
-            storage_ptr->mark_processed(msg, "ignored");
-            append_event("info", "mail_ignored", "Email classified as ignored",
-                {{"uid", msg.uid}, {"reason", decision.reason}});
-          }
-          if (cfg.mail_processing.mark_seen_after_success && mailbox.client) {
-            mailbox.client->mark_message_seen(msg.uid);
-          }
+  {
+    std::lock_guard<std::mutex> lock(mu);
+    mailbox.matched_last = matched;
+    mailbox.last_seen_uid = checkpoint.last_seen_uid;
+    status.mailbox_id = checkpoint.mailbox_id;
+    status.last_seen_uid = checkpoint.last_seen_uid;
+  }
+  return matched;
+}
 
-          if (numeric_uid > max_seen) max_seen = numeric_uid;
-        } else {
+int app::process_message(mailbox_runtime& mailbox,
+                         const std::string& mailbox_id,
+                         message& msg,
+                         const rule_plan& rules) {
+  auto email_id = store_message(mailbox, mailbox_id, msg);
+  if (!email_id) return 0;
+  return handle_stored_message(mailbox, msg, *email_id, rules);
+}
 
-          auto wf_result = workflow_ptr->handle_message(msg, rules_copy);
-          std::cout << "[mail] legacy result uid=" << msg.uid
-                    << " matched=" << wf_result.matched << std::endl;
-          if (wf_result.matched) matched++;
-          if (numeric_uid > max_seen) max_seen = numeric_uid;
+std::vector<int> app::process_messages(mailbox_runtime& mailbox,
+                                       const std::string& mailbox_id,
+                                       std::vector<message>& messages,
+                                       const rule_plan& rules) {
+  std::vector<int> matched(messages.size(), 0);
+  std::size_t batch = static_cast<std::size_t>(std::max(1, cfg.storage.batch_messages));
+  for (std::size_t i = 0; i < messages.size(); i += batch) {
+    std::size_t end = std::min(messages.size(), i + batch);
+    std::vector<std::optional<std::string>> email_ids;
+    {
+      storage_batch unit(*storage_ptr);
+      for (std::size_t j = i; j < end; ++j)
+        email_ids.push_back(store_message(mailbox, mailbox_id, messages[j]));
+    }
+    for (std::size_t j = i; j < end; ++j) {
+      if (email_ids[j - i]) matched[j] = handle_stored_message(mailbox, messages[j], *email_ids[j - i], rules);
+    }
+  }
+  return matched;
+}
+
+std::optional<std::string> app::store_message(mailbox_runtime& mailbox,
+                                              const std::string& mailbox_id,
+                                              message& msg) {
+  if (msg.mailbox_id.empty() || msg.mailbox_id == "default") {
+    msg.mailbox_id = mailbox_id;
+  }
+  if (msg.provider.empty()) msg.provider = mailbox.cfg.provider;
+
+  if (storage_ptr->is_processed(msg.mailbox_id, msg.uid)) {
+    std::cout << "[mail] skip uid=" << msg.uid << " already_processed" << std::endl;
+    return std::nullopt;
+  }
+
+  std::cout << "[mail] process uid=" << msg.uid
+            << " from=" << msg.from
+            << " subject=" << msg.subject << std::endl;
+
+  append_event("info", "mail_fetched", "Email fetched from IMAP",
+      {{"uid", msg.uid}, {"mailbox_id", msg.mailbox_id},
+       {"subject", msg.subject}, {"from", msg.from},
+       {"links", static_cast<int>(msg.links.size())},
+       {"attachments", static_cast<int>(msg.attachments.size())}});
+
+  std::string email_id;
+  if (email_ingestion_ptr) {
+    email_id = email_ingestion_ptr->ingest(msg);
+    append_event("info", "mail_stored", "Email stored in database",
+        {{"uid", msg.uid}, {"email_id", email_id}});
+  }
+  if (!email_id.empty() && attachment_svc_ptr) attachment_svc_ptr->store_attachments(email_id, msg);
+  return email_id;
+}
+
+int app::handle_stored_message(mailbox_runtime& mailbox,
+                               message& msg,
+                               const std::string& email_id,
+                               const rule_plan& rules) {
+  std::unique_lock<std::mutex> pipeline_lock(pipeline_mu);
+  int matched = 0;
+  email_analysis analysis;
+  email_decision decision;
+  bool pipeline_ok = false;
+
+  if (!email_id.empty()) {
+    if (email_classification_ptr) {
+      append_event("info", "mail_classification_started", "Email classification started",
+          {{"uid", msg.uid}, {"email_id", email_id}});
+      analysis = email_classification_ptr->classify(email_id, msg);
+      append_event("info", "mail_classification_finished", "Email classification finished",
+          {{"uid", msg.uid}, {"kind", to_string(analysis.kind)},
+           {"level", to_string(analysis.level)},
+           {"confidence", analysis.confidence},
+           {"should_notify", analysis.should_notify}});
+    }
+    if (email_decision_ptr) {
+      decision = email_decision_ptr->decide(analysis, msg);
+      std::string action_str =
+          decision.action == email_action::notify    ? "notify"    :
+          decision.action == email_action::form_fill ? "form_fill" : "ignore";
+      append_event("info", "mail_decision_created", "Email decision made",
+          {{"uid", msg.uid}, {"action", action_str}, {"reason", decision.reason}});
+    }
+    pipeline_ok = true;
+  }
+
+  if (pipeline_ok) {
+    if (decision.action == email_action::form_fill) {
+
+      auto wf_result = workflow_ptr->handle_message(msg, rules);
+      std::cout << "[mail] form_fill uid=" << msg.uid
+                << " matched=" << wf_result.matched << std::endl;
+      if (wf_result.matched) matched++;
+    } else if (decision.action == email_action::notify) {
+      if (notification_ptr) {
+        auto stored = storage_ptr->get_email_message(email_id);
+        if (stored) {
+          notification_ptr->notify_email(*stored, analysis);
+          append_event("info", "mail_important_notified", "Telegram notification sent",
+              {{"uid", msg.uid}, {"email_id", email_id},
+               {"importance_level", stored->importance_level}});
         }
       }
+      storage_ptr->mark_processed(msg, "important_notified");
+      matched++;
+    } else {
+      storage_ptr->mark_processed(msg, "ignored");
+      append_event("info", "mail_ignored", "Email classified as ignored",
+          {{"uid", msg.uid}, {"reason", decision.reason}});
+    }
+    pipeline_lock.unlock();
+    if (cfg.mail_processing.mark_seen_after_success && mailbox.client) {
+      mailbox.client->mark_message_seen(msg.uid);
+    }
+  } else {
 
+    auto wf_result = workflow_ptr->handle_message(msg, rules);
+    std::cout << "[mail] legacy result uid=" << msg.uid
+              << " matched=" << wf_result.matched << std::endl;
+    if (wf_result.matched) matched++;
+  }
+  return matched;
+}
 
-      std::uint64_t safe_max = (min_suspect_uid != UINT64_MAX && min_suspect_uid > 0)
-          ? std::min(max_seen, min_suspect_uid - 1)
-          : max_seen;
+void app::run(bool once) {
+  if (!storage_ptr) {
+    std::cerr << "app not configured" << std::endl;
+    return;
+  }
 
-      if (safe_max > checkpoint.last_seen_uid) {
-        checkpoint.last_seen_uid = safe_max;
-        checkpoint.updated_at = now_iso();
-        storage_ptr->save_checkpoint(checkpoint);
-        append_event(
-            "info",
-            "checkpoint_updated",
-            "Mailbox checkpoint updated",
-            {{"mailbox_id", checkpoint.mailbox_id}, {"last_seen_uid", checkpoint.last_seen_uid}}
-        );
-      }
+  while (true) {
+    load_rules_if_changed();
+    std::shared_ptr<const rule_plan> rules = engine.plan();
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      status.last_check = now_iso();
+    }
 
-      matched_total += matched;
-      {
-        std::lock_guard<std::mutex> lock(mu);
-        mailbox.matched_last = matched;
-        mailbox.last_seen_uid = checkpoint.last_seen_uid;
-        status.mailbox_id = checkpoint.mailbox_id;
-        status.last_seen_uid = checkpoint.last_seen_uid;
+    std::atomic<int> matched_total{0};
+    std::size_t workers = std::min<std::size_t>(
+        static_cast<std::size_t>(std::max(1, cfg.mailbox_workers)), mailboxes.size());
+    std::atomic<std::size_t> next_mailbox{0};
+    auto worker = [&]() {
+      for (std::size_t i = next_mailbox++; i < mailboxes.size(); i = next_mailbox++) {
+        try {
+          matched_total += poll_mailbox(mailboxes[i], *rules);
+        } catch (const std::exception& ex) {
+          {
+            std::lock_guard<std::mutex> lock(mu);
+            mailboxes[i].last_error = ex.what();
+          }
+          append_event("error", "mailbox_poll_failed", "Mailbox poll failed",
+              {{"mailbox_id", mailboxes[i].cfg.mailbox_id}, {"error", ex.what()}});
+        }
       }
+    };
+    ++live_polls;
+    if (workers <= 1) {
+      worker();
+    } else {
+      std::vector<std::thread> pool;
+      for (std::size_t w = 0; w < workers; ++w) pool.emplace_back(worker);
+      for (auto& t : pool) t.join();
     }
+    --live_polls;
 
     {
       std::lock_guard<std::mutex> lock(mu);
@@ -812,7 +1032,9 @@ void app::run(bool once) {
     }
 
     if (once) break;
-    std::this_thread::sleep_for(seconds(cfg.imap.poll_interval_sec));
+    std::unique_lock<std::mutex> wake_lock(wake_mu);
+    wake_cv.wait_for(wake_lock, seconds(cfg.imap.poll_interval_sec), [this]() { return wake_pending; });
+    wake_pending = false;
   }
 }
 
@@ -899,10 +1121,55 @@ std::string app::events_json(int limit) const {
   return out.dump(2);
 }
 
-std::string app::rules_json() const {
-  std::lock_guard<std::mutex> lock(mu);
-  if (!rules_raw.empty()) return rules_raw;
-  return rules_to_json(rules);
+static nlohmann::json counters_to_json(const rule_counters& counters) {
+  std::uint64_t evaluations = counters.evaluations.load(std::memory_order_relaxed);
+  std::uint64_t total_ns = counters.total_ns.load(std::memory_order_relaxed);
+  return {
+      {"evaluations", evaluations},
+      {"hits", counters.hits.load(std::memory_order_relaxed)},
+      {"total_ns", total_ns},
+      {"avg_ns", evaluations ? total_ns / evaluations : 0},
+  };
+}
+
+std::string app::rules_json(bool with_stats) const {
+  if (!with_stats) {
+    std::lock_guard<std::mutex> lock(mu);
+    if (!rules_raw.empty()) return rules_raw;
+    return rules_to_json(engine.plan()->rules);
+  }
+
+  auto plan = engine.plan();
+  nlohmann::json out = nlohmann::json::parse(rules_to_json(plan->rules));
+  auto& rules = out["rules"];
+  for (std::size_t i = 0; i < plan->rules.size() && i < rules.size(); ++i) {
+    rules[i]["stats"] = counters_to_json(plan->stats_for(i));
+    auto& conds = rules[i]["conditions"];
+    for (std::size_t k = 0; k < plan->rules[i].conditions.size() && k < conds.size(); ++k)
+      conds[k]["stats"] = counters_to_json(plan->stats_for(i, k));
+  }
+  return out.dump(2);
+}
+
+std::string app::rules_stats_json() const {
+  auto plan = engine.plan();
+  nlohmann::json rules = nlohmann::json::array();
+  for (std::size_t i = 0; i < plan->rules.size(); ++i) {
+    const rule& r = plan->rules[i];
+    nlohmann::json item = counters_to_json(plan->stats_for(i));
+    item["id"] = r.id;
+    item["name"] = r.name;
+    item["enabled"] = r.enabled;
+    nlohmann::json conds = nlohmann::json::array();
+    for (std::size_t k = 0; k < r.conditions.size(); ++k) {
+      nlohmann::json c = counters_to_json(plan->stats_for(i, k));
+      c["field"] = r.conditions[k].field;
+      conds.push_back(std::move(c));
+    }
+    item["conditions"] = std::move(conds);
+    rules.push_back(std::move(item));
+  }
+  return nlohmann::json{{"rules", std::move(rules)}, {"errors", plan->errors}}.dump(2);
 }
 
 bool app::update_rules_json(const std::string& text, std::string& err) {
@@ -1030,7 +1297,7 @@ bool app::update_profile_json(const std::string& body, std::string& err) {
 
 std::string app::config_json() const {
   nlohmann::json out;
-  out["app"] = {{"events_limit", cfg.events_limit}, {"log_level", cfg.log_level}};
+  out["app"] = {{"events_limit", cfg.events_limit}, {"mailbox_workers", cfg.mailbox_workers}, {"log_level", cfg.log_level}};
   out["mailboxes"] = nlohmann::json::array();
   auto mailbox_configs = cfg.mailboxes.empty() ? std::vector<imap_config>{cfg.imap} : cfg.mailboxes;
   for (const auto& mailbox : mailbox_configs) {
@@ -1223,6 +1490,8 @@ std::string app::test_imap_json() {
     item["auth_ok"] = result.auth_ok;
     item["folder_ok"] = result.folder_ok;
     item["max_uid"] = result.max_uid;
+    item["uid_next"] = result.uid_next;
+    item["messages"] = result.messages;
     item["error"] = result.error;
     if (!result.reachable || !result.auth_ok || !result.folder_ok) out["ok"] = false;
     out["mailboxes"].push_back(std::move(item));
@@ -1250,7 +1519,7 @@ std::string app::test_llm_json() {
        << ": need at least " << cfg.llm.min_memory_gb << "GB";
     warning = ss.str();
     next_action = "Use Noop fallback, choose a smaller model, or run on a machine with more RAM";
-    test_client = make_noop_llm_client();
+    test_client = make_noop_llm_client(cfg.llm);
   } else if (cfg.llm.enabled) {
     auto probe = probe_ollama_endpoint(cfg.llm);
     reachable = probe.reachable;
@@ -1275,16 +1544,16 @@ std::string app::test_llm_json() {
           {"next_action", next_action}
       };
       append_event("warn", "llm_fallback", "Ollama unavailable, using NoopLlmClient", data);
-      test_client = make_noop_llm_client();
+      test_client = make_noop_llm_client(cfg.llm);
     }
   } else {
     warning = "Local LLM is disabled; using rule-based mapping";
     next_action = "Set LLM_ENABLED=true and run docker compose --profile llm up --build";
-    test_client = make_noop_llm_client();
+    test_client = make_noop_llm_client(cfg.llm);
   }
 
   message msg = make_sample_form_message();
-  auto sample_client = make_noop_llm_client();
+  auto sample_client = make_noop_llm_client(cfg.llm);
   auto analysis = sample_client->analyze_email(msg);
   form_snapshot sample_form = make_sample_mapping_form();
   auto mapped = sample_client->map_fields(msg, sample_form, make_sample_profile());
@@ -1310,7 +1579,7 @@ std::string app::test_llm_json() {
     fallback = true;
     active_client = "NoopLlmClient";
     model_ready = false;
-    auto noop = make_noop_llm_client();
+    auto noop = make_noop_llm_client(cfg.llm);
     mapped = noop->map_fields(msg, sample_form, make_sample_profile());
     sample_mapping_ok = mapping_ok(mapped);
     warning = "Ollama sample mapping failed validation; using rule-based mapping";
@@ -1689,7 +1958,7 @@ std::string app::remap_form_json(const std::string& id, const std::string& body)
   std::unique_ptr<llm_client> noop;
   llm_client* mapper = llm_ptr.get();
   if (!use_llm) {
-    noop = make_noop_llm_client();
+    noop = make_noop_llm_client(cfg.llm);
     mapper = noop.get();
   }
   auto remapped = mapper->map_fields(msg, snapshot, profile);
@@ -1847,6 +2116,8 @@ std::string app::mail_debug_json() const {
     for (const auto& mailbox : mailboxes) {
       std::string masked_user = mailbox.cfg.username;
       if (masked_user.size() > 2) masked_user = masked_user.substr(0, 2) + "***";
+      mail_session_stats session;
+      if (mailbox.client) session = mailbox.client->session_stats();
       out["mailboxes"].push_back({
           {"id", mailbox.cfg.mailbox_id},
           {"provider", mailbox.cfg.provider},
@@ -1859,7 +2130,25 @@ std::string app::mail_debug_json() const {
           {"last_error", mailbox.last_error},
           {"last_seen_uid", mailbox.last_seen_uid},
           {"last_check", mailbox.last_check},
-          {"matched_last", mailbox.matched_last}
+          {"matched_last", mailbox.matched_last},
+          {"session", {
+              {"connected", session.connected},
+              {"connects", session.connects},
+              {"reconnects", session.reconnects},
+              {"idle_expired", session.idle_expired},
+              {"commands", session.commands},
+              {"reused_commands", session.reused_commands},
+              {"failures", session.failures},
+              {"condstore", session.condstore},
+              {"qresync", session.qresync},
+              {"push_mode", session.push_mode},
+              {"idle_waiting", session.idle_waiting},
+              {"idle_rounds", session.idle_rounds},
+              {"idle_wakeups", session.idle_wakeups},
+              {"connected_at", session.connected_at},
+              {"last_used_at", session.last_used_at},
+              {"last_error", session.last_error}
+          }}
       });
     }
   }
@@ -1911,6 +2200,7 @@ std::string app::mail_reset_state_json(const std::string& mailbox_id_param) {
   reset.started_at = now_iso();
   reset.updated_at = reset.started_at;
   storage_ptr->save_checkpoint(reset);
+  storage_ptr->set_checkpoint_backfill(target_id, 0);
 
   {
     std::lock_guard<std::mutex> lock(mu);
@@ -1968,6 +2258,13 @@ std::string app::expand_profile_preview_json(const std::string& body) {
 }
 
 
+static std::int64_t epoch_param(const std::string& value) {
+  if (std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); })) {
+    try { return std::stoll(value); } catch (...) { return 0; }
+  }
+  return parse_mail_date(value);
+}
+
 static nlohmann::json stored_email_summary_to_json(const stored_email& e) {
   int att_count = 0;
   if (!e.attachments_json.empty() && e.attachments_json != "[]") {
@@ -1980,6 +2277,7 @@ static nlohmann::json stored_email_summary_to_json(const stored_email& e) {
     {"from", e.from_addr},
     {"subject", e.subject},
     {"date", e.date_iso},
+    {"received_at", e.received_at ? format_epoch_iso(e.received_at) : ""},
     {"snippet", e.snippet},
     {"importance_level", e.importance_level},
     {"importance_score", e.importance_score},
@@ -2007,16 +2305,25 @@ static nlohmann::json stored_email_detail_to_json(const stored_email& e) {
   return j;
 }
 
-std::string app::mail_list_json(const std::string& filter, int limit, int offset) const {
+std::string app::mail_list_json(const std::string& filter, int limit, int offset,
+                                const std::string& before, const std::string& since,
+                                const std::string& until) const {
   if (!storage_ptr) return api_error("storage not available").dump(2);
   email_list_filter f;
   f.status = filter.empty() ? "all" : filter;
+  f.before_id = before;
+  if (!since.empty() && !(f.since = epoch_param(since)))
+    return api_error("since must be epoch seconds or a date", {{"since", since}}).dump(2);
+  if (!until.empty() && !(f.until = epoch_param(until)))
+    return api_error("until must be epoch seconds or a date", {{"until", until}}).dump(2);
   if (limit <= 0 || limit > 100) limit = 20;
   if (offset < 0) offset = 0;
   auto emails = storage_ptr->list_emails(f, limit, offset);
   nlohmann::json arr = nlohmann::json::array();
   for (const auto& e : emails) arr.push_back(stored_email_summary_to_json(e));
-  return nlohmann::json({{"ok", true}, {"filter", filter}, {"count", (int)arr.size()}, {"emails", arr}}).dump(2);
+  std::string next_cursor = static_cast<int>(emails.size()) == limit ? emails.back().id : "";
+  return nlohmann::json({{"ok", true}, {"filter", filter}, {"count", (int)arr.size()},
+                         {"next_cursor", next_cursor}, {"emails", arr}}).dump(2);
 }
 
 std::string app::mail_get_json(const std::string& id) const {
@@ -2134,7 +2441,11 @@ std::string app::mail_search_json(const std::string& query, int limit, int offse
   if (offset < 0) offset = 0;
   auto emails = storage_ptr->search_emails(query, limit, offset);
   nlohmann::json arr = nlohmann::json::array();
-  for (const auto& e : emails) arr.push_back(stored_email_summary_to_json(e));
+  for (const auto& e : emails) {
+    nlohmann::json item = stored_email_summary_to_json(e);
+    item["highlight"] = e.match_highlight;
+    arr.push_back(std::move(item));
+  }
   return nlohmann::json({{"ok", true}, {"query", query}, {"count", (int)arr.size()}, {"emails", arr}}).dump(2);
 }
 
@@ -24,11 +24,15 @@
 
 #include <nlohmann/json.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 struct app_status {
@@ -63,7 +67,8 @@ public:
 
   std::string status_json() const;
   std::string events_json(int limit) const;
-  std::string rules_json() const;
+  std::string rules_json(bool with_stats = false) const;
+  std::string rules_stats_json() const;
   bool update_rules_json(const std::string& text, std::string& err);
   std::string active_forms_json(bool all = false) const;
   std::string form_json(const std::string& id) const;
@@ -97,7 +102,9 @@ public:
   std::string mail_scan_last_json(int n);
   std::string mail_reset_state_json(const std::string& mailbox_id = {});
 
-  std::string mail_list_json(const std::string& filter, int limit, int offset) const;
+  std::string mail_list_json(const std::string& filter, int limit, int offset,
+                             const std::string& before = "", const std::string& since = "",
+                             const std::string& until = "") const;
   std::string mail_get_json(const std::string& id) const;
   bool mail_mark_read(const std::string& id, std::string& err);
   bool mail_archive(const std::string& id, std::string& err);
@@ -115,14 +122,42 @@ public:
 
 private:
   mailbox_checkpoint ensure_checkpoint(mailbox_runtime& mailbox);
+  void apply_backfill_policy(mailbox_runtime& mailbox, mailbox_checkpoint& checkpoint);
+  int poll_mailbox(mailbox_runtime& mailbox, const rule_plan& rules);
+  int process_message(mailbox_runtime& mailbox,
+                      const std::string& mailbox_id,
+                      message& msg,
+                      const rule_plan& rules);
+  // Stores up to storage.batch_messages messages per transaction, then runs
+  // classification and actions outside of it; returns matches per message.
+  // Callers hold a storage_deferral so the processed marks and
+  // classification updates commit together afterwards.
+  std::vector<int> process_messages(mailbox_runtime& mailbox,
+                                    const std::string& mailbox_id,
+                                    std::vector<message>& messages,
+                                    const rule_plan& rules);
+  // nullopt when the message was already processed, "" when it was not stored.
+  std::optional<std::string> store_message(mailbox_runtime& mailbox,
+                                           const std::string& mailbox_id,
+                                           message& msg);
+  int handle_stored_message(mailbox_runtime& mailbox,
+                            message& msg,
+                            const std::string& email_id,
+                            const rule_plan& rules);
+  void backfill_loop();
+  bool backfill_mailbox(mailbox_runtime& mailbox);
   void load_rules_if_changed();
   bool send_action(const message& msg, const action& a, std::string& err);
+  void wake_poll();
   void append_event(std::string level,
                     std::string type,
                     std::string message_text,
                     nlohmann::json data = nlohmann::json::object());
 
   app_config cfg;
+  std::mutex wake_mu;
+  std::condition_variable wake_cv;
+  bool wake_pending = false;
   std::vector<mailbox_runtime> mailboxes;
   std::unique_ptr<telegram_notifier> telegram_notifier_ptr;
   std::unique_ptr<storage> storage_ptr;
@@ -143,7 +178,10 @@ private:
   std::unique_ptr<telegram_mail_controller> mail_controller_ptr;
 
   mutable std::mutex mu;
-  std::vector<rule> rules;
+  std::mutex pipeline_mu;
+  std::thread backfill_thread;
+  std::atomic<bool> backfill_stop{false};
+  std::atomic<int> live_polls{0};
   std::string rules_raw;
   std::filesystem::file_time_type rules_mtime{};
   app_status status;
@@ -169,6 +169,17 @@ static imap_config parse_mailbox_config(const json& mailbox, const imap_config&
   cfg.checkpoint_mode = get_string(mailbox, "checkpoint_mode", cfg.checkpoint_mode);
   cfg.poll_interval_sec = get_int(mailbox, "poll_interval_sec", cfg.poll_interval_sec);
   cfg.mark_seen = get_bool(mailbox, "mark_seen", cfg.mark_seen);
+  cfg.command_timeout_sec = get_int(mailbox, "command_timeout_sec", cfg.command_timeout_sec);
+  cfg.session_idle_timeout_sec =
+      get_int(mailbox, "session_idle_timeout_sec", cfg.session_idle_timeout_sec);
+  cfg.fetch_batch_size = get_int(mailbox, "fetch_batch_size", cfg.fetch_batch_size);
+  cfg.fetch_mode = get_string(mailbox, "fetch_mode", cfg.fetch_mode);
+  cfg.idle = get_bool(mailbox, "idle", cfg.idle);
+  cfg.idle_refresh_sec = get_int(mailbox, "idle_refresh_sec", cfg.idle_refresh_sec);
+  cfg.backfill_mode = get_string(mailbox, "backfill_mode", cfg.backfill_mode);
+  cfg.backfill_days = get_int(mailbox, "backfill_days", cfg.backfill_days);
+  cfg.backfill_messages = get_int(mailbox, "backfill_messages", cfg.backfill_messages);
+  cfg.backfill_pause_ms = get_int(mailbox, "backfill_pause_ms", cfg.backfill_pause_ms);
   apply_provider_preset(cfg);
   return cfg;
 }
@@ -258,6 +269,8 @@ bool load_app_config(const std::string& path, app_config& out, std::string& err)
 
   const json storage = root.value("storage", json::object());
   out.storage.path = get_string(storage, "sqlite_path", get_string(storage, "path", out.storage.path));
+  out.storage.read_connections = get_int(storage, "read_connections", out.storage.read_connections);
+  out.storage.batch_messages = get_int(storage, "batch_messages", out.storage.batch_messages);
 
   const json browser_worker = root.value("browser_worker", json::object());
   out.browser_worker.enabled = get_bool(browser_worker, "enabled", out.browser_worker.enabled);
@@ -347,6 +360,11 @@ bool load_app_config(const std::string& path, app_config& out, std::string& err)
   if (llm.contains("recommended_memory_gb") && llm["recommended_memory_gb"].is_number()) {
     out.llm.recommended_memory_gb = llm["recommended_memory_gb"].get<double>();
   }
+  const json keyword_groups = llm.value("keyword_groups", json::object());
+  if (keyword_groups.is_object()) {
+    for (auto it = keyword_groups.begin(); it != keyword_groups.end(); ++it)
+      out.llm.keyword_groups[it.key()] = json_to_string_vector(it.value());
+  }
   apply_env_override(out.llm.enabled, "LLM_ENABLED");
   apply_env_override(out.llm.provider, "LLM_PROVIDER");
   apply_env_override(out.llm.endpoint, out.llm.endpoint_env.c_str());
@@ -441,6 +459,7 @@ bool load_app_config(const std::string& path, app_config& out, std::string& err)
   out.events_limit = get_int(app, "events_limit", get_int(root, "events_limit", out.events_limit));
   out.log_level = get_string(app, "log_level", get_string(root, "log_level", out.log_level));
   out.timezone = get_string(app, "timezone", out.timezone);
+  out.mailbox_workers = get_int(app, "mailbox_workers", out.mailbox_workers);
   out.demo_mode = get_bool(app, "demo_mode", out.demo_mode);
   out.imap.poll_interval_sec = get_int(
       app,
@@ -2,6 +2,7 @@
 
 #include "../domain/Rule.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -19,6 +20,16 @@ struct imap_config {
   std::string checkpoint_mode = "uid";
   int poll_interval_sec = 20;
   bool mark_seen = false;
+  int command_timeout_sec = 30;
+  int session_idle_timeout_sec = 300;
+  int fetch_batch_size = 20;
+  std::string fetch_mode = "headers_first";
+  bool idle = true;
+  int idle_refresh_sec = 1740;
+  std::string backfill_mode = "days";
+  int backfill_days = 7;
+  int backfill_messages = 200;
+  int backfill_pause_ms = 250;
 };
 
 struct telegram_config {
@@ -53,6 +64,8 @@ struct http_config {
 
 struct storage_config {
   std::string path = "data/app.db";
+  int read_connections = 3;
+  int batch_messages = 50;
 };
 
 struct browser_worker_config {
@@ -108,6 +121,7 @@ struct llm_config {
   bool startup_probe = true;
   double min_memory_gb = 6.0;
   double recommended_memory_gb = 8.0;
+  std::map<std::string, std::vector<std::string>> keyword_groups;
 };
 
 struct security_config {
@@ -183,6 +197,7 @@ struct app_config {
   int backoff_base_ms = 500;
   int backoff_max_ms = 8000;
   int events_limit = 200;
+  int mailbox_workers = 4;
   std::string timezone = "Europe/Moscow";
   bool demo_mode = false;
   std::string log_level = "info";
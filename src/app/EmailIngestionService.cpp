@@ -13,14 +13,15 @@ std::string email_ingestion_service::ingest(const message& msg) {
   email.to_addr     = msg.to;
   email.subject     = msg.subject;
   email.date_iso    = msg.date_iso;
+  email.received_at = msg.received_at;
   email.snippet     = msg.snippet;
   email.status      = "new";
 
   int max_chars = cfg.mail_processing.max_body_chars_to_store;
-  std::string body = msg.body_text.empty() ? msg.body : msg.body_text;
+  std::string_view body = message_text(msg);
   if (max_chars > 0 && static_cast<int>(body.size()) > max_chars)
-    body.resize(static_cast<size_t>(max_chars));
-  if (cfg.mail_processing.store_body_for_important) email.body_text = body;
+    body = body.substr(0, static_cast<size_t>(max_chars));
+  if (cfg.mail_processing.store_body_for_important) email.body_text.assign(body);
 
   if (!msg.links.empty()) {
     json links_arr = json::array();
@@ -1,5 +1,6 @@
 #include "FormUnderstandingEngine.h"
 #include "ProfileFactGraph.h"
+#include "../util/CaseFold.h"
 
 #include <algorithm>
 #include <cctype>
@@ -63,22 +64,7 @@ std::string field_label(const form_field& field) {
 namespace {
 
 std::string lower_copy(std::string text) {
-  std::transform(text.begin(), text.end(), text.begin(),
-                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-  const std::vector<std::pair<std::string, std::string>> ru = {
-      {"А", "а"}, {"Б", "б"}, {"В", "в"}, {"Г", "г"}, {"Д", "д"}, {"Е", "е"}, {"Ё", "ё"},
-      {"Ж", "ж"}, {"З", "з"}, {"И", "и"}, {"Й", "й"}, {"К", "к"}, {"Л", "л"}, {"М", "м"},
-      {"Н", "н"}, {"О", "о"}, {"П", "п"}, {"Р", "р"}, {"С", "с"}, {"Т", "т"}, {"У", "у"},
-      {"Ф", "ф"}, {"Х", "х"}, {"Ц", "ц"}, {"Ч", "ч"}, {"Ш", "ш"}, {"Щ", "щ"}, {"Ъ", "ъ"},
-      {"Ы", "ы"}, {"Ь", "ь"}, {"Э", "э"}, {"Ю", "ю"}, {"Я", "я"}
-  };
-  for (const auto& [from, to] : ru) {
-    size_t pos = 0;
-    while ((pos = text.find(from, pos)) != std::string::npos) {
-      text.replace(pos, from.size(), to);
-      pos += to.size();
-    }
-  }
+  case_fold_in_place(text);
   return text;
 }
 
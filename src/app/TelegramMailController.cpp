@@ -84,25 +84,19 @@ void telegram_mail_controller::cmd_mail(const std::string& ) {
   bot.send_message(text.str(), kb, err);
 }
 
-void telegram_mail_controller::cmd_important(const std::string& chat_id) {
-  email_list_filter filter;
-  filter.status = "important";
-  auto emails = store.list_emails(filter, PAGE_SIZE, 0);
-  send_email_list(chat_id, emails, "\xF0\x9F\x94\xB4 Важные письма");
+void telegram_mail_controller::cmd_important(const std::string& chat_id,
+                                              const std::string& before_id) {
+  send_email_page(chat_id, "important", PAGE_SIZE, before_id, "\xF0\x9F\x94\xB4 Важные письма");
 }
 
-void telegram_mail_controller::cmd_unread(const std::string& chat_id) {
-  email_list_filter filter;
-  filter.status = "unread";
-  auto emails = store.list_emails(filter, PAGE_SIZE, 0);
-  send_email_list(chat_id, emails, "\xF0\x9F\x93\xA7 Непрочитанные");
+void telegram_mail_controller::cmd_unread(const std::string& chat_id,
+                                           const std::string& before_id) {
+  send_email_page(chat_id, "unread", PAGE_SIZE, before_id, "\xF0\x9F\x93\xA7 Непрочитанные");
 }
 
-void telegram_mail_controller::cmd_digest(const std::string& chat_id) {
-  email_list_filter filter;
-  filter.status = "all";
-  auto emails = store.list_emails(filter, 10, 0);
-  send_email_list(chat_id, emails, "\xF0\x9F\x93\x8B Дайджест");
+void telegram_mail_controller::cmd_digest(const std::string& chat_id,
+                                           const std::string& before_id) {
+  send_email_page(chat_id, "all", 10, before_id, "\xF0\x9F\x93\x8B Дайджест");
 }
 
 void telegram_mail_controller::cmd_search(const std::string& chat_id,
@@ -152,9 +146,10 @@ void telegram_mail_controller::send_email_list(const std::string& ,
     if (!email.date_iso.empty()) text << "\xF0\x9F\x95\x90 " << email.date_iso << "\n";
     if (!email.category.empty() && email.category != "other")
       text << "\xF0\x9F\x8F\xB7 " << email.category << "\n";
-    if (!email.snippet.empty()) {
-      std::string snip = email.snippet.substr(0, 120);
-      if (email.snippet.size() > 120) snip += "…";
+    const std::string& preview = email.match_highlight.empty() ? email.snippet : email.match_highlight;
+    if (!preview.empty()) {
+      std::string snip = preview.substr(0, 120);
+      if (preview.size() > 120) snip += "…";
       text << snip;
     }
 
@@ -188,6 +183,27 @@ void telegram_mail_controller::send_email_list(const std::string& ,
   }
 }
 
+// A full page gets a "more" button that carries the last email as the keyset
+// cursor, so later pages cost the same as the first one.
+void telegram_mail_controller::send_email_page(const std::string& chat_id,
+                                                const std::string& status,
+                                                int limit,
+                                                const std::string& before_id,
+                                                const std::string& title) {
+  email_list_filter filter;
+  filter.status = status;
+  filter.before_id = before_id;
+  auto emails = store.list_emails(filter, limit, 0);
+  send_email_list(chat_id, emails, title);
+  if (static_cast<int>(emails.size()) < limit) return;
+
+  std::string tok_more = store.save_telegram_callback_token(
+      "mail:list:more", json{{"status", status}, {"before_id", emails.back().id}}.dump(), 7200);
+  std::string err;
+  bot.send_message("\xE2\xAC\x87 Показать ещё?",
+                   {{{"\xE2\x9E\xA1 Ещё", "mtok:" + tok_more, ""}}}, err);
+}
+
 void telegram_mail_controller::send_email_detail(const std::string& ,
                                                    const stored_email& email,
                                                    int page) {
@@ -379,6 +395,13 @@ void telegram_mail_controller::handle_mtok(const std::string& chat_id,
     } else if (rec->action == "mail:list:digest") {
       bot.answer_callback_query(callback_query_id, "", err);
       cmd_digest(chat_id);
+    } else if (rec->action == "mail:list:more") {
+      bot.answer_callback_query(callback_query_id, "", err);
+      std::string status = payload.value("status", "");
+      std::string before_id = payload.value("before_id", "");
+      if (status == "important") cmd_important(chat_id, before_id);
+      else if (status == "unread") cmd_unread(chat_id, before_id);
+      else cmd_digest(chat_id, before_id);
     } else if (rec->action == "mail:diagnostics") {
       bot.answer_callback_query(callback_query_id, "", err);
       cmd_diagnostics(chat_id);
@@ -24,15 +24,20 @@ private:
   static const int PAGE_BODY_CHARS = 3000;
 
   void cmd_mail(const std::string& chat_id);
-  void cmd_important(const std::string& chat_id);
-  void cmd_unread(const std::string& chat_id);
-  void cmd_digest(const std::string& chat_id);
+  void cmd_important(const std::string& chat_id, const std::string& before_id = "");
+  void cmd_unread(const std::string& chat_id, const std::string& before_id = "");
+  void cmd_digest(const std::string& chat_id, const std::string& before_id = "");
   void cmd_search(const std::string& chat_id, const std::string& query);
   void cmd_diagnostics(const std::string& chat_id);
 
   void send_email_list(const std::string& chat_id,
                        const std::vector<stored_email>& emails,
                        const std::string& title);
+  void send_email_page(const std::string& chat_id,
+                       const std::string& status,
+                       int limit,
+                       const std::string& before_id,
+                       const std::string& title);
   void send_email_detail(const std::string& chat_id,
                          const stored_email& email,
                          int page = 0);
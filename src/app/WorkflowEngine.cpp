@@ -190,7 +190,7 @@ std::optional<message_link> workflow_engine::choose_form_link(const message& msg
   return std::nullopt;
 }
 
-workflow_result workflow_engine::handle_message(const message& msg, const std::vector<rule>& rules) {
+workflow_result workflow_engine::handle_message(const message& msg, const rule_plan& rules) {
   workflow_result out;
   auto match = rules_engine.apply(msg, rules);
   if (!match.matched) {
@@ -32,7 +32,7 @@ public:
                   user_profile profile,
                   telegram_bot* telegram);
 
-  workflow_result handle_message(const message& msg, const std::vector<rule>& rules);
+  workflow_result handle_message(const message& msg, const rule_plan& rules);
   bool fill_form_after_review(const std::string& session_id, std::string& err);
   bool submit_form_after_confirm(const std::string& session_id, std::string& err);
   bool mark_manual_required(const std::string& session_id, std::string& err);
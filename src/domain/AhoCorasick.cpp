@@ -0,0 +1,94 @@
+#include "AhoCorasick.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+static unsigned char fold_ascii(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+void aho_corasick::add(std::string_view pattern_text, std::uint32_t id) {
+  if (pattern_text.empty()) return;
+  pattern p;
+  p.text.assign(pattern_text);
+  if (fold)
+    for (auto& c : p.text) c = static_cast<char>(fold_ascii(static_cast<unsigned char>(c)));
+  p.id = id;
+  patterns.push_back(std::move(p));
+}
+
+// Bytes that never occur in a pattern share class 0, so the transition table
+// is states x (distinct pattern bytes + 1) rather than states x 256.
+void aho_corasick::build() {
+  byte_class.fill(0);
+  classes = 1;
+  for (const auto& p : patterns) {
+    for (unsigned char c : p.text)
+      if (byte_class[c] == 0) byte_class[c] = classes++;
+  }
+  if (fold)
+    for (unsigned c = 'A'; c <= 'Z'; ++c) byte_class[c] = byte_class[c + ('a' - 'A')];
+
+  const std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+  delta.assign(classes, none);
+  std::vector<std::vector<std::uint32_t>> own(1);
+  for (const auto& p : patterns) {
+    std::uint32_t state = 0;
+    for (unsigned char c : p.text) {
+      std::size_t idx = static_cast<std::size_t>(state) * classes + byte_class[c];
+      if (delta[idx] == none) {
+        auto next = static_cast<std::uint32_t>(own.size());
+        own.emplace_back();
+        delta[idx] = next;
+        delta.resize(own.size() * classes, none);
+      }
+      state = delta[idx];
+    }
+    own[state].push_back(p.id);
+  }
+
+  const std::size_t states = own.size();
+  std::vector<std::uint32_t> fail(states, 0);
+  dict.assign(states, 0);
+  first.assign(states, 0);
+
+  std::vector<std::uint32_t> queue;
+  queue.reserve(states);
+  for (std::uint32_t k = 0; k < classes; ++k) {
+    std::uint32_t& t = delta[k];
+    if (t == none) {
+      t = 0;
+    } else {
+      queue.push_back(t);
+    }
+  }
+  for (std::size_t head = 0; head < queue.size(); ++head) {
+    std::uint32_t s = queue[head];
+    for (std::uint32_t k = 0; k < classes; ++k) {
+      std::size_t idx = static_cast<std::size_t>(s) * classes + k;
+      std::uint32_t via_fail = delta[static_cast<std::size_t>(fail[s]) * classes + k];
+      if (delta[idx] == none) {
+        delta[idx] = via_fail;
+        continue;
+      }
+      std::uint32_t t = delta[idx];
+      fail[t] = via_fail;
+      dict[t] = own[via_fail].empty() ? dict[via_fail] : via_fail;
+      queue.push_back(t);
+    }
+  }
+
+  out_begin.assign(states + 1, 0);
+  out_ids.clear();
+  for (std::size_t s = 0; s < states; ++s) {
+    out_begin[s] = static_cast<std::uint32_t>(out_ids.size());
+    out_ids.insert(out_ids.end(), own[s].begin(), own[s].end());
+    first[s] = own[s].empty() ? dict[s] : static_cast<std::uint32_t>(s);
+  }
+  out_begin[states] = static_cast<std::uint32_t>(out_ids.size());
+}
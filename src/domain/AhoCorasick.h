@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+class aho_corasick {
+public:
+  explicit aho_corasick(bool ascii_case_fold = false) : fold(ascii_case_fold) {}
+
+  void add(std::string_view pattern, std::uint32_t id);
+  void build();
+
+  bool empty() const { return patterns.empty(); }
+  std::size_t state_count() const { return first.size(); }
+
+  template <typename OnMatch>
+  void scan(std::string_view text, OnMatch&& on_match) const {
+    if (first.empty()) return;
+    std::uint32_t state = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+      state = delta[state * classes + byte_class[static_cast<unsigned char>(text[i])]];
+      for (std::uint32_t s = first[state]; s != 0; s = dict[s])
+        for (std::uint32_t k = out_begin[s]; k < out_begin[s + 1]; ++k) on_match(out_ids[k], i + 1);
+    }
+  }
+
+private:
+  struct pattern {
+    std::string text;
+    std::uint32_t id;
+  };
+
+  bool fold;
+  std::vector<pattern> patterns;
+  std::array<std::uint32_t, 256> byte_class{};
+  std::uint32_t classes = 1;
+  std::vector<std::uint32_t> delta;
+  std::vector<std::uint32_t> dict;
+  std::vector<std::uint32_t> first;
+  std::vector<std::uint32_t> out_begin;
+  std::vector<std::uint32_t> out_ids;
+};
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct message_link {
@@ -35,9 +40,28 @@ struct message {
   std::string body_text;
   std::string body_html;
   std::string date_iso;
+  // Epoch seconds from the Date header, else the IMAP INTERNALDATE; 0 if neither parsed.
+  std::int64_t received_at = 0;
   std::vector<std::string> labels;
   std::vector<message_link> links;
   std::vector<attachment> attachments;
   bool parse_suspect = false;
   std::string parse_strategy;
+
+  std::shared_ptr<const std::string> raw;
+  std::size_t raw_body_offset = 0;
 };
+
+
+inline std::string_view message_body(const message& msg) {
+  if (!msg.body.empty()) return msg.body;
+  if (msg.raw) {
+    std::string_view raw = *msg.raw;
+    return raw.substr(std::min(msg.raw_body_offset, raw.size()));
+  }
+  return msg.body_text.empty() ? std::string_view(msg.body_html) : std::string_view(msg.body_text);
+}
+
+inline std::string_view message_text(const message& msg) {
+  return msg.body_text.empty() ? message_body(msg) : std::string_view(msg.body_text);
+}
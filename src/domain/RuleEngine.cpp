@@ -1,195 +1,321 @@
 #include "RuleEngine.h"
 
+#include "../util/CaseFold.h"
+
 #include <algorithm>
-#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <regex>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-static std::string to_lower(std::string s) {
-  std::transform(s.begin(), s.end(), s.begin(),
-                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-  return s;
+// Case-insensitive ops compare against case_fold()ed needles; the haystack is
+// folded into a per-thread buffer so Cyrillic and Latin-1 fold too.
+static std::string_view folded(std::string_view s) {
+  static thread_local std::string buf;
+  buf.clear();
+  case_fold_append(buf, s);
+  return buf;
 }
 
-static bool ends_with(const std::string& value, const std::string& suffix) {
-  return value.size() >= suffix.size() &&
-         value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+static bool icontains(std::string_view hay, std::string_view folded_needle) {
+  if (folded_needle.empty()) return true;
+  if (hay.size() < folded_needle.size()) return false;
+  return folded(hay).find(folded_needle) != std::string_view::npos;
 }
 
-static std::vector<std::string> field_values(const message& msg, const std::string& field) {
-  if (field == "from") return {msg.from};
-  if (field == "to") return {msg.to};
-  if (field == "subject") return {msg.subject};
-  if (field == "snippet") return {msg.snippet};
-  if (field == "body") return {msg.body};
-  if (field == "body_text") return {msg.body_text};
-  if (field == "body_html") return {msg.body_html};
-  if (field == "received_at" || field == "date") return {msg.date_iso};
-  if (field == "uid") return {msg.uid};
-  if (field == "mailbox_id") return {msg.mailbox_id};
-  if (field == "provider") return {msg.provider};
-  if (field == "links.url") {
-    std::vector<std::string> values;
-    for (const auto& item : msg.links) values.push_back(item.url);
-    return values;
-  }
-  if (field == "links.domain") {
-    std::vector<std::string> values;
-    for (const auto& item : msg.links) values.push_back(item.domain);
-    return values;
-  }
-  if (field == "labels") return msg.labels;
-  if (field == "attachments.filename") {
-    std::vector<std::string> values;
-    for (const auto& item : msg.attachments) values.push_back(item.filename);
-    return values;
-  }
-  if (field == "attachments.mime_type" || field == "attachments.mime") {
-    std::vector<std::string> values;
-    for (const auto& item : msg.attachments) values.push_back(item.mime_type);
-    return values;
-  }
-  if (field == "attachments.size_bytes") {
-    std::vector<std::string> values;
-    for (const auto& item : msg.attachments) values.push_back(std::to_string(item.size_bytes));
-    return values;
-  }
-  return {};
-}
-
-static bool any_value_contains(const std::vector<std::string>& values, const std::string& needle) {
-  for (const auto& value : values) {
-    if (value.find(needle) != std::string::npos) return true;
-  }
-  return false;
-}
-
-static bool any_value_equals(const std::vector<std::string>& values, const std::string& expected) {
-  for (const auto& value : values) {
-    if (value == expected) return true;
-  }
-  return false;
+static rule_field resolve_field(const std::string& field) {
+  if (field == "from") return rule_field::from;
+  if (field == "to") return rule_field::to;
+  if (field == "subject") return rule_field::subject;
+  if (field == "snippet") return rule_field::snippet;
+  if (field == "body") return rule_field::body;
+  if (field == "body_text") return rule_field::body_text;
+  if (field == "body_html") return rule_field::body_html;
+  if (field == "received_at" || field == "date") return rule_field::date;
+  if (field == "uid") return rule_field::uid;
+  if (field == "mailbox_id") return rule_field::mailbox_id;
+  if (field == "provider") return rule_field::provider;
+  if (field == "links.url") return rule_field::link_url;
+  if (field == "links.domain") return rule_field::link_domain;
+  if (field == "labels") return rule_field::label;
+  if (field == "attachments.filename") return rule_field::attachment_filename;
+  if (field == "attachments.mime_type" || field == "attachments.mime") return rule_field::attachment_mime_type;
+  if (field == "attachments.size_bytes") return rule_field::attachment_size;
+  return rule_field::none;
 }
 
-static bool any_value_matches_regex(const std::vector<std::string>& values,
-                                    const std::string& pattern,
-                                    std::regex::flag_type flags) {
-  try {
-    std::regex re(pattern, flags);
-    for (const auto& value : values) {
-      if (std::regex_search(value, re)) return true;
-    }
-  } catch (const std::exception&) {
-    return false;
+template <typename Pred>
+static bool any_value(const message& msg, rule_field field, Pred&& pred) {
+  switch (field) {
+    case rule_field::from:       return pred(std::string_view(msg.from));
+    case rule_field::to:         return pred(std::string_view(msg.to));
+    case rule_field::subject:    return pred(std::string_view(msg.subject));
+    case rule_field::snippet:    return pred(std::string_view(msg.snippet));
+    case rule_field::body:       return pred(message_body(msg));
+    case rule_field::body_text:  return pred(std::string_view(msg.body_text));
+    case rule_field::body_html:  return pred(std::string_view(msg.body_html));
+    case rule_field::date:       return pred(std::string_view(msg.date_iso));
+    case rule_field::uid:        return pred(std::string_view(msg.uid));
+    case rule_field::mailbox_id: return pred(std::string_view(msg.mailbox_id));
+    case rule_field::provider:   return pred(std::string_view(msg.provider));
+    case rule_field::link_url:
+      for (const auto& item : msg.links) if (pred(std::string_view(item.url))) return true;
+      return false;
+    case rule_field::link_domain:
+      for (const auto& item : msg.links) if (pred(std::string_view(item.domain))) return true;
+      return false;
+    case rule_field::label:
+      for (const auto& item : msg.labels) if (pred(std::string_view(item))) return true;
+      return false;
+    case rule_field::attachment_filename:
+      for (const auto& item : msg.attachments) if (pred(std::string_view(item.filename))) return true;
+      return false;
+    case rule_field::attachment_mime_type:
+      for (const auto& item : msg.attachments) if (pred(std::string_view(item.mime_type))) return true;
+      return false;
+    case rule_field::attachment_size:
+      for (const auto& item : msg.attachments) {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), item.size_bytes);
+        if (pred(std::string_view(buf, static_cast<std::size_t>(res.ptr - buf)))) return true;
+      }
+      return false;
+    case rule_field::none:
+      return false;
   }
   return false;
 }
 
-static bool any_domain_in(const std::vector<std::string>& domains,
-                          const std::vector<std::string>& allowed) {
-  for (const auto& raw_domain : domains) {
-    std::string domain = to_lower(raw_domain);
-    for (const auto& raw_allowed : allowed) {
-      std::string allowed_domain = to_lower(raw_allowed);
-      if (domain == allowed_domain || ends_with(domain, "." + allowed_domain)) {
-        return true;
-      }
+static bool domain_allowed(std::string_view domain, const std::vector<std::string>& allowed) {
+  domain = folded(domain);
+  for (const auto& item : allowed) {
+    if (domain == item) return true;
+    if (domain.size() > item.size() && domain[domain.size() - item.size() - 1] == '.' &&
+        domain.substr(domain.size() - item.size()) == item) {
+      return true;
     }
   }
   return false;
 }
 
-static bool check_condition(const message& msg, const condition& cond) {
-  std::vector<std::string> values = field_values(msg, cond.field);
+struct scan_state {
+  std::vector<std::uint64_t> hits;
+  std::vector<char> scanned;
 
-  if (cond.op == cond_op::contains) {
-    return any_value_contains(values, cond.value);
+  void reset(const rule_plan& plan) {
+    hits.assign((plan.pattern_count + 63) / 64, 0);
+    scanned.assign(plan.matchers.size(), 0);
   }
+  bool hit(std::uint32_t id) const { return (hits[id >> 6] >> (id & 63)) & 1; }
+};
 
-  if (cond.op == cond_op::contains_i) {
-    std::vector<std::string> lower_values;
-    lower_values.reserve(values.size());
-    for (auto value : values) lower_values.push_back(to_lower(std::move(value)));
-    return any_value_contains(lower_values, to_lower(cond.value));
-  }
+// Runs every pattern of the field through its automata once per message;
+// later conditions on the same field only consult the hit bitmap.
+static void scan_field(const message& msg, const rule_plan& plan, int matcher, scan_state& state) {
+  if (state.scanned[static_cast<std::size_t>(matcher)]) return;
+  state.scanned[static_cast<std::size_t>(matcher)] = 1;
+  const field_matcher& fm = plan.matchers[static_cast<std::size_t>(matcher)];
+  auto mark = [&](std::uint32_t id, std::size_t) { state.hits[id >> 6] |= std::uint64_t{1} << (id & 63); };
+  any_value(msg, fm.field, [&](std::string_view v) {
+    if (!fm.exact.empty()) fm.exact.scan(v, mark);
+    if (!fm.folded.empty()) fm.folded.scan(folded(v), mark);
+    return false;
+  });
+}
 
-  if (cond.op == cond_op::not_contains) {
-    return !any_value_contains(values, cond.value);
+static bool check_condition(const message& msg, const compiled_condition& cond,
+                            const rule_plan& plan, scan_state& state) {
+  if (cond.matcher >= 0) {
+    scan_field(msg, plan, cond.matcher, state);
+    bool hit = std::any_of(cond.patterns.begin(), cond.patterns.end(),
+                           [&](std::uint32_t id) { return state.hit(id); });
+    return cond.op == cond_op::not_contains ? !hit : hit;
   }
 
-  if (cond.op == cond_op::equals) {
-    return any_value_equals(values, cond.value);
+  const std::string& needle = cond.value;
+  switch (cond.op) {
+    case cond_op::contains:
+      return any_value(msg, cond.field, [&](std::string_view v) { return v.find(needle) != std::string_view::npos; });
+    case cond_op::not_contains:
+      return !any_value(msg, cond.field, [&](std::string_view v) { return v.find(needle) != std::string_view::npos; });
+    case cond_op::contains_i:
+      return any_value(msg, cond.field, [&](std::string_view v) { return icontains(v, needle); });
+    case cond_op::equals:
+      return any_value(msg, cond.field, [&](std::string_view v) { return v == needle; });
+    case cond_op::not_equals:
+      return !any_value(msg, cond.field, [&](std::string_view v) { return v == needle; });
+    case cond_op::regex:
+    case cond_op::regex_i:
+      if (!cond.regex_ok) return false;
+      return any_value(msg, cond.field, [&](std::string_view v) {
+        return std::regex_search(v.begin(), v.end(), cond.re);
+      });
+    case cond_op::contains_any:
+      return any_value(msg, cond.field, [&](std::string_view v) {
+        for (const auto& item : cond.values)
+          if (v.find(item) != std::string_view::npos) return true;
+        return false;
+      });
+    case cond_op::contains_any_i:
+      return any_value(msg, cond.field, [&](std::string_view v) {
+        std::string_view hay = folded(v);
+        for (const auto& item : cond.values)
+          if (hay.find(item) != std::string_view::npos) return true;
+        return false;
+      });
+    case cond_op::exists:
+      return any_value(msg, cond.field, [](std::string_view v) { return !v.empty(); });
+    case cond_op::domain_in:
+      return any_value(msg, cond.field, [&](std::string_view v) { return domain_allowed(v, cond.values); });
+    case cond_op::date_before:
+      return any_value(msg, cond.field, [&](std::string_view v) { return !v.empty() && v < needle; });
+    case cond_op::date_after:
+      return any_value(msg, cond.field, [&](std::string_view v) { return !v.empty() && v > needle; });
   }
+  return false;
+}
 
-  if (cond.op == cond_op::not_equals) {
-    return !any_value_equals(values, cond.value);
+static compiled_condition compile_condition(const condition& c, const rule& r, std::vector<std::string>& errors) {
+  compiled_condition out;
+  out.field = resolve_field(c.field);
+  out.op    = c.op;
+  out.value = c.value;
+  out.values = c.values;
+  switch (c.op) {
+    case cond_op::contains_i:
+      out.value = case_fold(c.value);
+      break;
+    case cond_op::contains_any_i:
+    case cond_op::domain_in:
+      for (auto& item : out.values) case_fold_in_place(item);
+      break;
+    case cond_op::regex:
+    case cond_op::regex_i:
+      try {
+        auto flags = std::regex::ECMAScript;
+        if (c.op == cond_op::regex_i) flags |= std::regex::icase;
+        out.re = std::regex(c.value, flags);
+        out.regex_ok = true;
+      } catch (const std::exception& ex) {
+        errors.push_back("rule " + r.id + ": invalid regex '" + c.value + "': " + ex.what());
+      }
+      break;
+    default:
+      break;
   }
+  return out;
+}
 
-  if (cond.op == cond_op::regex) {
-    return any_value_matches_regex(values, cond.value, std::regex::ECMAScript);
-  }
+static void attach_patterns(rule_plan& plan, compiled_condition& cond,
+                            std::map<std::tuple<int, bool, std::string>, std::uint32_t>& ids) {
+  bool folded = cond.op == cond_op::contains_i || cond.op == cond_op::contains_any_i;
+  bool single = cond.op == cond_op::contains || cond.op == cond_op::not_contains || cond.op == cond_op::contains_i;
+  if (!single && !folded && cond.op != cond_op::contains_any) return;
+  if (cond.field == rule_field::none) return;
 
-  if (cond.op == cond_op::regex_i) {
-    return any_value_matches_regex(values, cond.value, std::regex::ECMAScript | std::regex::icase);
-  }
+  const std::vector<std::string> one{cond.value};
+  const std::vector<std::string>& needles = single ? one : cond.values;
+  if (needles.empty()) return;
+  for (const auto& n : needles)
+    if (n.empty()) return;
 
-  if (cond.op == cond_op::contains_any) {
-    for (const auto& item : cond.values) {
-      if (any_value_contains(values, item)) return true;
-    }
-    return false;
+  int matcher = -1;
+  for (std::size_t i = 0; i < plan.matchers.size(); ++i)
+    if (plan.matchers[i].field == cond.field) matcher = static_cast<int>(i);
+  if (matcher < 0) {
+    matcher = static_cast<int>(plan.matchers.size());
+    plan.matchers.emplace_back();
+    plan.matchers.back().field = cond.field;
   }
 
-  if (cond.op == cond_op::contains_any_i) {
-    std::vector<std::string> lower_values;
-    lower_values.reserve(values.size());
-    for (auto value : values) lower_values.push_back(to_lower(std::move(value)));
-    for (const auto& item : cond.values) {
-      if (any_value_contains(lower_values, to_lower(item))) return true;
+  field_matcher& fm = plan.matchers[static_cast<std::size_t>(matcher)];
+  for (const auto& n : needles) {
+    auto [it, inserted] = ids.emplace(std::make_tuple(matcher, folded, n), plan.pattern_count);
+    if (inserted) {
+      (folded ? fm.folded : fm.exact).add(n, plan.pattern_count);
+      ++plan.pattern_count;
     }
-    return false;
+    cond.patterns.push_back(it->second);
   }
+  cond.matcher = matcher;
+}
 
-  if (cond.op == cond_op::exists) {
-    return std::any_of(values.begin(), values.end(), [](const std::string& value) {
-      return !value.empty();
-    });
-  }
+std::shared_ptr<const rule_plan> compile_rules(std::vector<rule> rules, bool multi_pattern) {
+  auto plan = std::make_shared<rule_plan>();
+  plan->rules = std::move(rules);
+  std::map<std::tuple<int, bool, std::string>, std::uint32_t> pattern_ids;
 
-  if (cond.op == cond_op::domain_in) {
-    return any_domain_in(values, cond.values);
+  plan->condition_offset.reserve(plan->rules.size() + 1);
+  std::size_t total_conditions = 0;
+  for (const auto& r : plan->rules) {
+    plan->condition_offset.push_back(total_conditions);
+    total_conditions += r.conditions.size();
   }
-
-  if (cond.op == cond_op::date_before) {
-    for (const auto& value : values) {
-      if (!value.empty() && value < cond.value) return true;
+  plan->condition_offset.push_back(total_conditions);
+  plan->rule_stats.reset(new rule_counters[plan->rules.size()]);
+  plan->condition_stats.reset(new rule_counters[total_conditions]);
+  for (std::size_t i = 0; i < plan->rules.size(); ++i) {
+    const rule& r = plan->rules[i];
+    if (!r.enabled || r.conditions.empty()) continue;
+    compiled_rule cr;
+    cr.source = i;
+    cr.match  = r.match;
+    cr.conditions.reserve(r.conditions.size());
+    for (std::size_t k = 0; k < r.conditions.size(); ++k) {
+      cr.conditions.push_back(compile_condition(r.conditions[k], r, plan->errors));
+      cr.conditions.back().stats = plan->condition_offset[i] + k;
+      if (multi_pattern) attach_patterns(*plan, cr.conditions.back(), pattern_ids);
     }
-    return false;
+    plan->compiled.push_back(std::move(cr));
   }
-
-  if (cond.op == cond_op::date_after) {
-    for (const auto& value : values) {
-      if (!value.empty() && value > cond.value) return true;
-    }
-    return false;
+  for (auto& fm : plan->matchers) {
+    fm.exact.build();
+    fm.folded.build();
   }
+  return plan;
+}
 
-  return false;
+rule_engine::rule_engine() : current(compile_rules({})) {}
+
+void rule_engine::load(std::shared_ptr<const rule_plan> plan) {
+  if (!plan) plan = compile_rules({});
+  std::atomic_store(&current, std::move(plan));
 }
 
-match_result rule_engine::apply(const message& msg, const std::vector<rule>& rules) const {
+std::shared_ptr<const rule_plan> rule_engine::plan() const {
+  return std::atomic_load(&current);
+}
+
+static void count(rule_counters& counters, bool hit, std::chrono::steady_clock::duration elapsed) {
+  counters.evaluations.fetch_add(1, std::memory_order_relaxed);
+  if (hit) counters.hits.fetch_add(1, std::memory_order_relaxed);
+  counters.total_ns.fetch_add(
+      static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+      std::memory_order_relaxed);
+}
+
+match_result rule_engine::apply(const message& msg, const rule_plan& plan) const {
+  static thread_local scan_state state;
+  state.reset(plan);
+
   match_result res;
   res.matched = false;
 
-  for (const auto& r : rules) {
-    if (!r.enabled) continue;
-
+  for (const auto& r : plan.compiled) {
+    auto rule_start = std::chrono::steady_clock::now();
+    auto last = rule_start;
     bool ok = (r.match == match_mode::all);
-    if (r.conditions.empty()) ok = false;
-
     for (const auto& c : r.conditions) {
-      bool matched = check_condition(msg, c);
+      bool matched = check_condition(msg, c, plan, state);
+      auto now = std::chrono::steady_clock::now();
+      count(plan.condition_stats[c.stats], matched, now - last);
+      last = now;
       if (r.match == match_mode::all && !matched) {
         ok = false;
         break;
@@ -200,12 +326,19 @@ match_result rule_engine::apply(const message& msg, const std::vector<rule>& rul
       }
     }
 
+    count(plan.rule_stats[r.source], ok, last - rule_start);
+
     if (ok) {
+      const rule& source = plan.rules[r.source];
       res.matched = true;
-      res.matched_rule_ids.push_back(r.id);
-      for (const auto& a : r.actions) res.actions.push_back(a);
+      res.matched_rule_ids.push_back(source.id);
+      for (const auto& a : source.actions) res.actions.push_back(a);
     }
   }
 
   return res;
 }
+
+match_result rule_engine::apply(const message& msg, const std::vector<rule>& rules) const {
+  return apply(msg, *compile_rules(rules));
+}
@@ -1,8 +1,14 @@
 #pragma once
 
+#include "AhoCorasick.h"
 #include "Message.h"
 #include "Rule.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <regex>
 #include <string>
 #include <vector>
 
@@ -12,7 +18,86 @@ struct match_result {
   std::vector<std::string> matched_rule_ids;
 };
 
+enum class rule_field {
+  none,
+  from,
+  to,
+  subject,
+  snippet,
+  body,
+  body_text,
+  body_html,
+  date,
+  uid,
+  mailbox_id,
+  provider,
+  link_url,
+  link_domain,
+  label,
+  attachment_filename,
+  attachment_mime_type,
+  attachment_size
+};
+
+struct compiled_condition {
+  rule_field field = rule_field::none;
+  cond_op op = cond_op::contains;
+  std::string value;
+  std::vector<std::string> values;
+  std::regex re;
+  bool regex_ok = false;
+  int matcher = -1;
+  std::vector<std::uint32_t> patterns;
+  std::size_t stats = 0;
+};
+
+struct compiled_rule {
+  std::size_t source = 0;
+  match_mode match = match_mode::all;
+  std::vector<compiled_condition> conditions;
+};
+
+struct field_matcher {
+  rule_field field = rule_field::none;
+  aho_corasick exact;
+  aho_corasick folded;
+};
+
+struct alignas(64) rule_counters {
+  std::atomic<std::uint64_t> evaluations{0};
+  std::atomic<std::uint64_t> hits{0};
+  std::atomic<std::uint64_t> total_ns{0};
+};
+
+struct rule_plan {
+  std::vector<rule> rules;
+  std::vector<compiled_rule> compiled;
+  std::vector<field_matcher> matchers;
+  std::uint32_t pattern_count = 0;
+  std::vector<std::string> errors;
+
+  std::unique_ptr<rule_counters[]> rule_stats;
+  std::unique_ptr<rule_counters[]> condition_stats;
+  std::vector<std::size_t> condition_offset;
+
+  const rule_counters& stats_for(std::size_t rule_index) const { return rule_stats[rule_index]; }
+  const rule_counters& stats_for(std::size_t rule_index, std::size_t condition_index) const {
+    return condition_stats[condition_offset[rule_index] + condition_index];
+  }
+};
+
+std::shared_ptr<const rule_plan> compile_rules(std::vector<rule> rules, bool multi_pattern = true);
+
 class rule_engine {
 public:
+  rule_engine();
+
+  void load(std::shared_ptr<const rule_plan> plan);
+  std::shared_ptr<const rule_plan> plan() const;
+
+  match_result apply(const message& msg, const rule_plan& plan) const;
   match_result apply(const message& msg, const std::vector<rule>& rules) const;
+
+private:
+  std::shared_ptr<const rule_plan> current;
 };
@@ -0,0 +1,64 @@
+#include "EventRing.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+event_ring::event_ring(std::size_t capacity) : slots(std::max<std::size_t>(capacity, 1)) {}
+
+void event_ring::restore(const std::vector<event_record>& newest_first) {
+  if (newest_first.empty()) return;
+  long long newest = newest_first.front().id;
+  first_id = newest + 1;
+  std::size_t keep = std::min(newest_first.size(), slots.size());
+  for (std::size_t i = keep; i-- > 0;) {
+    const event_record& ev = newest_first[i];
+    if (ev.id <= 0) continue;
+    first_id = std::min(first_id, ev.id);
+    std::atomic_store(&slots[static_cast<std::size_t>(ev.id) % slots.size()],
+                      std::make_shared<const event_record>(ev));
+  }
+  next_id.store(newest + 1);
+}
+
+event_record event_ring::push(event_record event) {
+  event.id = next_id.fetch_add(1);
+  auto stored = std::make_shared<const event_record>(std::move(event));
+  std::atomic_store(&slots[static_cast<std::size_t>(stored->id) % slots.size()], stored);
+  return *stored;
+}
+
+std::vector<event_record> event_ring::last(std::size_t limit) const {
+  std::vector<event_record> result;
+  long long newest = next_id.load() - 1;
+  long long oldest = std::max(first_id, newest - static_cast<long long>(slots.size()) + 1);
+  for (long long id = newest; id >= oldest && result.size() < limit; --id) {
+    auto ev = std::atomic_load(&slots[static_cast<std::size_t>(id) % slots.size()]);
+    if (ev && ev->id == id) result.push_back(*ev);
+  }
+  return result;
+}
+
+std::vector<event_record> event_ring::since(long long after_id) const {
+  std::vector<event_record> result;
+  long long newest = next_id.load() - 1;
+  for (long long id = std::max(after_id + 1, oldest_id()); id <= newest; ++id) {
+    auto ev = std::atomic_load(&slots[static_cast<std::size_t>(id) % slots.size()]);
+    if (!ev || ev->id < id) break;
+    if (ev->id == id) result.push_back(*ev);
+  }
+  return result;
+}
+
+std::size_t event_ring::size() const {
+  long long count = next_id.load() - first_id;
+  return static_cast<std::size_t>(std::min<long long>(std::max<long long>(count, 0),
+                                                      static_cast<long long>(slots.size())));
+}
+
+long long event_ring::oldest_id() const {
+  return std::max(first_id, next_id.load() - static_cast<long long>(slots.size()));
+}
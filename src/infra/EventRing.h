@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Storage.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+// Fixed-size ring of the newest events. Writers claim an id with one
+// fetch_add and publish the record with an atomic shared_ptr store; readers
+// skip slots that are not yet published or already overwritten. There is no
+// ring-wide lock, but the shared_ptr atomics are not lock-free: libstdc++
+// guards them with a small pool of mutexes held only for the pointer swap.
+class event_ring {
+public:
+  explicit event_ring(std::size_t capacity = 1024);
+
+  // Seeds the ring with persisted events (newest first) and continues ids
+  // after the newest one; call before the ring is shared.
+  void restore(const std::vector<event_record>& newest_first);
+
+  event_record push(event_record event);
+
+  std::vector<event_record> last(std::size_t limit) const;
+  // Published events newer than after_id, oldest first; stops at the first
+  // id that is claimed but not yet published.
+  std::vector<event_record> since(long long after_id) const;
+
+  std::size_t capacity() const { return slots.size(); }
+  std::size_t size() const;
+  long long oldest_id() const;
+  long long newest_id() const { return next_id.load() - 1; }
+
+private:
+  std::vector<std::shared_ptr<const event_record>> slots;
+  std::atomic<long long> next_id{1};
+  long long first_id = 1;
+};
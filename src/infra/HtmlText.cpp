@@ -0,0 +1,280 @@
+#include "HtmlText.h"
+#include "../util/CaseFold.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+namespace {
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+inline bool is_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+const std::string_view k_block_tags[] = {
+  "address", "article", "aside", "blockquote", "br", "center", "dd", "div", "dl", "dt",
+  "fieldset", "figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6", "header",
+  "hr", "li", "main", "nav", "ol", "p", "pre", "section", "table", "title", "tr", "ul",
+};
+
+const std::string_view k_cell_tags[] = {"td", "th"};
+
+template <std::size_t N>
+bool tag_in(std::string_view name, const std::string_view (&set)[N]) {
+  for (auto item : set)
+    if (item == name) return true;
+  return false;
+}
+
+
+struct named_entity {
+  std::string_view name;
+  std::string_view utf8;
+};
+
+const named_entity k_entities[] = {
+  {"amp", "&"}, {"lt", "<"}, {"gt", ">"}, {"quot", "\""}, {"apos", "'"}, {"nbsp", " "},
+  {"shy", ""}, {"zwnj", ""}, {"zwj", ""},
+  {"ndash", "\xE2\x80\x93"}, {"mdash", "\xE2\x80\x94"}, {"hellip", "\xE2\x80\xA6"},
+  {"laquo", "\xC2\xAB"}, {"raquo", "\xC2\xBB"}, {"lsquo", "\xE2\x80\x98"}, {"rsquo", "\xE2\x80\x99"},
+  {"ldquo", "\xE2\x80\x9C"}, {"rdquo", "\xE2\x80\x9D"}, {"bdquo", "\xE2\x80\x9E"},
+  {"bull", "\xE2\x80\xA2"}, {"middot", "\xC2\xB7"}, {"copy", "\xC2\xA9"}, {"reg", "\xC2\xAE"},
+  {"trade", "\xE2\x84\xA2"}, {"euro", "\xE2\x82\xAC"}, {"deg", "\xC2\xB0"}, {"numero", "\xE2\x84\x96"},
+};
+
+void append_utf8(std::string& out, std::uint32_t cp) {
+  if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+// Decodes "&name;" / "&#N;" / "&#xH;" at s[pos]; returns the consumed length
+// or 0 when the ampersand is literal.
+std::size_t decode_entity(std::string_view s, std::size_t pos, std::string& decoded) {
+  decoded.clear();
+  std::size_t i = pos + 1;
+  if (i < s.size() && s[i] == '#') {
+    ++i;
+    bool hex = i < s.size() && (s[i] == 'x' || s[i] == 'X');
+    if (hex) ++i;
+    std::uint32_t cp = 0;
+    std::size_t digits = 0;
+    for (; i < s.size() && digits < 8; ++i, ++digits) {
+      char c = s[i];
+      int v = -1;
+      if (c >= '0' && c <= '9') v = c - '0';
+      else if (hex && ascii_lower(c) >= 'a' && ascii_lower(c) <= 'f') v = 10 + ascii_lower(c) - 'a';
+      if (v < 0) break;
+      cp = cp * (hex ? 16 : 10) + static_cast<std::uint32_t>(v);
+    }
+    if (digits == 0 || i >= s.size() || s[i] != ';') return 0;
+    if (cp == 0xA0) decoded = " ";
+    else append_utf8(decoded, cp);
+    return i + 1 - pos;
+  }
+  std::size_t end = i;
+  while (end < s.size() && end - i < 8 && is_alpha(s[end])) ++end;
+  if (end == i || end >= s.size() || s[end] != ';') return 0;
+  std::string_view name = s.substr(i, end - i);
+  for (const auto& e : k_entities) {
+    if (e.name == name) {
+      decoded.assign(e.utf8);
+      return end + 1 - pos;
+    }
+  }
+  return 0;
+}
+
+// Position just past the '>' closing the tag at s[pos] == '<'; quoted
+// attribute values may contain '>'.
+std::size_t tag_end(std::string_view s, std::size_t pos) {
+  std::size_t i = pos + 1;
+  while (i < s.size()) {
+    char c = s[i];
+    if (c == '>') return i + 1;
+    if (c == '=') {
+      ++i;
+      while (i < s.size() && is_space(s[i])) ++i;
+      if (i < s.size() && (s[i] == '"' || s[i] == '\'')) {
+        std::size_t close = s.find(s[i], i + 1);
+        if (close == std::string_view::npos) return s.size();
+        i = close + 1;
+      }
+      continue;
+    }
+    ++i;
+  }
+  return s.size();
+}
+
+std::size_t raw_text_end(std::string_view s, std::size_t pos, std::string_view closing) {
+  for (std::size_t i = s.find('<', pos); i != std::string_view::npos; i = s.find('<', i + 1))
+    if (ascii_istarts_with(s, i + 1, closing)) return i;
+  return s.size();
+}
+
+
+class text_writer {
+ public:
+  explicit text_writer(std::string& out) : out_(out) {}
+
+  void space() { pending_space_ = true; }
+  void newline() {
+    if (pending_newlines_ < 2) ++pending_newlines_;
+  }
+
+  void put(char c) {
+    flush();
+    out_.push_back(c);
+  }
+
+  void put(std::string_view s) {
+    if (s.empty()) return;
+    flush();
+    out_.append(s);
+  }
+
+ private:
+  void flush() {
+    if (!out_.empty()) {
+      if (pending_newlines_ > 0) out_.append(static_cast<std::size_t>(pending_newlines_), '\n');
+      else if (pending_space_) out_.push_back(' ');
+    }
+    pending_newlines_ = 0;
+    pending_space_ = false;
+  }
+
+  std::string& out_;
+  int pending_newlines_ = 0;
+  bool pending_space_ = false;
+};
+
+std::string make_snippet(const std::string& text, std::size_t max_len) {
+  std::string snippet;
+  snippet.reserve(std::min(text.size(), max_len));
+  for (std::size_t i = 0; i < text.size() && snippet.size() < max_len; ++i) {
+    if (text[i] != '\n') {
+      snippet.push_back(text[i]);
+    } else if (!snippet.empty() && snippet.back() != ' ') {
+      snippet.push_back(' ');
+    }
+  }
+  std::size_t lead = snippet.size();
+  while (lead > 0 && (static_cast<unsigned char>(snippet[lead - 1]) & 0xC0) == 0x80) --lead;
+  if (lead > 0) {
+    unsigned char c = static_cast<unsigned char>(snippet[lead - 1]);
+    std::size_t width = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (snippet.size() - (lead - 1) < width) snippet.resize(lead - 1);
+  }
+  while (!snippet.empty() && snippet.back() == ' ') snippet.pop_back();
+  return snippet;
+}
+
+}
+
+
+html_text_result html_to_text(std::string_view html, link_collector* links, std::size_t snippet_len) {
+  html_text_result result;
+  result.text.reserve(html.size() / 2);
+  text_writer w(result.text);
+  std::string entity;
+
+  auto scan_links = [&](std::size_t from, std::size_t to) {
+    if (links && to > from) scan_html_links(html.substr(from, to - from), *links);
+  };
+
+  const std::size_t n = html.size();
+  std::size_t i = 0;
+  std::size_t text_begin = 0;
+  while (i < n) {
+    char c = html[i];
+    if (c == '<' && i + 1 < n) {
+      char next = html[i + 1];
+      bool closing = next == '/';
+      std::size_t name_begin = i + (closing ? 2 : 1);
+
+      if (next == '!' || next == '?' || (name_begin < n && is_alpha(html[name_begin]))) {
+        scan_links(text_begin, i);
+
+        if (ascii_istarts_with(html, i, "<!--")) {
+          std::size_t close = html.find("-->", i + 4);
+          std::size_t end = close == std::string_view::npos ? n : close + 3;
+          scan_links(i, end);
+          i = text_begin = end;
+          continue;
+        }
+
+        std::size_t end = tag_end(html, i);
+        scan_links(i, end);
+        if (next == '!' || next == '?') {
+          i = text_begin = end;
+          continue;
+        }
+
+        char name_buf[16];
+        std::size_t name_len = 0;
+        for (std::size_t k = name_begin; k < n && name_len < sizeof(name_buf); ++k) {
+          char ch = ascii_lower(html[k]);
+          if (!is_alpha(ch) && !(ch >= '0' && ch <= '9')) break;
+          name_buf[name_len++] = ch;
+        }
+        std::string_view name(name_buf, name_len);
+
+        if (!closing && (name == "script" || name == "style")) {
+          std::string_view closing_tag = name == "script" ? "/script" : "/style";
+          std::size_t content_end = raw_text_end(html, end, closing_tag);
+          scan_links(end, content_end);
+          end = content_end < n ? tag_end(html, content_end) : n;
+          w.space();
+        } else if (tag_in(name, k_block_tags)) {
+          w.newline();
+        } else if (tag_in(name, k_cell_tags)) {
+          w.space();
+        }
+        i = text_begin = end;
+        continue;
+      }
+    }
+
+    if (is_space(c)) {
+      w.space();
+      ++i;
+      continue;
+    }
+    if (c == '&') {
+      if (std::size_t used = decode_entity(html, i, entity)) {
+        if (entity == " ") w.space();
+        else w.put(entity);
+        i += used;
+        continue;
+      }
+    }
+    w.put(c);
+    ++i;
+  }
+  scan_links(text_begin, n);
+
+  result.snippet = make_snippet(result.text, snippet_len);
+  return result;
+}
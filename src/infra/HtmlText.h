@@ -0,0 +1,18 @@
+#pragma once
+
+#include "LinkScan.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+struct html_text_result {
+  std::string text;
+  std::string snippet;
+};
+
+
+html_text_result html_to_text(std::string_view html,
+                              link_collector* links = nullptr,
+                              std::size_t snippet_len = 200);
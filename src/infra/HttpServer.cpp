@@ -139,7 +139,13 @@ public:
 
     server.Get("/api/rules", [this](const httplib::Request& req, httplib::Response& res) {
       if (!auth_ok(req, res)) return;
-      std::string body = handlers.get_rules_json ? handlers.get_rules_json() : "{}";
+      bool stats = req.has_param("stats") && req.get_param_value("stats") == "true";
+      std::string body = handlers.get_rules_json ? handlers.get_rules_json(stats) : "{}";
+      res.set_content(body, "application/json; charset=utf-8");
+    });
+    server.Get("/api/rules/stats", [this](const httplib::Request& req, httplib::Response& res) {
+      if (!auth_ok(req, res)) return;
+      std::string body = handlers.get_rules_stats_json ? handlers.get_rules_stats_json() : "{}";
       res.set_content(body, "application/json; charset=utf-8");
     });
     server.Post("/api/rules", [this](const httplib::Request& req, httplib::Response& res) {
@@ -371,8 +377,11 @@ public:
       int limit = 20, offset = 0;
       try { if (req.has_param("limit"))  limit  = std::stoi(req.get_param_value("limit"));  } catch (...) {}
       try { if (req.has_param("offset")) offset = std::stoi(req.get_param_value("offset")); } catch (...) {}
+      std::string before = req.has_param("before") ? req.get_param_value("before") : "";
+      std::string since = req.has_param("since") ? req.get_param_value("since") : "";
+      std::string until = req.has_param("until") ? req.get_param_value("until") : "";
       std::string body = handlers.mail_list_json ?
-          handlers.mail_list_json(filter, limit, offset) :
+          handlers.mail_list_json(filter, limit, offset, before, since, until) :
           nlohmann::json({{"ok", false}, {"error", "handler unavailable"}, {"emails", nlohmann::json::array()}}).dump();
       res.set_content(body, "application/json; charset=utf-8");
     });
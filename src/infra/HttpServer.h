@@ -10,7 +10,8 @@ struct http_handlers {
   std::function<std::string()> get_status_json;
   std::function<std::string()> get_dashboard_json;
   std::function<std::string(int)> get_events_json;
-  std::function<std::string()> get_rules_json;
+  std::function<std::string(bool)> get_rules_json;
+  std::function<std::string()> get_rules_stats_json;
   std::function<bool(const std::string&, std::string&)> set_rules_json;
   std::function<std::string(bool)> get_active_forms_json;
   std::function<std::string(const std::string&)> get_form_json;
@@ -48,7 +49,8 @@ struct http_handlers {
   std::function<bool(const std::string&, std::string&)> apply_profile_expansion_json;
 
 
-  std::function<std::string(const std::string&, int, int)> mail_list_json;
+  std::function<std::string(const std::string&, int, int, const std::string&,
+                            const std::string&, const std::string&)> mail_list_json;
   std::function<std::string(const std::string&)> mail_get_json;
   std::function<bool(const std::string&, std::string&)> mail_mark_read;
   std::function<bool(const std::string&, std::string&)> mail_archive;
@@ -1,9 +1,13 @@
 #include "ImapParse.h"
 
+#include "HtmlText.h"
+#include "LinkScan.h"
+#include "TransferDecode.h"
+#include "../util/CaseFold.h"
+
 #include <algorithm>
 #include <cctype>
 #include <regex>
-#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -19,156 +23,6 @@ std::string trim_str(const std::string& s) {
   return s.substr(b, e - b);
 }
 
-std::string to_lower(std::string s) {
-  std::transform(s.begin(), s.end(), s.begin(),
-                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-  return s;
-}
-
-std::string base64_decode(const std::string& input) {
-  static const std::string alphabet =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  std::string out;
-  int val = 0, bits = -8;
-  for (unsigned char c : input) {
-    if (std::isspace(c)) continue;
-    if (c == '=') break;
-    auto pos = alphabet.find(static_cast<char>(c));
-    if (pos == std::string::npos) continue;
-    val = (val << 6) + static_cast<int>(pos);
-    bits += 6;
-    if (bits >= 0) {
-      out.push_back(static_cast<char>((val >> bits) & 0xFF));
-      bits -= 8;
-    }
-  }
-  return out;
-}
-
-int hex_value(char c) {
-  if (c >= '0' && c <= '9') return c - '0';
-  if (c >= 'a' && c <= 'f') return 10 + c - 'a';
-  if (c >= 'A' && c <= 'F') return 10 + c - 'A';
-  return -1;
-}
-
-std::string quoted_printable_decode(const std::string& input, bool header_mode) {
-  std::string out;
-  for (std::size_t i = 0; i < input.size(); ++i) {
-    char c = input[i];
-    if (header_mode && c == '_') { out.push_back(' '); continue; }
-    if (c == '=' && i + 2 < input.size()) {
-      if (input[i+1] == '\r' && input[i+2] == '\n') { i += 2; continue; }
-      if (input[i+1] == '\n') { i += 1; continue; }
-      int hi = hex_value(input[i+1]);
-      int lo = hex_value(input[i+2]);
-      if (hi >= 0 && lo >= 0) {
-        out.push_back(static_cast<char>((hi << 4) | lo));
-        i += 2;
-        continue;
-      }
-    }
-    out.push_back(c);
-  }
-  return out;
-}
-
-std::string html_entity_decode(std::string text) {
-  auto replace_all = [](std::string& s, const std::string& from, const std::string& to) {
-    std::size_t p = 0;
-    while ((p = s.find(from, p)) != std::string::npos) {
-      s.replace(p, from.size(), to);
-      p += to.size();
-    }
-  };
-  replace_all(text, "&amp;",  "&");
-  replace_all(text, "&lt;",   "<");
-  replace_all(text, "&gt;",   ">");
-  replace_all(text, "&quot;", "\"");
-  replace_all(text, "&#39;",  "'");
-  return text;
-}
-
-std::string sanitize_url(std::string url) {
-  while (!url.empty()) {
-    char c = url.back();
-    if (c == '.' || c == ',' || c == ')' || c == ']' || c == '}' || c == ';') {
-      url.pop_back();
-      continue;
-    }
-    break;
-  }
-  return url;
-}
-
-std::string extract_domain(const std::string& url) {
-  static const std::regex re(R"(^https?://([^/:?#]+))", std::regex::icase);
-  std::smatch m;
-  if (!std::regex_search(url, m, re)) return "";
-  std::string host = m[1].str();
-  std::transform(host.begin(), host.end(), host.begin(),
-                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-  return host;
-}
-
-double estimate_form_link_confidence(const std::string& url) {
-  std::string lower = to_lower(url);
-  if (lower.find("forms.yandex.") != std::string::npos) {
-    if (lower.find("/admin/")   != std::string::npos) return 0.0;
-    if (lower.find("/answers/") != std::string::npos) return 0.0;
-    if (lower.find("/success")  != std::string::npos) return 0.0;
-    if (lower.find("/results/") != std::string::npos) return 0.0;
-    return 0.95;
-  }
-  if (lower.find("docs.google.com/forms") != std::string::npos) {
-    if (lower.find("/viewanalytics") != std::string::npos) return 0.0;
-    if (lower.find("/closedform")    != std::string::npos) return 0.0;
-    return 0.95;
-  }
-  if (lower.find("forms.gle")           != std::string::npos) return 0.95;
-  if (lower.find("forms.office.com")    != std::string::npos) return 0.95;
-  if (lower.find("forms.microsoft.com") != std::string::npos) return 0.95;
-  if (lower.find("portal.hse.ru/poll")  != std::string::npos) return 0.9;
-  if (lower.find("lms.hse.ru")          != std::string::npos) return 0.85;
-  if (lower.find("smartlms.hse.ru")     != std::string::npos) return 0.85;
-  if (lower.find("form") != std::string::npos ||
-      lower.find("poll") != std::string::npos) return 0.6;
-  return 0.2;
-}
-
-void collect_links(const std::string& text,
-                   std::vector<message_link>& result,
-                   std::set<std::string>& seen) {
-  static const std::regex url_regex(R"((https?://[^\s"'<>]+))", std::regex::icase);
-  auto begin = std::sregex_iterator(text.begin(), text.end(), url_regex);
-  for (auto it = begin; it != std::sregex_iterator(); ++it) {
-    std::string url = sanitize_url(html_entity_decode((*it)[1].str()));
-    if (url.empty() || !seen.insert(url).second) continue;
-    message_link item;
-    item.url        = url;
-    item.domain     = extract_domain(url);
-    item.confidence = estimate_form_link_confidence(url);
-    result.push_back(std::move(item));
-  }
-}
-
-void collect_href_links(const std::string& html,
-                        std::vector<message_link>& result,
-                        std::set<std::string>& seen) {
-  static const std::regex href_regex(
-      R"(href\s*=\s*["'](https?://[^"']+)["'])", std::regex::icase);
-  auto begin = std::sregex_iterator(html.begin(), html.end(), href_regex);
-  for (auto it = begin; it != std::sregex_iterator(); ++it) {
-    std::string url = sanitize_url(html_entity_decode((*it)[1].str()));
-    if (url.empty() || !seen.insert(url).second) continue;
-    message_link item;
-    item.url        = url;
-    item.domain     = extract_domain(url);
-    item.confidence = estimate_form_link_confidence(url);
-    result.push_back(std::move(item));
-  }
-}
-
 }
 
 
@@ -303,6 +157,483 @@ bool is_incomplete_literal(const std::string& response) {
   return false;
 }
 
+std::size_t imap_response_line_end(const std::string& buffer, std::size_t start) {
+  std::size_t pos = start;
+  while (true) {
+    std::size_t lf = buffer.find('\n', pos);
+    if (lf == std::string::npos) return std::string::npos;
+    std::size_t line_end = lf;
+    if (line_end > pos && buffer[line_end - 1] == '\r') line_end--;
+
+    if (line_end > pos && buffer[line_end - 1] == '}') {
+      std::size_t brace = buffer.rfind('{', line_end - 1);
+      if (brace != std::string::npos && brace >= pos) {
+        std::size_t digits_end = line_end - 1;
+        if (digits_end > brace + 1 && buffer[digits_end - 1] == '+') digits_end--;
+        bool all_digits = digits_end > brace + 1;
+        for (std::size_t i = brace + 1; i < digits_end && all_digits; ++i)
+          all_digits = std::isdigit(static_cast<unsigned char>(buffer[i])) != 0;
+        if (all_digits) {
+          std::size_t size = 0;
+          try {
+            size = std::stoull(buffer.substr(brace + 1, digits_end - brace - 1));
+          } catch (...) { return lf + 1; }
+          std::size_t literal_end = lf + 1 + size;
+          if (literal_end > buffer.size()) return std::string::npos;
+          pos = literal_end;
+          continue;
+        }
+      }
+    }
+    return lf + 1;
+  }
+}
+
+bool imap_tagged_response_end(const std::string& buffer,
+                              const std::string& tag,
+                              std::size_t& end,
+                              std::string& status_line) {
+  std::size_t pos = end;
+  while (pos < buffer.size()) {
+    std::size_t next = imap_response_line_end(buffer, pos);
+    if (next == std::string::npos) { end = pos; return false; }
+    if (buffer.compare(pos, tag.size(), tag) == 0 &&
+        pos + tag.size() < next && buffer[pos + tag.size()] == ' ') {
+      status_line = trim_str(buffer.substr(pos + tag.size() + 1, next - pos - tag.size() - 1));
+      end = next;
+      return true;
+    }
+    pos = next;
+  }
+  end = pos;
+  return false;
+}
+
+std::vector<std::string> imap_parse_search_uids(const std::string& response) {
+  std::vector<std::string> uids;
+  std::istringstream lines(response);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.size() >= 10 && ascii_lower(line.substr(0, 10)) == "* esearch ") {
+      std::string rest = line.substr(10);
+      if (!rest.empty() && rest[0] == '(') {
+        std::size_t close = rest.find(')');
+        rest = close == std::string::npos ? "" : rest.substr(close + 1);
+      }
+      std::istringstream tokens(rest);
+      std::string key;
+      std::string value;
+      while (tokens >> key) {
+        key = ascii_lower(key);
+        if (key == "uid") continue;
+        if (!(tokens >> value)) break;
+        if (key == "all") {
+          auto expanded = imap_expand_uid_set(value);
+          uids.insert(uids.end(), expanded.begin(), expanded.end());
+        } else if (key == "min" || key == "max") {
+          uids.push_back(value);
+        }
+      }
+      continue;
+    }
+    if (line.size() < 8 || ascii_lower(line.substr(0, 8)) != "* search") continue;
+    std::istringstream tokens(line.substr(8));
+    std::string token;
+    while (tokens >> token) {
+      if (std::all_of(token.begin(), token.end(),
+                      [](unsigned char c) { return std::isdigit(c) != 0; }))
+        uids.push_back(token);
+    }
+  }
+  return uids;
+}
+
+std::string imap_quote_string(const std::string& value) {
+  std::string out = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') out.push_back('\\');
+    out.push_back(c);
+  }
+  out.push_back('"');
+  return out;
+}
+
+std::string imap_compress_uid_set(const std::vector<std::string>& uids) {
+  std::vector<std::uint64_t> values;
+  values.reserve(uids.size());
+  for (const auto& uid : uids) {
+    try { values.push_back(std::stoull(uid)); } catch (...) {}
+  }
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+
+  std::string out;
+  for (std::size_t i = 0; i < values.size(); ) {
+    std::size_t j = i;
+    while (j + 1 < values.size() && values[j + 1] == values[j] + 1) ++j;
+    if (!out.empty()) out += ",";
+    out += std::to_string(values[i]);
+    if (j > i) out += ":" + std::to_string(values[j]);
+    i = j + 1;
+  }
+  return out;
+}
+
+std::vector<std::string> imap_expand_uid_set(const std::string& set, std::size_t limit) {
+  std::vector<std::string> out;
+  std::istringstream ranges(set);
+  std::string range;
+  while (std::getline(ranges, range, ',') && out.size() < limit) {
+    std::uint64_t lo = 0, hi = 0;
+    auto colon = range.find(':');
+    try {
+      lo = std::stoull(range.substr(0, colon));
+      hi = colon == std::string::npos ? lo : std::stoull(range.substr(colon + 1));
+    } catch (...) {
+      continue;
+    }
+    if (lo > hi) std::swap(lo, hi);
+    for (std::uint64_t uid = lo; uid <= hi && out.size() < limit; ++uid)
+      out.push_back(std::to_string(uid));
+  }
+  return out;
+}
+
+std::string imap_status_value(const std::string& response, const std::string& key) {
+  std::string lower = ascii_lower(response);
+  std::string needle = ascii_lower(key);
+  for (std::size_t pos = lower.find(needle); pos != std::string::npos;
+       pos = lower.find(needle, pos + 1)) {
+    bool starts_word = pos == 0 || lower[pos - 1] == ' ' || lower[pos - 1] == '(' || lower[pos - 1] == '[';
+    std::size_t value = pos + needle.size();
+    if (!starts_word || value >= lower.size() || lower[value] != ' ') continue;
+    ++value;
+    std::size_t end = value;
+    while (end < lower.size() && std::isdigit(static_cast<unsigned char>(lower[end]))) ++end;
+    if (end > value) return response.substr(value, end - value);
+  }
+  return "";
+}
+
+std::vector<std::string> imap_parse_vanished(const std::string& response) {
+  std::vector<std::string> uids;
+  std::istringstream lines(response);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.size() < 11 || ascii_lower(line.substr(0, 11)) != "* vanished ") continue;
+    std::string rest = trim_str(line.substr(11));
+    if (ascii_lower(rest).rfind("(earlier)", 0) == 0) rest = trim_str(rest.substr(9));
+    auto expanded = imap_expand_uid_set(rest);
+    uids.insert(uids.end(), expanded.begin(), expanded.end());
+  }
+  return uids;
+}
+
+bool imap_is_mailbox_change(const std::string& line) {
+  std::istringstream iss(line);
+  std::string star, number, kind;
+  if (!(iss >> star >> number >> kind) || star != "*") return false;
+  if (!std::all_of(number.begin(), number.end(),
+                   [](unsigned char c) { return std::isdigit(c) != 0; }))
+    return false;
+  kind = ascii_lower(kind);
+  return kind == "exists" || kind == "expunge";
+}
+
+bool imap_has_capability(const std::string& capabilities, const std::string& name) {
+  std::istringstream iss(ascii_lower(capabilities));
+  std::string wanted = ascii_lower(name);
+  std::string token;
+  while (iss >> token) {
+    if (token == wanted) return true;
+  }
+  return false;
+}
+
+bool imap_flags_contain(const std::string& flags, const std::string& flag) {
+  std::string list = flags;
+  std::replace(list.begin(), list.end(), '(', ' ');
+  std::replace(list.begin(), list.end(), ')', ' ');
+  return imap_has_capability(list, flag);
+}
+
+namespace {
+
+void skip_spaces(const std::string& s, std::size_t& pos, std::size_t end) {
+  while (pos < end && s[pos] == ' ') ++pos;
+}
+
+bool read_fetch_literal(const std::string& s, std::size_t& pos, std::size_t end, std::string& out) {
+  std::size_t close = s.find('}', pos);
+  if (close == std::string::npos || close >= end) return false;
+  std::size_t digits_end = close;
+  if (digits_end > pos + 1 && s[digits_end - 1] == '+') digits_end--;
+  std::size_t size = 0;
+  try { size = std::stoull(s.substr(pos + 1, digits_end - pos - 1)); } catch (...) { return false; }
+  std::size_t data = close + 1;
+  if (data < end && s[data] == '\r') data++;
+  if (data >= end || s[data] != '\n') return false;
+  data++;
+  if (data + size > end) return false;
+  out.assign(s, data, size);
+  pos = data + size;
+  return true;
+}
+
+bool read_fetch_value(const std::string& s, std::size_t& pos, std::size_t end,
+                      std::string& out, bool& is_nil) {
+  is_nil = false;
+  skip_spaces(s, pos, end);
+  if (pos >= end) return false;
+
+  if (s[pos] == '{') return read_fetch_literal(s, pos, end, out);
+
+  if (s[pos] == '"') {
+    out.clear();
+    for (++pos; pos < end && s[pos] != '"'; ++pos) {
+      if (s[pos] == '\\' && pos + 1 < end) ++pos;
+      out.push_back(s[pos]);
+    }
+    if (pos >= end) return false;
+    ++pos;
+    return true;
+  }
+
+  if (s[pos] == '(') {
+    std::size_t start = pos;
+    int depth = 0;
+    while (pos < end) {
+      char c = s[pos];
+      if (c == '"') {
+        for (++pos; pos < end && s[pos] != '"'; ++pos)
+          if (s[pos] == '\\') ++pos;
+        ++pos;
+        continue;
+      }
+      if (c == '{') {
+        std::string ignored;
+        std::size_t lit = pos;
+        if (read_fetch_literal(s, lit, end, ignored)) { pos = lit; continue; }
+      }
+      if (c == '(') depth++;
+      if (c == ')' && --depth == 0) { ++pos; break; }
+      ++pos;
+    }
+    if (depth != 0) return false;
+    out.assign(s, start, pos - start);
+    return true;
+  }
+
+  std::size_t start = pos;
+  while (pos < end && s[pos] != ' ' && s[pos] != ')' && s[pos] != '\r' && s[pos] != '\n') ++pos;
+  out.assign(s, start, pos - start);
+  is_nil = ascii_lower(out) == "nil";
+  return !out.empty();
+}
+
+bool read_fetch_name(const std::string& s, std::size_t& pos, std::size_t end, std::string& name) {
+  skip_spaces(s, pos, end);
+  std::size_t start = pos;
+  while (pos < end && s[pos] != ' ' && s[pos] != ')') {
+    if (s[pos] == '[') {
+      std::size_t close = s.find(']', pos);
+      if (close == std::string::npos || close >= end) return false;
+      pos = close;
+    }
+    ++pos;
+  }
+  name = s.substr(start, pos - start);
+  for (auto& c : name) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return !name.empty();
+}
+
+}
+
+std::vector<imap_fetch_item> imap_parse_fetch_items(const std::string& response) {
+  std::vector<imap_fetch_item> items;
+  std::size_t pos = 0;
+  while (pos < response.size()) {
+    std::size_t next = imap_response_line_end(response, pos);
+    if (next == std::string::npos) next = response.size();
+
+    std::size_t p = pos;
+    if (response.compare(p, 2, "* ") == 0) {
+      p += 2;
+      std::size_t digits = p;
+      while (p < next && std::isdigit(static_cast<unsigned char>(response[p]))) ++p;
+      if (p > digits && p + 8 <= next &&
+          ascii_lower(response.substr(p, 8)) == " fetch (") {
+        imap_fetch_item item;
+        try { item.seq = std::stoull(response.substr(digits, p - digits)); } catch (...) {}
+        p += 8;
+        while (p < next) {
+          skip_spaces(response, p, next);
+          if (p >= next || response[p] == ')') break;
+          std::string name, value;
+          bool is_nil = false;
+          if (!read_fetch_name(response, p, next, name)) break;
+          if (!read_fetch_value(response, p, next, value, is_nil)) break;
+          if (!is_nil) item.attrs[name] = std::move(value);
+        }
+
+        auto same = std::find_if(items.begin(), items.end(),
+                                 [&](const imap_fetch_item& it) { return it.seq == item.seq; });
+        if (same == items.end()) {
+          items.push_back(std::move(item));
+        } else {
+          for (auto& kv : item.attrs) same->attrs[kv.first] = std::move(kv.second);
+        }
+      }
+    }
+    pos = next;
+  }
+  return items;
+}
+
+namespace {
+
+struct sexp {
+  enum class kind { atom, string, nil, list };
+  kind type = kind::nil;
+  std::string text;
+  std::vector<sexp> items;
+};
+
+bool parse_sexp(const std::string& s, std::size_t& pos, sexp& out) {
+  while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) ++pos;
+  if (pos >= s.size()) return false;
+
+  if (s[pos] == '(') {
+    out.type = sexp::kind::list;
+    ++pos;
+    while (true) {
+      while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) ++pos;
+      if (pos >= s.size()) return false;
+      if (s[pos] == ')') { ++pos; return true; }
+      sexp child;
+      if (!parse_sexp(s, pos, child)) return false;
+      out.items.push_back(std::move(child));
+    }
+  }
+
+  if (s[pos] == '"') {
+    out.type = sexp::kind::string;
+    for (++pos; pos < s.size() && s[pos] != '"'; ++pos) {
+      if (s[pos] == '\\' && pos + 1 < s.size()) ++pos;
+      out.text.push_back(s[pos]);
+    }
+    if (pos >= s.size()) return false;
+    ++pos;
+    return true;
+  }
+
+  if (s[pos] == '{') {
+    out.type = sexp::kind::string;
+    return read_fetch_literal(s, pos, s.size(), out.text);
+  }
+
+  std::size_t start = pos;
+  while (pos < s.size() && !std::isspace(static_cast<unsigned char>(s[pos])) &&
+         s[pos] != '(' && s[pos] != ')')
+    ++pos;
+  out.text = s.substr(start, pos - start);
+  out.type = ascii_lower(out.text) == "nil" ? sexp::kind::nil : sexp::kind::atom;
+  return true;
+}
+
+std::string sexp_param(const sexp& params, const std::string& key) {
+  if (params.type != sexp::kind::list) return "";
+  for (std::size_t i = 0; i + 1 < params.items.size(); i += 2) {
+    if (ascii_lower(params.items[i].text) == key) return params.items[i + 1].text;
+  }
+  return "";
+}
+
+void collect_body_parts(const sexp& node, const std::string& id, std::vector<imap_body_part>& out) {
+  if (node.type != sexp::kind::list || node.items.empty()) return;
+
+  if (node.items[0].type == sexp::kind::list) {
+    int index = 0;
+    for (const auto& child : node.items) {
+      if (child.type != sexp::kind::list) break;
+      ++index;
+      collect_body_parts(child, id.empty() ? std::to_string(index) : id + "." + std::to_string(index), out);
+    }
+    return;
+  }
+
+  if (node.items.size() < 7) return;
+  imap_body_part part;
+  part.part_id    = id.empty() ? "1" : id;
+  part.type       = ascii_lower(node.items[0].text);
+  part.subtype    = ascii_lower(node.items[1].text);
+  part.charset    = ascii_lower(sexp_param(node.items[2], "charset"));
+  part.filename   = sexp_param(node.items[2], "name");
+  part.content_id = node.items[3].text;
+  part.encoding   = ascii_lower(node.items[5].text);
+  try { part.size = std::stoull(node.items[6].text); } catch (...) {}
+
+  std::size_t ext = 7;
+  if (part.type == "text") ext = 8;
+  else if (part.type == "message" && part.subtype == "rfc822") ext = 10;
+  std::size_t disp_index = ext + 1;
+  if (disp_index < node.items.size() && node.items[disp_index].type == sexp::kind::list &&
+      !node.items[disp_index].items.empty()) {
+    const sexp& disp = node.items[disp_index];
+    part.disposition = ascii_lower(disp.items[0].text);
+    if (disp.items.size() > 1) {
+      std::string fn = sexp_param(disp.items[1], "filename");
+      if (!fn.empty()) part.filename = fn;
+    }
+  }
+  if (!part.filename.empty()) part.filename = decode_mime_header(part.filename);
+  out.push_back(std::move(part));
+}
+
+}
+
+std::vector<imap_body_part> imap_parse_bodystructure(const std::string& bodystructure) {
+  std::vector<imap_body_part> parts;
+  sexp root;
+  std::size_t pos = 0;
+  if (!parse_sexp(bodystructure, pos, root)) return parts;
+  collect_body_parts(root, "", parts);
+  return parts;
+}
+
+std::vector<attachment> imap_attachments_from_parts(const std::vector<imap_body_part>& parts) {
+  std::vector<attachment> result;
+  for (const auto& part : parts) {
+    bool is_body_text = part.type == "text" && (part.subtype == "plain" || part.subtype == "html");
+    bool is_att = part.disposition == "attachment" ||
+                  (part.disposition == "inline" && !part.filename.empty()) ||
+                  (part.disposition.empty() && !is_body_text && part.type != "multipart");
+    if (!is_att) continue;
+
+    attachment att;
+    att.filename    = part.filename;
+    att.mime_type   = part.type + "/" + part.subtype;
+    att.part_id     = part.part_id;
+    att.disposition = part.disposition.empty() ? "attachment" : part.disposition;
+    att.size_bytes  = part.encoding == "base64" ? part.size / 4 * 3 : part.size;
+    att.content_id  = part.content_id;
+    if (!att.content_id.empty() && att.content_id.front() == '<') att.content_id.erase(0, 1);
+    if (!att.content_id.empty() && att.content_id.back() == '>') att.content_id.pop_back();
+    if (part.type == "image" || att.mime_type == "application/pdf") att.safe_to_preview = true;
+    result.push_back(std::move(att));
+  }
+  return result;
+}
+
+std::string imap_decode_part(const std::string& data, const std::string& encoding) {
+  std::string enc = ascii_lower(encoding);
+  if (enc == "base64") return base64_decode(data);
+  if (enc == "quoted-printable") return quoted_printable_decode(data, false);
+  return data;
+}
+
 std::string imap_extract_raw(const std::string& imap_response,
                               message_parse_diagnostics& diag) {
   diag.response_size   = imap_response.size();
@@ -368,11 +699,11 @@ void split_headers_body(const std::string& raw,
 
 std::string get_header(const std::vector<std::string>& headers,
                        const std::string& name) {
-  std::string needle = to_lower(name);
+  std::string needle = ascii_lower(name);
   for (const auto& h : headers) {
     auto pos = h.find(':');
     if (pos == std::string::npos) continue;
-    std::string key = to_lower(trim_str(h.substr(0, pos)));
+    std::string key = ascii_lower(trim_str(h.substr(0, pos)));
     if (key == needle) return trim_str(h.substr(pos + 1));
   }
   return "";
@@ -397,121 +728,21 @@ std::string decode_mime_header(const std::string& value) {
   return trim_str(out);
 }
 
-std::string extract_part_by_content_type(const std::string& raw,
-                                          const std::string& content_type) {
-  std::string lower  = to_lower(raw);
-  std::string needle = "content-type: " + content_type;
-  std::size_t pos    = lower.find(needle);
-  if (pos == std::string::npos) return "";
-
-  std::size_t body_start = raw.find("\r\n\r\n", pos);
-  std::size_t sep        = 4;
-  if (body_start == std::string::npos) { body_start = raw.find("\n\n", pos); sep = 2; }
-  if (body_start == std::string::npos) return "";
-  body_start += sep;
-
-  std::size_t end = raw.find("\r\n--", body_start);
-  if (end == std::string::npos) end = raw.find("\n--", body_start);
-  std::string part = raw.substr(body_start,
-      end == std::string::npos ? std::string::npos : end - body_start);
-
-  std::size_t qp_hdr = lower.rfind("content-transfer-encoding:", body_start);
-  if (qp_hdr != std::string::npos && qp_hdr > pos) {
-    std::string enc_region = lower.substr(qp_hdr, body_start - qp_hdr);
-    if (enc_region.find("quoted-printable") != std::string::npos)
-      part = quoted_printable_decode(part, false);
-    else if (enc_region.find("base64") != std::string::npos)
-      part = base64_decode(part);
-  }
-  return trim_str(part);
+std::string strip_html_tags(const std::string& html) {
+  return html_to_text(html).text;
 }
 
-std::string strip_html_tags(const std::string& html_in) {
-  std::string html = html_in;
-  html = std::regex_replace(html, std::regex("<(script|style)[^>]*>[\\s\\S]*?</\\1>",
-                                             std::regex::icase), " ");
-  html = std::regex_replace(html, std::regex("<br\\s*/?>",  std::regex::icase), "\n");
-  html = std::regex_replace(html, std::regex("</p>",        std::regex::icase), "\n");
-  html = std::regex_replace(html, std::regex("<[^>]+>",     std::regex::icase), " ");
-  return trim_str(html);
-}
-
-std::string snippet_from_body(const std::string& body, std::size_t max_len) {
-  std::string s = body;
+std::string snippet_from_body(std::string_view body, std::size_t max_len) {
+  std::string s(body.substr(0, max_len));
   for (auto& c : s)
     if (c == '\r' || c == '\n' || c == '\t') c = ' ';
-  if (s.size() > max_len) s.resize(max_len);
   return trim_str(s);
 }
 
 std::vector<message_link> extract_links(const std::string& text,
                                          const std::string& html) {
-  std::vector<message_link> result;
-  std::set<std::string> seen;
-  collect_links(text, result, seen);
-  collect_links(html, result, seen);
-  collect_href_links(html, result, seen);
-  return result;
-}
-
-std::vector<attachment> extract_attachment_metadata(const std::string& raw) {
-  std::vector<attachment> result;
-  std::string lower = to_lower(raw);
-  std::size_t search_from = 0;
-  while (true) {
-    std::size_t disp_pos = lower.find("content-disposition:", search_from);
-    if (disp_pos == std::string::npos) break;
-    std::size_t line_end = lower.find('\n', disp_pos);
-    if (line_end == std::string::npos) break;
-    std::string disp_line  = raw.substr(disp_pos, line_end - disp_pos);
-    std::string disp_lower = to_lower(disp_line);
-    search_from = line_end + 1;
-
-    bool is_att    = disp_lower.find("attachment") != std::string::npos;
-    bool is_inline = disp_lower.find("inline")     != std::string::npos;
-    if (!is_att && !is_inline) continue;
-
-    attachment att;
-    att.disposition = is_att ? "attachment" : "inline";
-
-    static const std::regex fn_re(R"(filename\*?=\"?([^\";\r\n]+)\"?)",
-                                   std::regex::icase);
-    std::smatch fn_m;
-    if (std::regex_search(disp_line, fn_m, fn_re)) {
-      att.filename = trim_str(fn_m[1].str());
-      att.filename = decode_mime_header(att.filename);
-    }
-
-    std::size_t back_start  = disp_pos > 800 ? disp_pos - 800 : 0;
-    std::string back_lower  = lower.substr(back_start, disp_pos - back_start);
-    std::size_t ct_rel      = back_lower.rfind("content-type:");
-    if (ct_rel != std::string::npos) {
-      std::size_t ct_abs  = back_start + ct_rel;
-      std::size_t ct_end  = lower.find('\n', ct_abs);
-      std::string ct_line = ct_end != std::string::npos
-          ? raw.substr(ct_abs, ct_end - ct_abs) : raw.substr(ct_abs);
-      auto semi           = ct_line.find(';');
-      att.mime_type       = to_lower(trim_str(ct_line.substr(14,
-          semi == std::string::npos ? std::string::npos : semi - 14)));
-
-      if (att.mime_type.rfind("image/", 0) == 0) att.safe_to_preview = true;
-      if (att.mime_type == "application/pdf")    att.safe_to_preview = true;
-
-      std::size_t cid_pos = back_lower.rfind("content-id:");
-      if (cid_pos != std::string::npos) {
-        std::size_t cid_abs  = back_start + cid_pos;
-        std::size_t cid_end  = lower.find('\n', cid_abs);
-        std::string cid_line = cid_end != std::string::npos
-            ? raw.substr(cid_abs, cid_end - cid_abs) : raw.substr(cid_abs);
-        std::string cid_val  = trim_str(cid_line.substr(11));
-        if (!cid_val.empty() && cid_val.front() == '<') cid_val = cid_val.substr(1);
-        if (!cid_val.empty() && cid_val.back()  == '>') cid_val.pop_back();
-        att.content_id = cid_val;
-      }
-    }
-
-    if (!att.filename.empty() || !att.content_id.empty() || is_att)
-      result.push_back(std::move(att));
-  }
-  return result;
+  link_collector links;
+  scan_text_links(text, links);
+  scan_html_links(html, links);
+  return std::move(links.links);
 }
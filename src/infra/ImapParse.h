@@ -3,7 +3,10 @@
 #include "../domain/Message.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
@@ -35,6 +38,59 @@ std::string imap_extract_raw(const std::string& imap_response,
 bool is_incomplete_literal(const std::string& response);
 
 
+std::size_t imap_response_line_end(const std::string& buffer, std::size_t start);
+
+bool imap_tagged_response_end(const std::string& buffer,
+                              const std::string& tag,
+                              std::size_t& end,
+                              std::string& status_line);
+
+std::vector<std::string> imap_parse_search_uids(const std::string& response);
+
+std::string imap_quote_string(const std::string& value);
+
+std::string imap_compress_uid_set(const std::vector<std::string>& uids);
+
+std::vector<std::string> imap_expand_uid_set(const std::string& set, std::size_t limit = 100000);
+
+std::string imap_status_value(const std::string& response, const std::string& key);
+
+std::vector<std::string> imap_parse_vanished(const std::string& response);
+
+bool imap_is_mailbox_change(const std::string& line);
+
+bool imap_has_capability(const std::string& capabilities, const std::string& name);
+
+bool imap_flags_contain(const std::string& flags, const std::string& flag);
+
+
+struct imap_fetch_item {
+  std::uint64_t seq = 0;
+  std::map<std::string, std::string> attrs;
+};
+
+std::vector<imap_fetch_item> imap_parse_fetch_items(const std::string& response);
+
+
+struct imap_body_part {
+  std::string part_id;
+  std::string type;
+  std::string subtype;
+  std::string charset;
+  std::string encoding;
+  std::string disposition;
+  std::string filename;
+  std::string content_id;
+  std::size_t size = 0;
+};
+
+std::vector<imap_body_part> imap_parse_bodystructure(const std::string& bodystructure);
+
+std::vector<attachment> imap_attachments_from_parts(const std::vector<imap_body_part>& parts);
+
+std::string imap_decode_part(const std::string& data, const std::string& encoding);
+
+
 void split_headers_body(const std::string& raw,
                         std::vector<std::string>& headers,
                         std::string& body);
@@ -44,16 +100,11 @@ std::string get_header(const std::vector<std::string>& headers,
 
 std::string decode_mime_header(const std::string& value);
 
-std::string extract_part_by_content_type(const std::string& raw,
-                                          const std::string& content_type);
-
-std::string snippet_from_body(const std::string& body,
+std::string snippet_from_body(std::string_view body,
                                std::size_t max_len = 200);
 
 std::vector<message_link> extract_links(const std::string& text,
                                          const std::string& html = "");
 
-std::vector<attachment> extract_attachment_metadata(const std::string& raw);
-
 
 std::string strip_html_tags(const std::string& html);
@@ -0,0 +1,444 @@
+#include "ImapSession.h"
+#include "ImapParse.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+std::string now_iso() {
+  auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  std::tm tm{};
+#if defined(_WIN32)
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  char buf[32]{};
+  std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+  return buf;
+}
+
+}
+
+imap_session::imap_session(imap_config cfg) : cfg(std::move(cfg)) {}
+
+imap_session::~imap_session() {
+  std::lock_guard<std::mutex> lock(mu);
+  close_locked();
+}
+
+bool imap_session::command(const std::string& cmd, std::string& response, std::string& err) {
+  std::lock_guard<std::mutex> lock(mu);
+
+  auto now = std::chrono::steady_clock::now();
+  if (curl && cfg.session_idle_timeout_sec > 0 &&
+      now - last_used > std::chrono::seconds(cfg.session_idle_timeout_sec)) {
+    std::cout << "[imap] session idle timeout mailbox=" << cfg.mailbox_id << std::endl;
+    close_locked();
+    std::lock_guard<std::mutex> stats_lock(stats_mu);
+    counters.idle_expired++;
+  }
+
+  bool reused = curl != nullptr;
+  if (!curl && !open_locked(err)) {
+    record_failure(err);
+    return false;
+  }
+
+  bool transport_failed = false;
+  response.clear();
+  bool ok = run_locked(cmd, response, err, transport_failed);
+
+  if (!ok && transport_failed && reused) {
+    std::cout << "[imap] session lost mailbox=" << cfg.mailbox_id
+              << " err=" << err << ", reconnecting" << std::endl;
+    close_locked();
+    {
+      std::lock_guard<std::mutex> stats_lock(stats_mu);
+      counters.reconnects++;
+    }
+    reused = false;
+    err.clear();
+    response.clear();
+    transport_failed = false;
+    ok = open_locked(err) && run_locked(cmd, response, err, transport_failed);
+  }
+
+  if (!ok) {
+    if (transport_failed) close_locked();
+    record_failure(err);
+    return false;
+  }
+
+  last_used = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> stats_lock(stats_mu);
+  counters.commands++;
+  if (reused) counters.reused_commands++;
+  counters.last_used_at = now_iso();
+  return true;
+}
+
+bool imap_session::idle(int max_wait_sec,
+                        const std::atomic<bool>& stop,
+                        bool& changed,
+                        std::string& err) {
+  std::lock_guard<std::mutex> lock(mu);
+  changed = false;
+
+  if (!curl && !open_locked(err)) {
+    record_failure(err);
+    return false;
+  }
+  if (!imap_has_capability(capabilities(), "IDLE")) {
+    no_idle = true;
+    err = "server does not advertise IDLE";
+    return false;
+  }
+
+  char tag_buf[16]{};
+  std::snprintf(tag_buf, sizeof(tag_buf), "ctl%u", ++tag_seq);
+  std::string tag = tag_buf;
+
+  auto fail = [&](const std::string& reason) {
+    err = reason;
+    close_locked();
+    record_failure(err);
+    std::lock_guard<std::mutex> stats_lock(stats_mu);
+    counters.idle_waiting = false;
+    return false;
+  };
+
+  if (!send_locked(tag + " IDLE\r\n", err)) return fail(err);
+
+  std::size_t scan = 0;
+  bool accepted = false;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.command_timeout_sec);
+  while (!accepted) {
+    std::size_t next = imap_response_line_end(inbuf, scan);
+    if (next == std::string::npos) {
+      if (!recv_locked(deadline, err)) return fail(err);
+      continue;
+    }
+    std::string line = inbuf.substr(scan, next - scan);
+    scan = next;
+    if (line.rfind("+", 0) == 0) {
+      accepted = true;
+    } else if (line.rfind(tag + " ", 0) == 0) {
+      inbuf.erase(0, scan);
+      err = "imap IDLE rejected: " + line.substr(tag.size() + 1);
+      while (!err.empty() && (err.back() == '\r' || err.back() == '\n')) err.pop_back();
+      record_failure(err);
+      return false;
+    } else if (imap_is_mailbox_change(line)) {
+      changed = true;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> stats_lock(stats_mu);
+    counters.idle_waiting = true;
+    counters.idle_rounds++;
+  }
+
+  auto until = std::chrono::steady_clock::now() + std::chrono::seconds(max_wait_sec);
+  while (!changed && !stop) {
+    std::size_t next = imap_response_line_end(inbuf, scan);
+    if (next != std::string::npos) {
+      if (imap_is_mailbox_change(inbuf.substr(scan, next - scan))) changed = true;
+      scan = next;
+      continue;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        until - std::chrono::steady_clock::now()).count();
+    if (left <= 0) break;
+    if (!poll_locked(static_cast<int>(std::min<long long>(left, 1000)), err)) return fail(err);
+  }
+  inbuf.erase(0, scan);
+
+  {
+    std::lock_guard<std::mutex> stats_lock(stats_mu);
+    counters.idle_waiting = false;
+  }
+
+  if (!send_locked("DONE\r\n", err)) return fail(err);
+
+  std::size_t end = 0;
+  std::string status_line;
+  while (!imap_tagged_response_end(inbuf, tag, end, status_line)) {
+    auto done_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.command_timeout_sec);
+    if (!recv_locked(done_deadline, err)) return fail(err);
+  }
+  for (std::size_t pos = 0; pos < end; ) {
+    std::size_t next = imap_response_line_end(inbuf, pos);
+    if (next == std::string::npos || next > end) break;
+    if (imap_is_mailbox_change(inbuf.substr(pos, next - pos))) changed = true;
+    pos = next;
+  }
+  inbuf.erase(0, end);
+
+  if (status_line.rfind("OK", 0) != 0) {
+    err = "imap IDLE " + status_line;
+    record_failure(err);
+    return false;
+  }
+
+  last_used = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> stats_lock(stats_mu);
+  if (changed) counters.idle_wakeups++;
+  counters.last_used_at = now_iso();
+  return true;
+}
+
+bool imap_session::idle_unsupported() const {
+  return no_idle;
+}
+
+void imap_session::disconnect() {
+  std::lock_guard<std::mutex> lock(mu);
+  close_locked();
+}
+
+mail_session_stats imap_session::stats() const {
+  std::lock_guard<std::mutex> lock(stats_mu);
+  return counters;
+}
+
+std::string imap_session::capabilities() const {
+  std::lock_guard<std::mutex> lock(stats_mu);
+  return caps;
+}
+
+bool imap_session::open_locked(std::string& err) {
+  curl = curl_easy_init();
+  if (!curl) {
+    err = "curl init failed";
+    return false;
+  }
+
+  std::ostringstream url;
+  url << (cfg.tls ? "imaps" : "imap") << "://" << cfg.host << ":" << cfg.port << "/";
+  std::string url_text = url.str();
+
+  char error_buffer[CURL_ERROR_SIZE] = {0};
+  curl_easy_setopt(curl, CURLOPT_URL,            url_text.c_str());
+  curl_easy_setopt(curl, CURLOPT_USERNAME,       cfg.username.c_str());
+  curl_easy_setopt(curl, CURLOPT_PASSWORD,       cfg.password.c_str());
+  curl_easy_setopt(curl, CURLOPT_USE_SSL,        cfg.tls ? CURLUSESSL_ALL : CURLUSESSL_NONE);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+  curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY,   1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL,       1L);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER,    error_buffer);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT,        static_cast<long>(cfg.command_timeout_sec));
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+
+  CURLcode res = curl_easy_perform(curl);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, nullptr);
+  if (res != CURLE_OK) {
+    err = error_buffer[0] ? std::string(error_buffer) : std::string(curl_easy_strerror(res));
+    close_locked();
+    return false;
+  }
+
+  inbuf.clear();
+  std::string response;
+  bool transport_failed = false;
+  if (!run_locked("CAPABILITY", response, err, transport_failed)) {
+    close_locked();
+    return false;
+  }
+  std::string capability_line;
+  std::istringstream lines(response);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.rfind("* CAPABILITY ", 0) == 0) capability_line = line.substr(13);
+  }
+  if (!capability_line.empty() && capability_line.back() == '\r') capability_line.pop_back();
+
+  bool qresync = imap_has_capability(capability_line, "QRESYNC");
+  bool condstore = qresync || imap_has_capability(capability_line, "CONDSTORE");
+  if (qresync) {
+    std::string enable_err;
+    if (!run_locked("ENABLE QRESYNC", response, enable_err, transport_failed)) {
+      if (transport_failed) {
+        err = enable_err;
+        close_locked();
+        return false;
+      }
+      qresync = false;
+    }
+  }
+
+  std::string select_cmd = "SELECT " + imap_quote_string(cfg.folder);
+  bool selected = false;
+  if (condstore) {
+    selected = run_locked(select_cmd + " (CONDSTORE)", response, err, transport_failed);
+    if (!selected && !transport_failed) condstore = qresync = false;
+  }
+  if (!selected && !transport_failed)
+    selected = run_locked(select_cmd, response, err, transport_failed);
+  if (!selected) {
+    err = "SELECT " + cfg.folder + " failed: " + err;
+    close_locked();
+    return false;
+  }
+
+  last_used = std::chrono::steady_clock::now();
+  std::cout << "[imap] session connected mailbox=" << cfg.mailbox_id
+            << " host=" << cfg.host << " folder=" << cfg.folder << std::endl;
+
+  std::lock_guard<std::mutex> stats_lock(stats_mu);
+  caps = capability_line;
+  counters.condstore = condstore;
+  counters.qresync = qresync;
+  counters.connected = true;
+  counters.connects++;
+  counters.connected_at = now_iso();
+  return true;
+}
+
+void imap_session::close_locked() {
+  if (curl) {
+    curl_easy_cleanup(curl);
+    curl = nullptr;
+  }
+  inbuf.clear();
+  std::lock_guard<std::mutex> stats_lock(stats_mu);
+  counters.connected = false;
+}
+
+bool imap_session::run_locked(const std::string& cmd,
+                              std::string& response,
+                              std::string& err,
+                              bool& transport_failed) {
+  char tag_buf[16]{};
+  std::snprintf(tag_buf, sizeof(tag_buf), "ctl%u", ++tag_seq);
+  std::string tag = tag_buf;
+
+  if (!send_locked(tag + " " + cmd + "\r\n", err)) {
+    transport_failed = true;
+    return false;
+  }
+
+  std::size_t end = 0;
+  std::string status_line;
+  while (!imap_tagged_response_end(inbuf, tag, end, status_line)) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.command_timeout_sec);
+    if (!recv_locked(deadline, err)) {
+      transport_failed = true;
+      return false;
+    }
+  }
+
+  response = inbuf.substr(0, end);
+  inbuf.erase(0, end);
+
+  if (status_line.rfind("OK", 0) != 0) {
+    err = "imap " + status_line;
+    return false;
+  }
+  return true;
+}
+
+bool imap_session::send_locked(const std::string& data, std::string& err) {
+  std::size_t offset = 0;
+  while (offset < data.size()) {
+    std::size_t sent = 0;
+    CURLcode rc = curl_easy_send(curl, data.data() + offset, data.size() - offset, &sent);
+    if (rc == CURLE_AGAIN) {
+      if (!wait_socket(false, cfg.command_timeout_sec * 1000)) {
+        err = "imap write timeout";
+        return false;
+      }
+      continue;
+    }
+    if (rc != CURLE_OK) {
+      err = curl_easy_strerror(rc);
+      return false;
+    }
+    offset += sent;
+  }
+  return true;
+}
+
+bool imap_session::recv_locked(std::chrono::steady_clock::time_point deadline, std::string& err) {
+  char buf[16384];
+  while (true) {
+    std::size_t received = 0;
+    CURLcode rc = curl_easy_recv(curl, buf, sizeof(buf), &received);
+    if (rc == CURLE_AGAIN) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0 || !wait_socket(true, static_cast<int>(left))) {
+        err = "imap read timeout";
+        return false;
+      }
+      continue;
+    }
+    if (rc != CURLE_OK) {
+      err = curl_easy_strerror(rc);
+      return false;
+    }
+    if (received == 0) {
+      err = "imap connection closed by server";
+      return false;
+    }
+    inbuf.append(buf, received);
+    return true;
+  }
+}
+
+bool imap_session::poll_locked(int wait_ms, std::string& err) {
+  char buf[16384];
+  std::size_t received = 0;
+  CURLcode rc = curl_easy_recv(curl, buf, sizeof(buf), &received);
+  if (rc == CURLE_AGAIN) {
+    wait_socket(true, wait_ms);
+    return true;
+  }
+  if (rc != CURLE_OK) {
+    err = curl_easy_strerror(rc);
+    return false;
+  }
+  if (received == 0) {
+    err = "imap connection closed by server";
+    return false;
+  }
+  inbuf.append(buf, received);
+  return true;
+}
+
+bool imap_session::wait_socket(bool for_recv, int timeout_ms) const {
+  curl_socket_t sock = CURL_SOCKET_BAD;
+  if (curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sock) != CURLE_OK || sock == CURL_SOCKET_BAD)
+    return false;
+
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(sock, &fds);
+  timeval tv{};
+  tv.tv_sec  = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  int rc = select(static_cast<int>(sock) + 1,
+                  for_recv ? &fds : nullptr,
+                  for_recv ? nullptr : &fds,
+                  nullptr, &tv);
+  return rc > 0;
+}
+
+void imap_session::record_failure(const std::string& err) {
+  std::lock_guard<std::mutex> stats_lock(stats_mu);
+  counters.failures++;
+  counters.last_error = err;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "MailClient.h"
+#include "../app/Config.h"
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+
+class imap_session {
+public:
+  explicit imap_session(imap_config cfg);
+  ~imap_session();
+
+  imap_session(const imap_session&) = delete;
+  imap_session& operator=(const imap_session&) = delete;
+
+  bool command(const std::string& cmd, std::string& response, std::string& err);
+  bool idle(int max_wait_sec, const std::atomic<bool>& stop, bool& changed, std::string& err);
+  void disconnect();
+
+  bool idle_unsupported() const;
+
+  mail_session_stats stats() const;
+  std::string capabilities() const;
+
+private:
+  bool open_locked(std::string& err);
+  void close_locked();
+  bool run_locked(const std::string& cmd,
+                  std::string& response,
+                  std::string& err,
+                  bool& transport_failed);
+  bool send_locked(const std::string& data, std::string& err);
+  bool recv_locked(std::chrono::steady_clock::time_point deadline, std::string& err);
+  bool poll_locked(int wait_ms, std::string& err);
+  bool wait_socket(bool for_recv, int timeout_ms) const;
+  void record_failure(const std::string& err);
+
+  imap_config cfg;
+  std::mutex mu;
+  CURL* curl = nullptr;
+  std::string inbuf;
+  std::string caps;
+  unsigned tag_seq = 0;
+  std::atomic<bool> no_idle{false};
+  std::chrono::steady_clock::time_point last_used{};
+
+  mutable std::mutex stats_mu;
+  mail_session_stats counters;
+};
@@ -0,0 +1,198 @@
+#include "LinkScan.h"
+#include "../util/CaseFold.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+
+namespace {
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool is_url_char(char c) {
+  return !is_space(c) && c != '"' && c != '\'' && c != '<' && c != '>';
+}
+
+bool icontains(std::string_view hay, std::string_view lower_needle) {
+  if (lower_needle.empty()) return true;
+  if (hay.size() < lower_needle.size()) return false;
+  for (std::size_t i = 0; i + lower_needle.size() <= hay.size(); ++i)
+    if (ascii_istarts_with(hay, i, lower_needle)) return true;
+  return false;
+}
+
+std::size_t scheme_length(std::string_view s, std::size_t pos) {
+  if (ascii_istarts_with(s, pos, "https://")) return 8;
+  if (ascii_istarts_with(s, pos, "http://")) return 7;
+  return 0;
+}
+
+inline bool is_trailing_punct(char c) {
+  return c == '.' || c == ',' || c == ')' || c == ']' || c == '}' || c == ';';
+}
+
+
+enum class host_match { exact_or_sub, label_prefix };
+
+struct form_link_pattern {
+  std::string_view host;
+  host_match how;
+  std::string_view path_prefix;
+  double confidence;
+  std::string_view excluded[4];
+};
+
+const form_link_pattern k_form_link_patterns[] = {
+  {"forms.yandex.",       host_match::label_prefix, "",      0.95,
+   {"/admin/", "/answers/", "/success", "/results/"}},
+  {"docs.google.com",     host_match::exact_or_sub, "/forms", 0.95, {"/viewanalytics", "/closedform"}},
+  {"forms.gle",           host_match::exact_or_sub, "",      0.95, {}},
+  {"forms.office.com",    host_match::exact_or_sub, "",      0.95, {}},
+  {"forms.microsoft.com", host_match::exact_or_sub, "",      0.95, {}},
+  {"portal.hse.ru",       host_match::exact_or_sub, "/poll", 0.9,  {}},
+  {"lms.hse.ru",          host_match::exact_or_sub, "",      0.85, {}},
+  {"smartlms.hse.ru",     host_match::exact_or_sub, "",      0.85, {}},
+};
+
+bool host_matches(std::string_view host, const form_link_pattern& p) {
+  if (p.how == host_match::exact_or_sub) {
+    if (host == p.host) return true;
+    return host.size() > p.host.size() &&
+           host.compare(host.size() - p.host.size(), p.host.size(), p.host) == 0 &&
+           host[host.size() - p.host.size() - 1] == '.';
+  }
+  for (std::size_t pos = host.find(p.host); pos != std::string_view::npos; pos = host.find(p.host, pos + 1))
+    if (pos == 0 || host[pos - 1] == '.') return true;
+  return false;
+}
+
+}
+
+
+void link_collector::add(std::string_view raw_url) {
+  static const std::pair<std::string_view, char> kEntities[] = {
+    {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&#39;", '\''},
+  };
+  std::string url;
+  url.reserve(raw_url.size());
+  for (std::size_t i = 0; i < raw_url.size(); ++i) {
+    char c = raw_url[i];
+    if (c == '&') {
+      for (const auto& [entity, decoded] : kEntities) {
+        if (raw_url.compare(i, entity.size(), entity) == 0) {
+          c = decoded;
+          i += entity.size() - 1;
+          break;
+        }
+      }
+    }
+    url.push_back(c);
+  }
+  while (!url.empty() && is_trailing_punct(url.back())) url.pop_back();
+  if (url.empty() || seen.count(url)) return;
+
+  message_link item;
+  item.domain     = url_host(url);
+  item.confidence = form_link_confidence(url);
+  item.url        = url;
+  seen.insert(std::move(url));
+  links.push_back(std::move(item));
+}
+
+std::size_t bare_url_length(std::string_view s, std::size_t pos) {
+  std::size_t scheme = scheme_length(s, pos);
+  if (scheme == 0) return 0;
+  std::size_t end = pos + scheme;
+  while (end < s.size() && is_url_char(s[end])) ++end;
+  return end > pos + scheme ? end - pos : 0;
+}
+
+bool href_url_at(std::string_view s, std::size_t pos,
+                 std::size_t& url_begin, std::size_t& url_end, std::size_t& next) {
+  if (!ascii_istarts_with(s, pos, "href")) return false;
+  std::size_t i = pos + 4;
+  while (i < s.size() && is_space(s[i])) ++i;
+  if (i >= s.size() || s[i] != '=') return false;
+  ++i;
+  while (i < s.size() && is_space(s[i])) ++i;
+  if (i >= s.size() || (s[i] != '"' && s[i] != '\'')) return false;
+  ++i;
+  std::size_t scheme = scheme_length(s, i);
+  if (scheme == 0) return false;
+  std::size_t end = i + scheme;
+  while (end < s.size() && s[end] != '"' && s[end] != '\'') ++end;
+  if (end >= s.size() || end == i + scheme) return false;
+  url_begin = i;
+  url_end   = end;
+  next      = end + 1;
+  return true;
+}
+
+void scan_text_links(std::string_view text, link_collector& out) {
+  std::size_t i = 0;
+  while (i < text.size()) {
+    if (ascii_lower(text[i]) == 'h') {
+      if (std::size_t len = bare_url_length(text, i)) {
+        out.add(text.substr(i, len));
+        i += len;
+        continue;
+      }
+    }
+    ++i;
+  }
+}
+
+void scan_html_links(std::string_view html, link_collector& out) {
+  std::size_t i = 0;
+  while (i < html.size()) {
+    if (ascii_lower(html[i]) == 'h') {
+      std::size_t begin = 0, end = 0, next = 0;
+      if (href_url_at(html, i, begin, end, next)) {
+        out.add(html.substr(begin, end - begin));
+        i = next;
+        continue;
+      }
+      if (std::size_t len = bare_url_length(html, i)) {
+        out.add(html.substr(i, len));
+        i += len;
+        continue;
+      }
+    }
+    ++i;
+  }
+}
+
+std::string url_host(std::string_view url) {
+  std::size_t begin = scheme_length(url, 0);
+  if (begin == 0) return "";
+  std::size_t end = begin;
+  while (end < url.size() && url[end] != '/' && url[end] != ':' && url[end] != '?' && url[end] != '#') ++end;
+  std::string host;
+  host.reserve(end - begin);
+  for (std::size_t i = begin; i < end; ++i) host.push_back(ascii_lower(url[i]));
+  return host;
+}
+
+double form_link_confidence(std::string_view url) {
+  std::string host = url_host(url);
+  std::size_t path_begin = scheme_length(url, 0) + host.size();
+  std::string_view path = path_begin < url.size() ? url.substr(path_begin) : std::string_view();
+  if (!path.empty() && path.front() == ':') {
+    std::size_t slash = path.find('/');
+    path = slash == std::string_view::npos ? std::string_view() : path.substr(slash);
+  }
+
+  for (const auto& p : k_form_link_patterns) {
+    if (!host_matches(host, p)) continue;
+    if (!p.path_prefix.empty() && !ascii_istarts_with(path, 0, p.path_prefix)) continue;
+    for (auto excluded : p.excluded)
+      if (!excluded.empty() && icontains(path, excluded)) return 0.0;
+    return p.confidence;
+  }
+  if (icontains(url, "form") || icontains(url, "poll")) return 0.6;
+  return 0.2;
+}
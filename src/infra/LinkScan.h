@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../domain/Message.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+
+struct link_collector {
+  std::vector<message_link> links;
+  std::unordered_set<std::string> seen;
+
+  void add(std::string_view raw_url);
+};
+
+
+std::size_t bare_url_length(std::string_view s, std::size_t pos);
+
+bool href_url_at(std::string_view s, std::size_t pos,
+                 std::size_t& url_begin, std::size_t& url_end, std::size_t& next);
+
+void scan_text_links(std::string_view text, link_collector& out);
+
+void scan_html_links(std::string_view html, link_collector& out);
+
+
+std::string url_host(std::string_view url);
+
+double form_link_confidence(std::string_view url);
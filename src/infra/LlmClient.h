@@ -18,6 +18,7 @@ public:
 };
 
 std::unique_ptr<llm_client> make_noop_llm_client();
+std::unique_ptr<llm_client> make_noop_llm_client(const llm_config& cfg);
 std::unique_ptr<llm_client> make_ollama_client(const llm_config& cfg);
 
 struct ollama_probe_result {
@@ -4,6 +4,7 @@
 #include "../app/Config.h"
 
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,8 @@ struct imap_test_result {
   bool auth_ok = false;
   bool folder_ok = false;
   std::uint64_t max_uid = 0;
+  std::uint64_t uid_next = 0;
+  std::uint64_t messages = 0;
   std::string error;
 
   bool latest_fetch_ok = false;
@@ -27,6 +30,34 @@ struct imap_test_result {
   int links_count = 0;
 };
 
+struct mail_session_stats {
+  bool connected = false;
+  std::uint64_t connects = 0;
+  std::uint64_t reconnects = 0;
+  std::uint64_t idle_expired = 0;
+  std::uint64_t commands = 0;
+  std::uint64_t reused_commands = 0;
+  std::uint64_t failures = 0;
+  bool condstore = false;
+  bool qresync = false;
+  std::string push_mode = "polling";
+  bool idle_waiting = false;
+  std::uint64_t idle_rounds = 0;
+  std::uint64_t idle_wakeups = 0;
+  std::string connected_at;
+  std::string last_used_at;
+  std::string last_error;
+};
+
+
+struct mailbox_status {
+  bool ok = false;
+  std::uint64_t uid_next = 0;
+  std::uint64_t messages = 0;
+  std::uint64_t highest_modseq = 0;
+  std::string uid_validity;
+};
+
 
 struct mail_fetch_result {
   bool ok = true;
@@ -40,6 +71,11 @@ struct mail_fetch_result {
   std::vector<message>     messages;
   std::vector<std::string> failed_uids;
   std::vector<std::string> parse_failed_uids;
+  std::uint64_t highest_modseq = 0;
+  std::vector<std::string> seen_uids;
+  std::vector<std::string> unseen_uids;
+  std::vector<std::string> expunged_uids;
+  std::vector<std::string> skipped_uids;
 };
 
 class mail_client {
@@ -49,7 +85,34 @@ public:
   virtual std::vector<message> fetch_after_uid(std::uint64_t last_seen_uid) = 0;
   virtual std::vector<message> fetch_last_n(int n) = 0;
   virtual std::string fetch_uid_validity() { return ""; }
+  virtual mailbox_status probe_status() { return {}; }
+  virtual void begin_cycle() {}
+  virtual bool search_uids_since(int days, std::vector<std::string>& uids, std::string& err) {
+    err = "not supported";
+    return false;
+  }
+  virtual bool search_last_uids(int n, std::vector<std::string>& uids, std::string& err) {
+    err = "not supported";
+    return false;
+  }
+  virtual mail_fetch_result fetch_uids_result(const std::vector<std::string>& uids) {
+    mail_fetch_result r;
+    r.ok = false;
+    r.error = "not supported";
+    return r;
+  }
   virtual void mark_message_seen(const std::string& uid) {}
+  virtual mail_session_stats session_stats() const { return {}; }
+  virtual bool start_push(std::function<void()> on_change) { return false; }
+  virtual void stop_push() {}
+  // Called by the ingestion fetches (fetch_delta, fetch_after_uid_result,
+  // fetch_uids_result) before anything is fetched; returns the UIDs still
+  // worth fetching, the rest land in skipped_uids. fetch_last_n is not screened.
+  virtual void set_prescreen(std::function<std::vector<std::string>(const std::vector<std::string>&)> fn) {}
+
+  virtual mail_fetch_result fetch_delta(std::uint64_t last_seen_uid, std::uint64_t highest_modseq) {
+    return fetch_after_uid_result(last_seen_uid);
+  }
 
 
   virtual mail_fetch_result fetch_after_uid_result(std::uint64_t last_seen_uid) {
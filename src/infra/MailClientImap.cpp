@@ -1,14 +1,25 @@
 #include "MailClient.h"
+#include "HtmlText.h"
 #include "ImapParse.h"
+#include "ImapSession.h"
+#include "LinkScan.h"
+#include "MimeParse.h"
+#include "../util/MailDate.h"
 
 #include <curl/curl.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
 #include <cstdint>
 #include <iostream>
-#include <regex>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -20,12 +31,6 @@ struct curl_global_guard {
 
 static curl_global_guard curl_guard;
 
-std::size_t write_cb(char* ptr, std::size_t size, std::size_t nmemb, void* userdata) {
-  auto* out = static_cast<std::string*>(userdata);
-  out->append(ptr, size * nmemb);
-  return size * nmemb;
-}
-
 std::uint64_t parse_uint64_or_zero(const std::string& text) {
   try {
     std::size_t pos = 0;
@@ -36,32 +41,21 @@ std::uint64_t parse_uint64_or_zero(const std::string& text) {
   }
 }
 
-
-std::string parse_uid_validity(const std::string& response) {
-  static const std::regex re(R"(\[UIDVALIDITY\s+(\d+)\])", std::regex::icase);
-  std::smatch m;
-  if (std::regex_search(response, m, re)) return m[1].str();
-  static const std::regex re2(R"(UIDVALIDITY\s+(\d+))", std::regex::icase);
-  if (std::regex_search(response, m, re2)) return m[1].str();
-  return "";
-}
-
 }
 
 class mail_client_imap : public mail_client {
 public:
-  explicit mail_client_imap(imap_config cfg) : cfg(std::move(cfg)) {}
+  explicit mail_client_imap(imap_config cfg) : cfg(cfg), session(cfg), idle_session(cfg) {}
+
+  ~mail_client_imap() override { stop_push(); }
 
   friend imap_test_result test_imap_mailbox(const imap_config& cfg);
 
   std::uint64_t fetch_max_uid() override {
-    std::vector<std::string> uids;
+    mailbox_status st;
     std::string err;
-    if (!fetch_uid_list("UID SEARCH ALL", uids, err)) return 0;
-    std::uint64_t max_uid = 0;
-    for (const auto& uid : uids)
-      max_uid = std::max(max_uid, parse_uint64_or_zero(uid));
-    return max_uid;
+    if (!probe(true, st, err)) return 0;
+    return last_message_uid(st, err);
   }
 
 
@@ -74,7 +68,13 @@ public:
     mail_fetch_result result;
     result.mailbox_id    = cfg.mailbox_id;
     result.last_seen_uid = last_seen_uid;
-    result.uid_validity  = fetch_uid_validity();
+    auto st = probe_status();
+    result.uid_validity  = st.uid_validity;
+    if (st.ok && st.uid_next > 0 && st.uid_next <= last_seen_uid + 1) {
+      std::cout << "[mail] imap no new uids uidnext=" << st.uid_next
+                << " last_seen_uid=" << last_seen_uid << std::endl;
+      return result;
+    }
 
     std::vector<std::string> uids;
     std::string err;
@@ -96,38 +96,63 @@ public:
     uids.erase(std::remove_if(uids.begin(), uids.end(), [last_seen_uid](const std::string& u) {
       return parse_uint64_or_zero(u) <= last_seen_uid;
     }), uids.end());
-    std::sort(uids.begin(), uids.end(), [](const std::string& a, const std::string& b) {
-      return parse_uint64_or_zero(a) < parse_uint64_or_zero(b);
-    });
+    sort_uids(uids);
 
     result.searched_uids = uids;
     std::cout << "[mail] imap new uids count=" << uids.size()
               << " last_seen_uid=" << last_seen_uid << std::endl;
 
-    for (const auto& uid : uids) {
-      std::cout << "[mail] fetch uid=" << uid << " mailbox=" << cfg.mailbox_id << std::endl;
-      message msg;
-      std::string fetch_err;
-      if (fetch_message(uid, msg, fetch_err)) {
-        result.fetched_uids.push_back(uid);
-        std::cout << "[mail] fetched uid=" << uid
-                  << " strategy=" << msg.parse_strategy
-                  << " from=" << msg.from
-                  << " subject=" << msg.subject
-                  << " links=" << msg.links.size()
-                  << " parse_suspect=" << msg.parse_suspect << std::endl;
-        if (msg.parse_suspect) {
-          result.parse_failed_uids.push_back(uid);
-        } else {
-          std::uint64_t uid_n = parse_uint64_or_zero(uid);
-          if (uid_n > result.max_seen_uid) result.max_seen_uid = uid_n;
-          result.messages.push_back(std::move(msg));
-        }
-      } else {
-        std::cout << "[mail] fetch failed uid=" << uid << " err=" << fetch_err << std::endl;
-        result.failed_uids.push_back(uid);
+    fetch_uids(uids, result, true);
+    return result;
+  }
+
+  mail_fetch_result fetch_delta(std::uint64_t last_seen_uid, std::uint64_t highest_modseq) override {
+    auto result = fetch_after_uid_result(last_seen_uid);
+    if (!result.ok) return result;
+
+    auto stats = session.stats();
+    if (!stats.condstore) return result;
+
+    std::string response;
+    std::string err;
+    std::uint64_t server_modseq = probe_status().highest_modseq;
+    if (server_modseq == 0) {
+      if (!session.command("STATUS " + imap_quote_string(cfg.folder) + " (HIGHESTMODSEQ)", response, err)) {
+        std::cout << "[mail] modseq status failed err=" << err << std::endl;
+        return result;
       }
+      server_modseq = parse_uint64_or_zero(imap_status_value(response, "HIGHESTMODSEQ"));
+    }
+    result.highest_modseq = server_modseq;
+    if (server_modseq == 0 || highest_modseq == 0 || last_seen_uid == 0 ||
+        server_modseq <= highest_modseq)
+      return result;
+
+    std::ostringstream cmd;
+    cmd << "UID FETCH 1:" << last_seen_uid << " (UID FLAGS) (CHANGEDSINCE " << highest_modseq
+        << (stats.qresync ? " VANISHED)" : ")");
+    if (!session.command(cmd.str(), response, err)) {
+      std::cout << "[mail] changedsince fetch failed err=" << err << std::endl;
+      result.highest_modseq = highest_modseq;
+      return result;
+    }
+
+    for (const auto& item : imap_parse_fetch_items(response)) {
+      auto uid_it = item.attrs.find("UID");
+      auto flags_it = item.attrs.find("FLAGS");
+      if (uid_it == item.attrs.end() || flags_it == item.attrs.end()) continue;
+      if (imap_flags_contain(flags_it->second, "\\Seen"))
+        result.seen_uids.push_back(uid_it->second);
+      else
+        result.unseen_uids.push_back(uid_it->second);
     }
+    if (stats.qresync) result.expunged_uids = imap_parse_vanished(response);
+
+    std::cout << "[mail] delta mailbox=" << cfg.mailbox_id
+              << " modseq=" << highest_modseq << "->" << server_modseq
+              << " seen=" << result.seen_uids.size()
+              << " unseen=" << result.unseen_uids.size()
+              << " expunged=" << result.expunged_uids.size() << std::endl;
     return result;
   }
 
@@ -136,85 +161,178 @@ public:
     std::vector<std::string> all_uids;
     std::string err;
     std::cout << "[mail] fetch_last_n n=" << n << " mailbox=" << cfg.mailbox_id << std::endl;
-    if (!fetch_uid_list("UID SEARCH ALL", all_uids, err)) {
+    if (!search_last_uids(n, all_uids, err)) {
       std::cout << "[mail] fetch_last_n search failed err=" << err << std::endl;
       return {};
     }
-    std::sort(all_uids.begin(), all_uids.end(), [](const std::string& a, const std::string& b) {
-      return parse_uint64_or_zero(a) < parse_uint64_or_zero(b);
-    });
-    if (static_cast<int>(all_uids.size()) > n)
-      all_uids.erase(all_uids.begin(), all_uids.end() - n);
-    std::vector<message> result;
-    for (const auto& uid : all_uids) {
-      message msg;
-      std::string fetch_err;
-      if (fetch_message(uid, msg, fetch_err)) result.push_back(std::move(msg));
-    }
+    mail_fetch_result result;
+    fetch_uids(all_uids, result, false);
+    return std::move(result.messages);
+  }
+
+  bool search_last_uids(int n, std::vector<std::string>& uids, std::string& err) override {
+    mailbox_status st;
+    if (n <= 0) return true;
+    if (!probe(true, st, err)) return false;
+    if (st.messages == 0) return true;
+
+
+    std::uint64_t first = st.messages > static_cast<std::uint64_t>(n)
+                              ? st.messages - static_cast<std::uint64_t>(n) + 1 : 1;
+    std::vector<std::string> found;
+    if (!fetch_uid_list(search_prefix() + std::to_string(first) + ":*", found, err)) return false;
+    sort_uids(found);
+    if (static_cast<int>(found.size()) > n)
+      found.erase(found.begin(), found.end() - n);
+    uids.insert(uids.end(), found.begin(), found.end());
+    return true;
+  }
+
+  bool search_uids_since(int days, std::vector<std::string>& uids, std::string& err) override {
+    static const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    std::time_t since = std::time(nullptr) - static_cast<std::time_t>(std::max(0, days)) * 86400;
+    std::tm tm{};
+#if defined(_WIN32)
+    gmtime_s(&tm, &since);
+#else
+    gmtime_r(&since, &tm);
+#endif
+    std::ostringstream cmd;
+    cmd << search_prefix() << "SINCE " << tm.tm_mday << "-" << months[tm.tm_mon] << "-"
+        << (tm.tm_year + 1900);
+    std::vector<std::string> found;
+    if (!fetch_uid_list(cmd.str(), found, err)) return false;
+    sort_uids(found);
+    uids.insert(uids.end(), found.begin(), found.end());
+    return true;
+  }
+
+  mail_fetch_result fetch_uids_result(const std::vector<std::string>& uids) override {
+    mail_fetch_result result;
+    result.mailbox_id    = cfg.mailbox_id;
+    result.searched_uids = uids;
+    fetch_uids(uids, result, true);
     return result;
   }
 
-private:
-  imap_config cfg;
+  bool start_push(std::function<void()> on_change) override {
+    if (!cfg.idle) return false;
+    if (idle_thread.joinable()) return true;
+    idle_stop = false;
+    idle_thread = std::thread([this, on_change]() { idle_loop(on_change); });
+    return true;
+  }
 
-  std::string base_url() const {
-    std::string scheme = cfg.tls ? "imaps" : "imap";
-    std::ostringstream ss;
-    ss << scheme << "://" << cfg.host << ":" << cfg.port << "/" << cfg.folder;
-    return ss.str();
+  void set_prescreen(std::function<std::vector<std::string>(const std::vector<std::string>&)> fn) override {
+    prescreen = std::move(fn);
   }
 
-  bool perform_request(const std::string& url,
-                       const std::string& custom_request,
-                       std::string& response,
-                       std::string& err) const {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-      err = "curl init failed";
-      return false;
+  void stop_push() override {
+    idle_stop = true;
+    if (idle_thread.joinable()) idle_thread.join();
+    idle_session.disconnect();
+  }
+
+private:
+  imap_config cfg;
+  mutable imap_session session;
+  imap_session idle_session;
+  std::thread idle_thread;
+  std::atomic<bool> idle_stop{false};
+  std::atomic<bool> idle_running{false};
+  std::function<std::vector<std::string>(const std::vector<std::string>&)> prescreen;
+  std::mutex status_mu;
+  bool status_cached = false;
+  mailbox_status cached_status;
+
+  bool probe(bool refresh, mailbox_status& out, std::string& err) {
+    std::lock_guard<std::mutex> lock(status_mu);
+    if (status_cached && !refresh) {
+      out = cached_status;
+      return true;
     }
-    curl_easy_setopt(curl, CURLOPT_URL,          url.c_str());
-    curl_easy_setopt(curl, CURLOPT_USERNAME,      cfg.username.c_str());
-    curl_easy_setopt(curl, CURLOPT_PASSWORD,      cfg.password.c_str());
-    curl_easy_setopt(curl, CURLOPT_USE_SSL,       cfg.tls ? CURLUSESSL_ALL : CURLUSESSL_NONE);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
-    if (!custom_request.empty())
-      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, custom_request.c_str());
-    char error_buffer[CURL_ERROR_SIZE] = {0};
-    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER,  error_buffer);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL,     1L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA,    &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT,      30L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-      err = error_buffer[0]
-          ? std::string(error_buffer)
-          : std::string(curl_easy_strerror(res));
-      curl_easy_cleanup(curl);
+    std::string items = "UIDNEXT UIDVALIDITY MESSAGES";
+    if (session.stats().condstore) items += " HIGHESTMODSEQ";
+    std::string response;
+    if (!session.command("STATUS " + imap_quote_string(cfg.folder) + " (" + items + ")", response, err))
+      return false;
+
+    mailbox_status st;
+    st.uid_next       = parse_uint64_or_zero(imap_status_value(response, "UIDNEXT"));
+    st.messages       = parse_uint64_or_zero(imap_status_value(response, "MESSAGES"));
+    st.highest_modseq = parse_uint64_or_zero(imap_status_value(response, "HIGHESTMODSEQ"));
+    st.uid_validity   = imap_status_value(response, "UIDVALIDITY");
+    st.ok = !st.uid_validity.empty() || st.uid_next > 0;
+    if (!st.ok) {
+      err = "STATUS response lacks UIDNEXT/UIDVALIDITY";
       return false;
     }
-    curl_easy_cleanup(curl);
+    cached_status = st;
+    status_cached = true;
+    out = st;
     return true;
   }
 
+
+  static void sort_uids(std::vector<std::string>& uids) {
+    std::sort(uids.begin(), uids.end(), [](const std::string& a, const std::string& b) {
+      return parse_uint64_or_zero(a) < parse_uint64_or_zero(b);
+    });
+  }
+
+  std::string search_prefix() const {
+    return imap_has_capability(session.capabilities(), "ESEARCH") ? "UID SEARCH RETURN (ALL) "
+                                                                   : "UID SEARCH ";
+  }
+
+  std::uint64_t last_message_uid(const mailbox_status& st, std::string& err) const {
+    if (st.messages == 0) return 0;
+    std::vector<std::string> uids;
+    if (!fetch_uid_list(search_prefix() + "*", uids, err)) return 0;
+    std::uint64_t max_uid = 0;
+    for (const auto& uid : uids)
+      max_uid = std::max(max_uid, parse_uint64_or_zero(uid));
+    return max_uid;
+  }
+
+  void idle_loop(const std::function<void()>& on_change) {
+    idle_running = true;
+    int backoff_sec = 5;
+    std::cout << "[imap] idle watcher started mailbox=" << cfg.mailbox_id << std::endl;
+    while (!idle_stop) {
+      bool changed = false;
+      std::string err;
+      if (idle_session.idle(std::max(60, cfg.idle_refresh_sec), idle_stop, changed, err)) {
+        backoff_sec = 5;
+        if (changed) {
+          std::cout << "[imap] idle wakeup mailbox=" << cfg.mailbox_id << std::endl;
+          if (on_change) on_change();
+        }
+        continue;
+      }
+      if (idle_session.idle_unsupported()) {
+        std::cout << "[imap] server lacks IDLE mailbox=" << cfg.mailbox_id
+                  << ", polling every " << cfg.poll_interval_sec << "s" << std::endl;
+        idle_session.disconnect();
+        break;
+      }
+      std::cout << "[imap] idle failed mailbox=" << cfg.mailbox_id << " err=" << err
+                << " retry_in=" << backoff_sec << "s" << std::endl;
+      for (int i = 0; i < backoff_sec && !idle_stop; ++i)
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+      backoff_sec = std::min(backoff_sec * 2, 300);
+    }
+    idle_running = false;
+  }
+
   bool fetch_uid_list(const std::string& search_command,
                       std::vector<std::string>& uids,
                       std::string& err) const {
     std::string response;
-    std::string url = base_url();
-    if (!perform_request(url, search_command, response, err)) return false;
-    std::istringstream iss(response);
-    std::string token;
-    while (iss >> token) {
-      if (!token.empty() &&
-          std::all_of(token.begin(), token.end(),
-                      [](unsigned char c) { return std::isdigit(c) != 0; }))
-        uids.push_back(token);
-    }
+    if (!session.command(search_command, response, err)) return false;
+    auto found = imap_parse_search_uids(response);
+    uids.insert(uids.end(), found.begin(), found.end());
     return true;
   }
 
@@ -222,10 +340,7 @@ private:
   bool fetch_message(const std::string& uid, message& msg, std::string& err,
                      std::size_t* raw_size_out = nullptr) const {
     std::string response;
-
-
-    std::string url = base_url() + "/;UID=" + uid;
-    if (!perform_request(url, "", response, err)) return false;
+    if (!session.command("UID FETCH " + uid + " (INTERNALDATE BODY.PEEK[])", response, err)) return false;
 
     if (raw_size_out) *raw_size_out = response.size();
 
@@ -237,15 +352,280 @@ private:
     }
 
 
+    if (response.find('{') == std::string::npos) {
+      err = "message not found (uid=" + uid + ")";
+      return false;
+    }
+
     message_parse_diagnostics diag;
     std::string raw = imap_extract_raw(response, diag);
+    build_message(uid, std::move(raw), diag, msg);
+    if (!msg.received_at) {
+      for (const auto& item : imap_parse_fetch_items(response)) {
+        auto date_it = item.attrs.find("INTERNALDATE");
+        if (date_it != item.attrs.end()) msg.received_at = parse_mail_date(date_it->second);
+      }
+    }
+    return true;
+  }
+
+  // Ingestion paths pass screen=true; listings such as fetch_last_n get
+  // every message, processed or not.
+  void fetch_uids(const std::vector<std::string>& all_uids, mail_fetch_result& result,
+                  bool screen) const {
+    std::vector<std::string> uids = screen && prescreen ? prescreen(all_uids) : all_uids;
+    if (uids.size() < all_uids.size()) {
+      std::set<std::string> wanted(uids.begin(), uids.end());
+      for (const auto& uid : all_uids)
+        if (!wanted.count(uid)) result.skipped_uids.push_back(uid);
+      std::cout << "[mail] prescreen skip count=" << result.skipped_uids.size()
+                << " mailbox=" << cfg.mailbox_id << std::endl;
+    }
+    std::size_t batch = static_cast<std::size_t>(std::max(1, cfg.fetch_batch_size));
+    for (std::size_t i = 0; i < uids.size(); i += batch) {
+      std::vector<std::string> chunk(uids.begin() + i,
+                                     uids.begin() + std::min(uids.size(), i + batch));
+      bool batched = cfg.fetch_mode == "full"
+          ? chunk.size() > 1 && fetch_batch(chunk, result)
+          : fetch_batch_headers_first(chunk, result);
+      if (!batched) {
+        for (const auto& uid : chunk) {
+          std::cout << "[mail] fetch uid=" << uid << " mailbox=" << cfg.mailbox_id << std::endl;
+          message msg;
+          std::string fetch_err;
+          if (fetch_message(uid, msg, fetch_err)) {
+            record_fetched(uid, std::move(msg), result);
+          } else {
+            std::cout << "[mail] fetch failed uid=" << uid << " err=" << fetch_err << std::endl;
+            result.failed_uids.push_back(uid);
+          }
+        }
+      }
+    }
+  }
+
+  bool fetch_batch(const std::vector<std::string>& uids, mail_fetch_result& result) const {
+    std::string uid_set = imap_compress_uid_set(uids);
+    std::cout << "[mail] fetch batch uids=" << uid_set << " count=" << uids.size()
+              << " mailbox=" << cfg.mailbox_id << std::endl;
+
+    std::string response;
+    std::string err;
+    if (!session.command("UID FETCH " + uid_set + " (UID RFC822.SIZE INTERNALDATE BODY.PEEK[])", response, err)) {
+      std::cout << "[mail] fetch batch failed err=" << err << ", falling back to per-uid" << std::endl;
+      return false;
+    }
+
+    std::map<std::string, imap_fetch_item*> by_uid;
+    auto items = imap_parse_fetch_items(response);
+    for (auto& item : items) {
+      auto uid_it = item.attrs.find("UID");
+      if (uid_it != item.attrs.end()) by_uid[uid_it->second] = &item;
+    }
+
+    for (const auto& uid : uids) {
+      auto found = by_uid.find(uid);
+      if (found == by_uid.end() || !found->second->attrs.count("BODY[]")) {
+        std::cout << "[mail] fetch failed uid=" << uid << " err=missing from batch response" << std::endl;
+        result.failed_uids.push_back(uid);
+        continue;
+      }
 
-    std::vector<std::string> headers;
-    std::string body;
-    split_headers_body(raw, headers, body);
-    diag.headers_count = headers.size();
-    diag.body_size     = body.size();
+      imap_fetch_item* item = found->second;
+      std::string& raw = item->attrs.at("BODY[]");
+      auto size_it = item->attrs.find("RFC822.SIZE");
+      std::uint64_t expected = size_it == item->attrs.end() ? 0 : parse_uint64_or_zero(size_it->second);
+      if (expected > raw.size()) {
+        std::cout << "[mail] fetch failed uid=" << uid << " err=truncated literal size="
+                  << raw.size() << " rfc822_size=" << expected << std::endl;
+        result.failed_uids.push_back(uid);
+        continue;
+      }
+
+      message_parse_diagnostics diag;
+      diag.strategy        = "batch_literal";
+      diag.literal_found   = true;
+      diag.literal_size_ok = true;
+      diag.response_size   = raw.size();
+      diag.extracted_size  = raw.size();
+      diag.response_prefix = raw.substr(0, std::min<std::size_t>(300, raw.size()));
+
+      message msg;
+      build_message(uid, std::move(raw), diag, msg);
+      if (!msg.received_at) msg.received_at = internal_date(item->attrs);
+      record_fetched(uid, std::move(msg), result);
+    }
+    return true;
+  }
+
+  bool fetch_batch_headers_first(const std::vector<std::string>& uids,
+                                 mail_fetch_result& result) const {
+    std::string uid_set = imap_compress_uid_set(uids);
+    std::cout << "[mail] fetch headers uids=" << uid_set << " count=" << uids.size()
+              << " mailbox=" << cfg.mailbox_id << std::endl;
+
+    std::string response;
+    std::string err;
+    if (!session.command("UID FETCH " + uid_set +
+                         " (UID RFC822.SIZE INTERNALDATE BODYSTRUCTURE BODY.PEEK[HEADER])", response, err)) {
+      std::cout << "[mail] fetch headers failed err=" << err << ", falling back to full fetch" << std::endl;
+      return false;
+    }
+
+    std::map<std::string, imap_fetch_item> by_uid;
+    for (auto& item : imap_parse_fetch_items(response)) {
+      auto uid_it = item.attrs.find("UID");
+      if (uid_it != item.attrs.end()) by_uid[uid_it->second] = std::move(item);
+    }
+
+    std::map<std::string, message> done;
+    std::set<std::string> need_full;
+    std::map<std::string, std::vector<std::string>> by_sections;
+    std::map<std::string, std::pair<imap_body_part, imap_body_part>> text_parts;
+
+    for (const auto& uid : uids) {
+      auto found = by_uid.find(uid);
+      if (found == by_uid.end() || !found->second.attrs.count("BODY[HEADER]")) continue;
+      const auto& attrs = found->second.attrs;
+
+      message msg;
+      std::vector<std::string> headers;
+      std::string ignored_body;
+      split_headers_body(attrs.at("BODY[HEADER]"), headers, ignored_body);
+      fill_headers(uid, headers, msg);
+      if (!msg.received_at) msg.received_at = internal_date(attrs);
+      msg.parse_strategy = "headers_first";
+
+      auto structure_it = attrs.find("BODYSTRUCTURE");
+      auto parts = structure_it == attrs.end()
+          ? std::vector<imap_body_part>{}
+          : imap_parse_bodystructure(structure_it->second);
+      if (parts.empty()) {
+        need_full.insert(uid);
+        continue;
+      }
+      msg.attachments = imap_attachments_from_parts(parts);
 
+      imap_body_part plain, html;
+      for (const auto& part : parts) {
+        if (part.type != "text" || part.disposition == "attachment") continue;
+        if (part.subtype == "plain" && plain.part_id.empty()) plain = part;
+        if (part.subtype == "html" && html.part_id.empty()) html = part;
+      }
+      std::string sections;
+      if (!plain.part_id.empty()) sections += " BODY.PEEK[" + plain.part_id + "]";
+      if (!html.part_id.empty()) sections += " BODY.PEEK[" + html.part_id + "]";
+
+      text_parts[uid] = {plain, html};
+      if (!sections.empty()) by_sections[sections].push_back(uid);
+      done[uid] = std::move(msg);
+    }
+
+    for (const auto& group : by_sections) {
+      std::string body_response;
+      std::string body_err;
+      if (!session.command("UID FETCH " + imap_compress_uid_set(group.second) +
+                           " (UID" + group.first + ")", body_response, body_err)) {
+        std::cout << "[mail] fetch text parts failed err=" << body_err << std::endl;
+        for (const auto& uid : group.second) {
+          done.erase(uid);
+          need_full.insert(uid);
+        }
+        continue;
+      }
+      std::map<std::string, imap_fetch_item> bodies;
+      for (auto& item : imap_parse_fetch_items(body_response)) {
+        auto uid_it = item.attrs.find("UID");
+        if (uid_it != item.attrs.end()) bodies[uid_it->second] = std::move(item);
+      }
+      for (const auto& uid : group.second) {
+        auto body_it = bodies.find(uid);
+        if (body_it == bodies.end()) {
+          done.erase(uid);
+          need_full.insert(uid);
+          continue;
+        }
+        message& msg = done[uid];
+        const auto& parts = text_parts[uid];
+        auto section = [&](const imap_body_part& part) -> std::string {
+          if (part.part_id.empty()) return "";
+          auto it = body_it->second.attrs.find("BODY[" + part.part_id + "]");
+          return it == body_it->second.attrs.end() ? "" : imap_decode_part(it->second, part.encoding);
+        };
+        msg.body_text = section(parts.first);
+        msg.body_html = section(parts.second);
+      }
+    }
+
+    for (const auto& uid : uids) {
+      auto found = done.find(uid);
+      if (found != done.end()) {
+        message_parse_diagnostics diag;
+        diag.strategy = "headers_first";
+        diag.response_size = response.size();
+        diag.body_size = found->second.body_text.size() + found->second.body_html.size();
+        if (text_parts.count(uid)) finish_message(uid, diag, found->second);
+        record_fetched(uid, std::move(found->second), result);
+      } else if (need_full.count(uid)) {
+        message msg;
+        std::string fetch_err;
+        if (fetch_message(uid, msg, fetch_err)) {
+          record_fetched(uid, std::move(msg), result);
+        } else {
+          std::cout << "[mail] fetch failed uid=" << uid << " err=" << fetch_err << std::endl;
+          result.failed_uids.push_back(uid);
+        }
+      } else {
+        std::cout << "[mail] fetch failed uid=" << uid << " err=missing from header response" << std::endl;
+        result.failed_uids.push_back(uid);
+      }
+    }
+    return true;
+  }
+
+  static std::int64_t internal_date(const std::map<std::string, std::string>& attrs) {
+    auto it = attrs.find("INTERNALDATE");
+    return it == attrs.end() ? 0 : parse_mail_date(it->second);
+  }
+
+  void record_fetched(const std::string& uid, message msg, mail_fetch_result& result) const {
+    result.fetched_uids.push_back(uid);
+    std::cout << "[mail] fetched uid=" << uid
+              << " strategy=" << msg.parse_strategy
+              << " from=" << msg.from
+              << " subject=" << msg.subject
+              << " links=" << msg.links.size()
+              << " parse_suspect=" << msg.parse_suspect << std::endl;
+    if (msg.parse_suspect) {
+      result.parse_failed_uids.push_back(uid);
+    } else {
+      std::uint64_t uid_n = parse_uint64_or_zero(uid);
+      if (uid_n > result.max_seen_uid) result.max_seen_uid = uid_n;
+      result.messages.push_back(std::move(msg));
+    }
+  }
+
+  void build_message(const std::string& uid,
+                     std::string raw,
+                     message_parse_diagnostics& diag,
+                     message& msg) const {
+    mime_tree tree = mime_parse(raw);
+    const mime_part& root = tree.parts.front();
+    diag.headers_count = root.headers.size();
+    diag.body_size     = raw.size() - root.body_offset;
+
+    fill_headers(uid, root.headers, msg);
+    msg.body_text   = mime_part_text(raw, tree, "text/plain");
+    msg.body_html   = mime_part_text(raw, tree, "text/html");
+    msg.attachments = mime_attachments(tree);
+    msg.raw_body_offset = root.body_offset;
+    msg.raw = std::make_shared<const std::string>(std::move(raw));
+
+    msg.parse_strategy = diag.strategy;
+    finish_message(uid, diag, msg);
+  }
+
+  void fill_headers(const std::string& uid, const std::vector<std::string>& headers, message& msg) const {
     msg.mailbox_id  = cfg.mailbox_id;
     msg.provider    = cfg.provider;
     msg.uid         = uid;
@@ -254,20 +634,25 @@ private:
     msg.to          = get_header(headers, "To");
     msg.subject     = decode_mime_header(get_header(headers, "Subject"));
     msg.date_iso    = get_header(headers, "Date");
-    msg.body        = body;
-    msg.body_text   = extract_part_by_content_type(raw, "text/plain");
-    msg.body_html   = extract_part_by_content_type(raw, "text/html");
-    if (msg.body_text.empty())
-      msg.body_text = msg.body_html.empty() ? body : strip_html_tags(msg.body_html);
-    msg.snippet     = snippet_from_body(msg.body_text.empty() ? body : msg.body_text);
-    msg.links       = extract_links(msg.body_text, msg.body_html);
+    msg.received_at = parse_mail_date(msg.date_iso);
     if (msg.message_id.empty()) msg.message_id = uid;
+  }
 
-    msg.attachments = extract_attachment_metadata(raw);
-    for (std::size_t i = 0; i < msg.attachments.size(); ++i)
-      msg.attachments[i].part_id = std::to_string(i + 2);
-
-    msg.parse_strategy = diag.strategy;
+  void finish_message(const std::string& uid,
+                      const message_parse_diagnostics& diag,
+                      message& msg) const {
+    link_collector links;
+    if (msg.body_text.empty() && !msg.body_html.empty()) {
+      html_text_result converted = html_to_text(msg.body_html, &links);
+      msg.body_text = std::move(converted.text);
+      msg.snippet   = std::move(converted.snippet);
+    } else {
+      if (msg.body_text.empty()) msg.body_text = std::string(message_body(msg));
+      msg.snippet = snippet_from_body(message_text(msg));
+      scan_text_links(msg.body_text, links);
+      scan_html_links(msg.body_html, links);
+    }
+    msg.links = std::move(links.links);
 
 
     if (msg.subject.empty() && msg.from.empty() && msg.body_text.empty()) {
@@ -283,24 +668,39 @@ private:
                        0, std::min<std::size_t>(200, diag.response_prefix.size()))
                 << std::endl;
     }
-
-    return true;
   }
 
   std::string fetch_uid_validity() override {
-    std::string response;
+    return probe_status().uid_validity;
+  }
+
+  mailbox_status probe_status() override {
+    mailbox_status st;
     std::string err;
-    std::string url = base_url();
-    if (!perform_request(url, "STATUS " + cfg.folder + " (UIDVALIDITY)", response, err))
-      return "";
-    return parse_uid_validity(response);
+    if (!probe(false, st, err))
+      std::cout << "[mail] status probe failed mailbox=" << cfg.mailbox_id << " err=" << err << std::endl;
+    return st;
+  }
+
+  void begin_cycle() override {
+    std::lock_guard<std::mutex> lock(status_mu);
+    status_cached = false;
   }
 
   void mark_message_seen(const std::string& uid) override {
     std::string ignore_response;
     std::string ignore_err;
-    perform_request(base_url(), "UID STORE " + uid + " +FLAGS (\\Seen)",
-                    ignore_response, ignore_err);
+    session.command("UID STORE " + uid + " +FLAGS.SILENT (\\Seen)", ignore_response, ignore_err);
+  }
+
+  mail_session_stats session_stats() const override {
+    auto stats = session.stats();
+    auto idle_stats = idle_session.stats();
+    stats.push_mode    = idle_running ? "idle" : "polling";
+    stats.idle_waiting = idle_stats.idle_waiting;
+    stats.idle_rounds  = idle_stats.idle_rounds;
+    stats.idle_wakeups = idle_stats.idle_wakeups;
+    return stats;
   }
 };
 
@@ -319,19 +719,20 @@ imap_test_result test_imap_mailbox(const imap_config& cfg) {
     return result;
   }
   mail_client_imap client(cfg);
-  std::vector<std::string> uids;
+  mailbox_status st;
   std::string err;
-  if (!client.fetch_uid_list("UID SEARCH ALL", uids, err)) {
+  if (!client.probe(true, st, err)) {
     result.error = err.empty() ? "imap connection failed" : err;
     return result;
   }
   result.reachable  = true;
   result.auth_ok    = true;
   result.folder_ok  = true;
-  for (const auto& uid : uids)
-    result.max_uid = std::max(result.max_uid, parse_uint64_or_zero(uid));
+  result.uid_next   = st.uid_next;
+  result.messages   = st.messages;
+  result.max_uid    = client.last_message_uid(st, err);
 
-  result.fetch_mode = "uid_url";
+  result.fetch_mode = "session";
 
 
   if (result.max_uid > 0) {
@@ -341,7 +742,7 @@ imap_test_result test_imap_mailbox(const imap_config& cfg) {
     if (!client.fetch_message(std::to_string(result.max_uid), msg, fetch_err, &raw_size)) {
       result.response_size      = static_cast<int>(raw_size);
       result.incomplete_literal = fetch_err.find("incomplete_literal") != std::string::npos;
-      result.error = "UID SEARCH OK but FETCH uid=" + std::to_string(result.max_uid) +
+      result.error = "STATUS OK but FETCH uid=" + std::to_string(result.max_uid) +
                      " failed: " + (fetch_err.empty() ? "unknown" : fetch_err);
     } else {
       result.response_size          = static_cast<int>(raw_size);
@@ -0,0 +1,369 @@
+#include "MimeParse.h"
+#include "ImapParse.h"
+#include "TransferDecode.h"
+#include "../util/CaseFold.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+
+enum class body_encoding { plain, base64, quoted_printable };
+
+std::string trim_copy(const std::string& s) {
+  std::size_t b = 0;
+  while (b < s.size() && std::isspace(static_cast<unsigned char>(s[b]))) b++;
+  std::size_t e = s.size();
+  while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) e--;
+  return s.substr(b, e - b);
+}
+
+bool is_hex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool is_base64_symbol(unsigned char c) {
+  return std::isalnum(c) || c == '+' || c == '/';
+}
+
+
+std::map<std::string, std::string> parse_params(const std::string& value, std::string& head) {
+  std::map<std::string, std::string> params;
+  std::size_t pos = value.find(';');
+  head = ascii_lower(trim_copy(value.substr(0, pos)));
+  while (pos != std::string::npos && pos < value.size()) {
+    ++pos;
+    while (pos < value.size() && (std::isspace(static_cast<unsigned char>(value[pos])) || value[pos] == ';'))
+      ++pos;
+    std::size_t eq = value.find('=', pos);
+    std::size_t semi = value.find(';', pos);
+    if (eq == std::string::npos || (semi != std::string::npos && semi < eq)) {
+      pos = semi;
+      continue;
+    }
+    std::string name = ascii_lower(trim_copy(value.substr(pos, eq - pos)));
+    pos = eq + 1;
+    while (pos < value.size() && std::isspace(static_cast<unsigned char>(value[pos]))) ++pos;
+    std::string v;
+    if (pos < value.size() && value[pos] == '"') {
+      for (++pos; pos < value.size() && value[pos] != '"'; ++pos) {
+        if (value[pos] == '\\' && pos + 1 < value.size()) ++pos;
+        v.push_back(value[pos]);
+      }
+      pos = value.find(';', pos);
+    } else {
+      semi = value.find(';', pos);
+      v = trim_copy(value.substr(pos, semi == std::string::npos ? std::string::npos : semi - pos));
+      pos = semi;
+    }
+    if (!name.empty()) params[name] = v;
+  }
+  return params;
+}
+
+std::string percent_decode(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '%' && i + 2 < s.size() && is_hex(s[i + 1]) && is_hex(s[i + 2])) {
+      out.push_back(static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16)));
+      i += 2;
+    } else {
+      out.push_back(s[i]);
+    }
+  }
+  return out;
+}
+
+std::string strip_charset_prefix(const std::string& s) {
+  std::size_t first = s.find('\'');
+  if (first == std::string::npos) return s;
+  std::size_t second = s.find('\'', first + 1);
+  return second == std::string::npos ? s : s.substr(second + 1);
+}
+
+
+std::string param_value(const std::map<std::string, std::string>& params, const std::string& name) {
+  auto it = params.find(name);
+  if (it != params.end()) return it->second;
+  it = params.find(name + "*");
+  if (it != params.end()) return percent_decode(strip_charset_prefix(it->second));
+
+  std::string out;
+  for (int i = 0;; ++i) {
+    std::string key = name + "*" + std::to_string(i);
+    auto plain = params.find(key);
+    auto ext = params.find(key + "*");
+    if (ext != params.end()) {
+      out += percent_decode(i == 0 ? strip_charset_prefix(ext->second) : ext->second);
+    } else if (plain != params.end()) {
+      out += plain->second;
+    } else {
+      break;
+    }
+  }
+  return out;
+}
+
+std::string header_value(const std::vector<std::string>& headers, const std::string& name) {
+  for (const auto& h : headers) {
+    if (h.size() <= name.size() || h[name.size()] != ':') continue;
+    bool same = std::equal(name.begin(), name.end(), h.begin(), [](char a, char b) {
+      return ascii_lower(a) == ascii_lower(b);
+    });
+    if (same) return trim_copy(h.substr(name.size() + 1));
+  }
+  return "";
+}
+
+void finish_headers(mime_part& part) {
+  std::string head;
+  auto type_params = parse_params(header_value(part.headers, "Content-Type"), head);
+  part.content_type = head.empty() ? "text/plain" : head;
+  part.charset  = ascii_lower(param_value(type_params, "charset"));
+  part.boundary = param_value(type_params, "boundary");
+  part.encoding = ascii_lower(header_value(part.headers, "Content-Transfer-Encoding"));
+
+  auto disp_params = parse_params(header_value(part.headers, "Content-Disposition"), head);
+  part.disposition = head;
+  std::string filename = param_value(disp_params, "filename");
+  if (filename.empty()) filename = param_value(type_params, "name");
+  part.filename = decode_mime_header(filename);
+
+  part.content_id = header_value(part.headers, "Content-ID");
+  if (!part.content_id.empty() && part.content_id.front() == '<') part.content_id.erase(0, 1);
+  if (!part.content_id.empty() && part.content_id.back() == '>') part.content_id.pop_back();
+}
+
+bool is_multipart(const mime_part& part) {
+  return part.content_type.rfind("multipart/", 0) == 0 && !part.boundary.empty();
+}
+
+
+struct leaf_state {
+  int index = -1;
+  body_encoding encoding = body_encoding::plain;
+  bool has_line = false;
+  std::size_t pending_terminator = 0;
+  bool pending_soft_break = false;
+  bool base64_done = false;
+  std::size_t base64_symbols = 0;
+};
+
+void account_line(leaf_state& leaf, mime_part& part, const char* line, std::size_t len,
+                  std::size_t terminator) {
+  if (leaf.has_line && leaf.encoding != body_encoding::base64 && !leaf.pending_soft_break)
+    part.decoded_size += leaf.pending_terminator;
+  leaf.has_line = true;
+  leaf.pending_terminator = terminator;
+  leaf.pending_soft_break = false;
+
+  switch (leaf.encoding) {
+    case body_encoding::plain:
+      part.decoded_size += len;
+      break;
+    case body_encoding::base64:
+      for (std::size_t i = 0; i < len && !leaf.base64_done; ++i) {
+        unsigned char c = static_cast<unsigned char>(line[i]);
+        if (c == '=') leaf.base64_done = true;
+        else if (is_base64_symbol(c)) ++leaf.base64_symbols;
+      }
+      break;
+    case body_encoding::quoted_printable:
+      for (std::size_t i = 0; i < len; ++i) {
+        if (line[i] == '=') {
+          if (i + 2 < len && is_hex(line[i + 1]) && is_hex(line[i + 2])) {
+            i += 2;
+          } else if (i + 1 == len && terminator > 0) {
+            leaf.pending_soft_break = true;
+            continue;
+          }
+        }
+        ++part.decoded_size;
+      }
+      break;
+  }
+}
+
+void close_leaf(leaf_state& leaf, mime_part& part, bool at_eof) {
+  if (leaf.index < 0) return;
+  if (leaf.encoding == body_encoding::base64) {
+    part.decoded_size = leaf.base64_symbols * 6 / 8;
+  } else if (leaf.pending_soft_break) {
+    if (!at_eof) part.decoded_size += 1;
+    else if (leaf.pending_terminator != 2) part.decoded_size += 1 + leaf.pending_terminator;
+  } else if (at_eof && leaf.has_line) {
+    part.decoded_size += leaf.pending_terminator;
+  }
+  leaf = leaf_state{};
+}
+
+body_encoding encoding_kind(const std::string& encoding) {
+  if (encoding == "base64") return body_encoding::base64;
+  if (encoding == "quoted-printable") return body_encoding::quoted_printable;
+  return body_encoding::plain;
+}
+
+}
+
+mime_tree mime_parse(const std::string& raw) {
+  mime_tree tree;
+  tree.parts.emplace_back();
+
+  struct open_container {
+    int index;
+    int children;
+  };
+  std::vector<open_container> stack;
+  leaf_state leaf;
+  int current = 0;
+  bool in_headers = true;
+  bool prev_terminated = false;
+
+  std::size_t pos = 0;
+  while (pos < raw.size()) {
+    std::size_t nl = raw.find('\n', pos);
+    std::size_t line_end = nl == std::string::npos ? raw.size() : nl;
+    std::size_t content_end = line_end > pos && raw[line_end - 1] == '\r' ? line_end - 1 : line_end;
+    std::size_t next = nl == std::string::npos ? raw.size() : nl + 1;
+    std::size_t len = content_end - pos;
+    const char* line = raw.data() + pos;
+
+    if (!stack.empty() && len >= 2 && line[0] == '-' && line[1] == '-') {
+      int level = -1;
+      bool closing = false;
+      for (int k = static_cast<int>(stack.size()) - 1; k >= 0 && level < 0; --k) {
+        const std::string& b = tree.parts[stack[k].index].boundary;
+        if (len < 2 + b.size() || raw.compare(pos + 2, b.size(), b) != 0) continue;
+        std::size_t rest = pos + 2 + b.size();
+        bool close = content_end - rest >= 2 && raw[rest] == '-' && raw[rest + 1] == '-';
+        if (close) rest += 2;
+        while (rest < content_end && std::isspace(static_cast<unsigned char>(raw[rest]))) ++rest;
+        if (rest != content_end) continue;
+        level = k;
+        closing = close;
+      }
+      if (level >= 0) {
+        if (leaf.index >= 0) close_leaf(leaf, tree.parts[leaf.index], false);
+        if (in_headers && current >= 0) {
+          tree.parts[current].body_offset = tree.parts[current].body_end = pos;
+          finish_headers(tree.parts[current]);
+        }
+        stack.resize(static_cast<std::size_t>(level) + 1);
+        open_container& container = stack.back();
+        if (closing) {
+          tree.parts[container.index].body_end = pos;
+          stack.pop_back();
+          current = -1;
+          in_headers = false;
+        } else {
+          mime_part part;
+          const std::string& prefix = tree.parts[container.index].part_id;
+          part.part_id = (prefix.empty() ? "" : prefix + ".") + std::to_string(++container.children);
+          part.parent = container.index;
+          part.header_offset = next;
+          tree.parts.push_back(std::move(part));
+          current = static_cast<int>(tree.parts.size()) - 1;
+          tree.parts[container.index].children.push_back(current);
+          in_headers = true;
+        }
+        pos = next;
+        prev_terminated = nl != std::string::npos;
+        continue;
+      }
+    }
+
+    if (in_headers && current >= 0) {
+      mime_part& part = tree.parts[current];
+      if (len == 0) {
+        in_headers = false;
+        part.body_offset = part.body_end = next;
+        finish_headers(part);
+        if (is_multipart(part)) {
+          stack.push_back({current, 0});
+        } else {
+          if (current == 0) part.part_id = "1";
+          leaf.index = current;
+          leaf.encoding = encoding_kind(part.encoding);
+        }
+      } else if ((line[0] == ' ' || line[0] == '\t') && !part.headers.empty()) {
+        part.headers.back() += " " + trim_copy(std::string(line, len));
+      } else {
+        part.headers.emplace_back(line, len);
+      }
+    } else if (leaf.index >= 0) {
+      mime_part& part = tree.parts[leaf.index];
+      account_line(leaf, part, line, len, next - content_end);
+      part.body_end = content_end;
+    }
+    pos = next;
+    prev_terminated = nl != std::string::npos;
+  }
+
+  if (in_headers && current >= 0) {
+    mime_part& part = tree.parts[current];
+    part.body_offset = part.body_end = raw.size();
+    finish_headers(part);
+    if (current == 0 && !is_multipart(part)) part.part_id = "1";
+  }
+  if (leaf.index >= 0) {
+    mime_part& part = tree.parts[leaf.index];
+    if (prev_terminated && leaf.has_line) part.body_end = raw.size();
+    close_leaf(leaf, part, prev_terminated);
+  }
+  for (const auto& open : stack) tree.parts[open.index].body_end = raw.size();
+  return tree;
+}
+
+std::string mime_decode_part(const std::string& raw, const mime_part& part) {
+  if (part.body_end <= part.body_offset || part.body_offset >= raw.size()) return "";
+  std::string_view body(raw.data() + part.body_offset,
+                        std::min(part.body_end, raw.size()) - part.body_offset);
+  if (part.encoding == "base64") return base64_decode(body);
+  if (part.encoding == "quoted-printable") return quoted_printable_decode(body, false);
+  return std::string(body);
+}
+
+const mime_part* mime_find_text_part(const mime_tree& tree, const std::string& content_type) {
+  for (const auto& part : tree.parts) {
+    if (!part.children.empty() || part.disposition == "attachment") continue;
+    if (part.content_type == content_type) return &part;
+  }
+  return nullptr;
+}
+
+std::string mime_part_text(const std::string& raw,
+                           const mime_tree& tree,
+                           const std::string& content_type) {
+  const mime_part* part = mime_find_text_part(tree, content_type);
+  return part ? trim_copy(mime_decode_part(raw, *part)) : "";
+}
+
+std::vector<attachment> mime_attachments(const mime_tree& tree) {
+  std::vector<attachment> result;
+  for (const auto& part : tree.parts) {
+    if (is_multipart(part)) continue;
+    bool is_body_text = part.content_type == "text/plain" || part.content_type == "text/html";
+    bool is_att = part.disposition == "attachment" ||
+                  (part.disposition == "inline" && !part.filename.empty()) ||
+                  (part.disposition.empty() && !is_body_text);
+    if (!is_att) continue;
+
+    attachment att;
+    att.filename    = part.filename;
+    att.mime_type   = part.content_type;
+    att.part_id     = part.part_id;
+    att.disposition = part.disposition.empty() ? "attachment" : part.disposition;
+    att.size_bytes  = part.decoded_size;
+    att.content_id  = part.content_id;
+    if (att.mime_type.rfind("image/", 0) == 0 || att.mime_type == "application/pdf")
+      att.safe_to_preview = true;
+    result.push_back(std::move(att));
+  }
+  return result;
+}
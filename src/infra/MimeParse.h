@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../domain/Message.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+struct mime_part {
+  std::string part_id;
+  std::string content_type;
+  std::string charset;
+  std::string boundary;
+  std::string encoding;
+  std::string disposition;
+  std::string filename;
+  std::string content_id;
+  std::vector<std::string> headers;
+  int parent = -1;
+  std::vector<int> children;
+  std::size_t header_offset = 0;
+  std::size_t body_offset   = 0;
+  std::size_t body_end      = 0;
+  std::size_t decoded_size  = 0;
+};
+
+struct mime_tree {
+  std::vector<mime_part> parts;
+};
+
+
+mime_tree mime_parse(const std::string& raw);
+
+std::string mime_decode_part(const std::string& raw, const mime_part& part);
+
+const mime_part* mime_find_text_part(const mime_tree& tree, const std::string& content_type);
+
+std::string mime_part_text(const std::string& raw,
+                           const mime_tree& tree,
+                           const std::string& content_type);
+
+std::vector<attachment> mime_attachments(const mime_tree& tree);
@@ -1,62 +1,114 @@
 #include "LlmClient.h"
 
 #include "../app/FormUnderstandingEngine.h"
+#include "../domain/AhoCorasick.h"
+#include "../util/CaseFold.h"
 
 #include <algorithm>
-#include <cctype>
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace {
 
 
-std::string utf8_lower(const std::string& input) {
-  std::string out;
-  out.reserve(input.size());
-  for (size_t i = 0; i < input.size(); ) {
-    unsigned char c = static_cast<unsigned char>(input[i]);
-    if (c < 0x80) {
-      out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-      ++i;
-    } else if (c == 0xD0 && i + 1 < input.size()) {
-      unsigned char c2 = static_cast<unsigned char>(input[i + 1]);
-      if (c2 == 0x81) {
+enum keyword_group : std::uint32_t {
+  kw_auth         = 1u << 0,
+  kw_confirmation = 1u << 1,
+  kw_academic     = 1u << 2,
+  kw_form         = 1u << 3,
+  kw_urgency      = 1u << 4,
+};
 
-        out += '\xD1'; out += '\x91';
-      } else if (c2 >= 0x90 && c2 <= 0x9F) {
+struct default_keyword_group {
+  const char* name;
+  keyword_group group;
+  std::vector<const char*> terms;
+};
 
-        out += '\xD0'; out += static_cast<char>(c2 + 0x20);
-      } else if (c2 >= 0xA0 && c2 <= 0xAF) {
+// Config "llm.keyword_groups.<name>" replaces the built-in terms of a group.
+const default_keyword_group k_keyword_groups[] = {
+  {"auth", kw_auth, {
+      "подтвердите вход", "confirm your login", "two-factor",
+      "2fa", "код подтверждения", "authentication code",
+      "verify your", "подтверждение входа"}},
+  {"confirmation", kw_confirmation, {
+      "ответы записаны", "ваш ответ получен", "ответ отправлен",
+      "answers recorded", "response submitted", "your response",
+      "thank you for", "спасибо за ответ", "/admin/", "/answers/"}},
+  {"academic", kw_academic, {
+      "учебн", "задолженн", "отчисл", "пересдач", "приказ",
+      "зачёт", "зачет", "экзамен", "оцениван", "задание",
+      "уведомлен", "напоминан", "требуется", "документ",
+      "lms", "smartlms", "edu", "university", "академическ"}},
+  {"form", kw_form, {
+      "опрос", "анкета", "форма", "регистрация", "заполните",
+      "survey", "form", "questionnaire", "fill out", "fill in"}},
+  {"urgency", kw_urgency, {
+      "важно", "срочно", "дедлайн", "deadline", "important", "urgent",
+      "asap", "немедленно", "как можно скорее"}},
+};
 
-        out += '\xD1'; out += static_cast<char>(c2 - 0x20);
+// All keyword groups compiled into one automaton over case-folded UTF-8, so
+// a message is folded once and scanned once regardless of the term count.
+class keyword_index {
+public:
+  explicit keyword_index(const std::map<std::string, std::vector<std::string>>& overrides) {
+    std::string folded;
+    auto add = [&](std::string_view term, keyword_group group) {
+      folded.clear();
+      case_fold_append(folded, term);
+      if (folded.empty()) return;
+      automaton.add(folded, static_cast<std::uint32_t>(group_of.size()));
+      group_of.push_back(group);
+    };
+    for (const auto& g : k_keyword_groups) {
+      auto it = overrides.find(g.name);
+      if (it != overrides.end()) {
+        for (const auto& term : it->second) add(term, g.group);
       } else {
-        out += static_cast<char>(c); out += static_cast<char>(c2);
+        for (const char* term : g.terms) add(term, g.group);
       }
-      i += 2;
-    } else {
-
-      size_t len = 1;
-      if ((c & 0xE0) == 0xC0) len = 2;
-      else if ((c & 0xF0) == 0xE0) len = 3;
-      else if ((c & 0xF8) == 0xF0) len = 4;
-      for (size_t j = 0; j < len && i + j < input.size(); ++j)
-        out += input[i + j];
-      i += len;
     }
+    automaton.build();
   }
-  return out;
-}
 
-bool contains_any(const std::string& text,
-                  const std::initializer_list<const char*>& needles) {
-  std::string lower = utf8_lower(text);
-  for (const char* needle : needles) {
-    if (lower.find(needle) != std::string::npos) return true;
+  std::uint32_t classify(const message& msg) const {
+    static thread_local std::string hay;
+    std::string_view body = message_body(msg);
+    hay.clear();
+    hay.reserve(msg.subject.size() + msg.snippet.size() + msg.body_text.size() + body.size() + 3);
+    case_fold_append(hay, msg.subject);
+    hay += '\n';
+    case_fold_append(hay, msg.snippet);
+    hay += '\n';
+    case_fold_append(hay, msg.body_text);
+    hay += '\n';
+    case_fold_append(hay, body);
+
+    std::uint32_t groups = 0;
+    automaton.scan(hay, [&](std::uint32_t id, std::size_t) { groups |= group_of[id]; });
+    return groups;
   }
-  return false;
+
+private:
+  aho_corasick automaton;
+  std::vector<std::uint32_t> group_of;
+};
+
+std::shared_ptr<const keyword_index> default_keyword_index() {
+  static const auto index = std::make_shared<const keyword_index>(
+      std::map<std::string, std::vector<std::string>>{});
+  return index;
 }
 
 class noop_llm_client final : public llm_client {
 public:
+  explicit noop_llm_client(std::shared_ptr<const keyword_index> keywords) : keywords(std::move(keywords)) {}
+
   email_analysis analyze_email(const message& msg) override {
     email_analysis result;
     result.summary  = msg.subject.empty() ? msg.snippet : msg.subject;
@@ -68,12 +120,9 @@ public:
     result.contains_links       = !msg.links.empty();
     result.contains_attachments = !msg.attachments.empty();
 
-    std::string hay = msg.subject + "\n" + msg.snippet + "\n" + msg.body_text + "\n" + msg.body;
-
+    const std::uint32_t groups = keywords->classify(msg);
 
-    if (contains_any(hay, {"подтвердите вход", "confirm your login", "two-factor",
-                            "2fa", "код подтверждения", "authentication code",
-                            "verify your", "подтверждение входа"})) {
+    if (groups & kw_auth) {
       result.kind               = message_kind::auth_required;
       result.level              = importance_level::high;
       result.category           = email_category::security;
@@ -87,17 +136,10 @@ public:
     }
 
 
-    bool is_confirmation = contains_any(hay, {
-        "ответы записаны", "ваш ответ получен", "ответ отправлен",
-        "answers recorded", "response submitted", "your response",
-        "thank you for", "спасибо за ответ", "/admin/", "/answers/"});
+    bool is_confirmation = (groups & kw_confirmation) != 0;
 
 
-    if (contains_any(hay, {
-            "учебн", "задолженн", "отчисл", "пересдач", "приказ",
-            "зачёт", "зачет", "экзамен", "оцениван", "задание",
-            "уведомлен", "напоминан", "требуется", "документ",
-            "lms", "smartlms", "edu", "university", "академическ"})) {
+    if (groups & kw_academic) {
       result.kind               = message_kind::important_notification;
       result.level              = importance_level::high;
       result.category           = email_category::academic;
@@ -112,9 +154,7 @@ public:
 
 
     if (!is_confirmation) {
-      bool has_form_kw = contains_any(hay, {
-          "опрос", "анкета", "форма", "регистрация", "заполните",
-          "survey", "form", "questionnaire", "fill out", "fill in"});
+      bool has_form_kw = (groups & kw_form) != 0;
       if (has_form_kw || !result.form_links.empty()) {
         if (result.form_links.empty() && !msg.links.empty()) {
           auto best = std::max_element(msg.links.begin(), msg.links.end(),
@@ -137,9 +177,7 @@ public:
     }
 
 
-    if (contains_any(hay, {
-            "важно", "срочно", "дедлайн", "deadline", "important", "urgent",
-            "asap", "немедленно", "как можно скорее"})) {
+    if (groups & kw_urgency) {
       result.kind               = message_kind::important_notification;
       result.level              = importance_level::medium;
       result.category           = email_category::other;
@@ -164,10 +202,18 @@ public:
                                      const user_profile& profile) override {
     return understand_form_fields_rule_based(msg, form, profile);
   }
+
+private:
+  std::shared_ptr<const keyword_index> keywords;
 };
 
 }
 
 std::unique_ptr<llm_client> make_noop_llm_client() {
-  return std::make_unique<noop_llm_client>();
+  return std::make_unique<noop_llm_client>(default_keyword_index());
+}
+
+std::unique_ptr<llm_client> make_noop_llm_client(const llm_config& cfg) {
+  if (cfg.keyword_groups.empty()) return make_noop_llm_client();
+  return std::make_unique<noop_llm_client>(std::make_shared<const keyword_index>(cfg.keyword_groups));
 }
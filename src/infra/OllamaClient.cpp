@@ -183,7 +183,7 @@ bool curl_post_chat(const llm_config& cfg,
 
 class ollama_client final : public llm_client {
 public:
-  explicit ollama_client(llm_config cfg) : cfg(std::move(cfg)), fallback(make_noop_llm_client()) {}
+  explicit ollama_client(llm_config cfg) : cfg(std::move(cfg)), fallback(make_noop_llm_client(this->cfg)) {}
 
   static int level_rank(importance_level level) {
     switch (level) {
@@ -449,8 +449,9 @@ private:
     for (const auto& att : msg.attachments) {
       attachments.push_back({{"filename", att.filename}, {"mime_type", att.mime_type}});
     }
-    std::string body_excerpt = msg.body_text.empty() ? msg.body : msg.body_text;
-    if (body_excerpt.size() > 6000) body_excerpt = body_excerpt.substr(0, 6000) + "…";
+    std::string_view body_view = message_text(msg);
+    std::string body_excerpt(body_view.substr(0, 6000));
+    if (body_view.size() > 6000) body_excerpt += "…";
 
     std::ostringstream prompt;
     prompt <<
@@ -1,14 +1,26 @@
 #include "Storage.h"
+#include "EventRing.h"
+#include "../util/MailDate.h"
 
 #include <sqlite3.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <forward_list>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 using nlohmann::json;
@@ -28,6 +40,14 @@ static std::string now_iso() {
   return buf;
 }
 
+// Emails whose Date header does not parse sort by when they were stored.
+static std::int64_t received_epoch(const std::string& date_header, const std::string& created_at) {
+  if (std::int64_t parsed = parse_mail_date(date_header)) return parsed;
+  if (std::int64_t stored = parse_mail_date(created_at)) return stored;
+  return std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 static json form_fields_to_json(const std::vector<form_field>& fields) {
   json arr = json::array();
   for (const auto& field : fields) {
@@ -160,15 +180,154 @@ static std::string random_id(const std::string& prefix) {
   return ss.str();
 }
 
+// Prepared statements of one connection keyed by SQL text. finish() resets a
+// statement and parks it here instead of finalizing it, so each query is
+// compiled once per connection. Guarded by the owning connection's mutex.
+class statement_cache {
+public:
+  ~statement_cache() { clear(); }
+
+  sqlite3_stmt* take(sqlite3* db, const char* sql) {
+    auto it = idle.find(std::string_view(sql));
+    if (it != idle.end() && !it->second.empty()) {
+      sqlite3_stmt* stmt = it->second.back();
+      it->second.pop_back();
+      return stmt;
+    }
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+      sqlite3_finalize(stmt);
+      return nullptr;
+    }
+    return stmt;
+  }
+
+  void put_back(sqlite3_stmt* stmt) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    std::string_view sql = sqlite3_sql(stmt);
+    auto it = idle.find(sql);
+    if (it == idle.end()) {
+      if (idle.size() >= k_max_queries) {
+        sqlite3_finalize(stmt);
+        return;
+      }
+      texts.emplace_front(sql);
+      it = idle.emplace(std::string_view(texts.front()), std::vector<sqlite3_stmt*>{}).first;
+    }
+    if (it->second.size() >= k_max_per_query) {
+      sqlite3_finalize(stmt);
+      return;
+    }
+    it->second.push_back(stmt);
+  }
+
+  void clear() {
+    for (auto& entry : idle)
+      for (sqlite3_stmt* stmt : entry.second) sqlite3_finalize(stmt);
+    idle.clear();
+    texts.clear();
+  }
+
+private:
+  static constexpr std::size_t k_max_queries = 256;
+  static constexpr std::size_t k_max_per_query = 4;
+
+  std::forward_list<std::string> texts;
+  std::unordered_map<std::string_view, std::vector<sqlite3_stmt*>> idle;
+};
+
+struct sqlite_connection {
+  sqlite3* db = nullptr;
+  std::mutex mu;
+  statement_cache statements;
+};
+
+// Each connection keeps its own page cache; the 2 MB default is smaller
+// than the list/search working set once the mailbox grows.
+static void tune_connection(sqlite3* handle) {
+  sqlite3_busy_timeout(handle, 5000);
+  sqlite3_exec(handle, "PRAGMA cache_size=-16000;", nullptr, nullptr, nullptr);
+}
+
+static bool is_memory_path(const std::string& path) {
+  return path.empty() || path == ":memory:" || path.rfind("file::memory:", 0) == 0 ||
+         path.find("mode=memory") != std::string::npos;
+}
+
+// unicode61 folds case for Cyrillic as well as Latin and strips Latin
+// accents; the prefix indexes keep type-ahead queries off a scan. Rows are
+// tied to email_message through email_id (its rowid is not stable, VACUUM
+// may renumber it); email_message.fts_rowid points back for updates.
+static const char* k_email_fts_ddl =
+  "CREATE VIRTUAL TABLE IF NOT EXISTS email_fts USING fts5("
+  " subject, sender, snippet, body, link_domains, attachment_names, email_id UNINDEXED,"
+  " tokenize='unicode61 remove_diacritics 2', prefix='2 3');";
+
+// The index row is always built from the stored email_message row, so the
+// upsert's keep-old-body rules and the backfill produce the same document.
+// unicode61 has no Cyrillic diacritics, so "ё" is spelled "е" on both the
+// index and the query side.
+static const char* k_email_fts_columns = "subject,sender,snippet,body,link_domains,attachment_names,email_id";
+static const char* k_email_fts_document =
+  " replace(replace(subject,'ё','е'),'Ё','Е'),from_addr,"
+  " replace(replace(snippet,'ё','е'),'Ё','Е'),"
+  " replace(replace(body_text,'ё','е'),'Ё','Е'),"
+  " (SELECT group_concat(json_extract(value,'$.domain'),' ') FROM json_each("
+  "   CASE WHEN json_valid(links_json) THEN links_json ELSE '[]' END)),"
+  " (SELECT group_concat(json_extract(value,'$.filename'),' ') FROM json_each("
+  "   CASE WHEN json_valid(attachments_json) THEN attachments_json ELSE '[]' END)),"
+  " id "
+  "FROM email_message";
+
+static const std::string k_email_fts_insert =
+  std::string("INSERT INTO email_fts(") + k_email_fts_columns + ") SELECT" + k_email_fts_document;
+// The backfill reuses the current rowids so fts_rowid is set in one pass.
+static const std::string k_email_fts_backfill =
+  std::string("INSERT INTO email_fts(rowid,") + k_email_fts_columns + ") SELECT rowid," + k_email_fts_document +
+  ";UPDATE email_message SET fts_rowid=rowid;";
+
+// Turns free text into an FTS5 expression: every word becomes a quoted
+// prefix term and the terms are AND-ed, so operators typed by the user are
+// never interpreted and partially typed words still match.
+static std::string fts_match_expression(const std::string& query) {
+  auto is_word = [&](std::size_t at) {
+    unsigned char c = static_cast<unsigned char>(query[at]);
+    return c >= 0x80 || std::isalnum(c);
+  };
+  std::string expr;
+  std::size_t i = 0;
+  while (i < query.size()) {
+    if (!is_word(i)) {
+      ++i;
+      continue;
+    }
+    if (!expr.empty()) expr += ' ';
+    expr += '"';
+    for (; i < query.size() && is_word(i); ++i) {
+      if (query.compare(i, 2, "ё") == 0 || query.compare(i, 2, "Ё") == 0) {
+        expr += query[++i] == '\x91' ? "е" : "Е";
+        continue;
+      }
+      expr += query[i];
+    }
+    expr += "\"*";
+  }
+  return expr;
+}
+
 class sqlite_storage final : public storage {
 public:
-  explicit sqlite_storage(const std::string& path, std::string& err) {
+  sqlite_storage(const std::string& path, int read_connections, int event_limit, std::string& err)
+      : events_limit(event_limit > 0 ? event_limit : 200) {
     if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
       err = "sqlite open failed: " + std::string(sqlite3_errmsg(db));
       sqlite3_close(db);
       db = nullptr;
       return;
     }
+    tune_connection(db);
+    bool wal = !is_memory_path(path) && enable_wal();
 
     const char* ddl_processed =
       "CREATE TABLE IF NOT EXISTS processed ("
@@ -195,7 +354,9 @@ public:
       " uid_validity TEXT,"
       " last_seen_uid INTEGER NOT NULL DEFAULT 0,"
       " started_at TEXT NOT NULL,"
-      " updated_at TEXT NOT NULL"
+      " updated_at TEXT NOT NULL,"
+      " highest_modseq INTEGER NOT NULL DEFAULT 0,"
+      " backfill_until_uid INTEGER NOT NULL DEFAULT 0"
       ");";
 
     const char* ddl_processed_message =
@@ -287,6 +448,9 @@ public:
       " muted_until TEXT,"
       " created_at TEXT NOT NULL,"
       " updated_at TEXT NOT NULL,"
+      " received_at INTEGER NOT NULL DEFAULT 0,"
+      " server_seen INTEGER NOT NULL DEFAULT 0,"
+      " fts_rowid INTEGER,"
       " UNIQUE(mailbox_id, uid)"
       ");";
 
@@ -309,6 +473,19 @@ public:
       " created_at TEXT NOT NULL"
       ");";
 
+    // One index per list view, ordered like the keyset cursor and carrying
+    // muted_until so the mute filter is decided before any row is read.
+    const char* ddl_email_list_indexes =
+      "CREATE INDEX IF NOT EXISTS idx_email_active ON email_message(received_at,id,muted_until) "
+      " WHERE archived_at IS NULL;"
+      "CREATE INDEX IF NOT EXISTS idx_email_unread ON email_message(received_at,id,muted_until) "
+      " WHERE read_at IS NULL AND archived_at IS NULL;"
+      "CREATE INDEX IF NOT EXISTS idx_email_important ON email_message(received_at,id,muted_until,read_at) "
+      " WHERE importance_level IN ('critical','high') AND archived_at IS NULL;"
+      "CREATE INDEX IF NOT EXISTS idx_email_archived ON email_message(received_at,id) "
+      " WHERE archived_at IS NOT NULL;"
+      "CREATE INDEX IF NOT EXISTS idx_email_mailbox ON email_message(mailbox_id,archived_at,received_at,id,muted_until);";
+
     const char* ddl_telegram_callback_token =
       "CREATE TABLE IF NOT EXISTS telegram_callback_token ("
       " token TEXT PRIMARY KEY,"
@@ -348,37 +525,101 @@ public:
       }
     }
     ensure_active_form_session_columns();
+    ensure_mailbox_checkpoint_columns();
+    ensure_email_message_columns();
+    if (sqlite3_exec(db, ddl_email_list_indexes, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+      err = "sqlite ddl failed: " + std::string(err_msg ? err_msg : "");
+      sqlite3_free(err_msg);
+      return;
+    }
+    ensure_email_fts();
+
+    if (wal) open_readers(path, read_connections);
+    events.restore(query_events(static_cast<int>(events.capacity()), 0));
+    persisted_id = events.newest_id();
+    event_writer = std::thread([this]() { run_event_writer(); });
   }
 
   ~sqlite_storage() override {
+    if (event_writer.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(pending_mu);
+        stopping = true;
+      }
+      pending_cv.notify_one();
+      event_writer.join();
+    }
+    for (auto& r : readers) {
+      r->statements.clear();
+      sqlite3_close(r->db);
+    }
+    writer_statements.clear();
     if (db) sqlite3_close(db);
   }
 
   bool is_processed(const std::string& mailbox_id, const std::string& uid) override {
-    std::lock_guard<std::mutex> lock(mu);
+    {
+      std::lock_guard<std::mutex> guard(deferred_mu);
+      auto it = deferred.find(std::this_thread::get_id());
+      if (it != deferred.end()) {
+        for (const auto& [msg, status] : it->second.processed) {
+          std::string queued_mailbox = msg.mailbox_id.empty() ? "default" : msg.mailbox_id;
+          if (msg.uid == uid && queued_mailbox == mailbox_id) return true;
+        }
+      }
+    }
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return false;
     const char* sql =
-      "SELECT 1 FROM processed_message "
-      "WHERE mailbox_id = ? AND message_uid = ? LIMIT 1;";
+      "SELECT EXISTS(SELECT 1 FROM processed_message WHERE mailbox_id = ?1 AND message_uid = ?2)"
+      " OR EXISTS(SELECT 1 FROM processed WHERE uid = ?2);";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    if (!prepare(db, sql, &stmt)) return false;
     sqlite3_bind_text(stmt, 1, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, uid.c_str(), -1, SQLITE_TRANSIENT);
-    int rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (rc == SQLITE_ROW) return true;
+    bool processed = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 0;
+    finish(stmt);
+    return processed;
+  }
 
-    const char* legacy_sql = "SELECT 1 FROM processed WHERE uid = ? LIMIT 1;";
-    stmt = nullptr;
-    if (sqlite3_prepare_v2(db, legacy_sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
-    sqlite3_bind_text(stmt, 1, uid.c_str(), -1, SQLITE_TRANSIENT);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_ROW;
+  std::vector<std::string> filter_unprocessed(const std::string& mailbox_id,
+                                              const std::vector<std::string>& uids) override {
+    if (uids.empty()) return {};
+    auto lease = reader();
+    sqlite3* db = lease.db;
+    if (!db) return uids;
+    const char* sql =
+      "SELECT u.value FROM json_each(?1) u"
+      " WHERE NOT EXISTS(SELECT 1 FROM processed_message p"
+      "                  WHERE p.mailbox_id = ?2 AND p.message_uid = u.value)"
+      " AND NOT EXISTS(SELECT 1 FROM processed l WHERE l.uid = u.value)"
+      " ORDER BY u.key;";
+    sqlite3_stmt* stmt = nullptr;
+    if (!prepare(db, sql, &stmt)) return uids;
+    std::string list = nlohmann::json(uids).dump();
+    sqlite3_bind_text(stmt, 1, list.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
+    std::vector<std::string> result;
+    while (sqlite3_step(stmt) == SQLITE_ROW) result.push_back(text_column(stmt, 0));
+    finish(stmt);
+    return result;
   }
 
   void mark_processed(const message& msg, const std::string& status) override {
-    std::lock_guard<std::mutex> lock(mu);
+    {
+      std::lock_guard<std::mutex> guard(deferred_mu);
+      auto it = deferred.find(std::this_thread::get_id());
+      if (it != deferred.end()) {
+        it->second.processed.emplace_back(msg, status);
+        return;
+      }
+    }
+    write_processed(msg, status);
+  }
+
+  void write_processed(const message& msg, const std::string& status) {
+    auto lock = write_lock();
     if (!db) return;
     const char* processed_message_sql =
       "INSERT INTO processed_message "
@@ -389,7 +630,7 @@ public:
       " status = excluded.status,"
       " processed_at = excluded.processed_at;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, processed_message_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (prepare(db, processed_message_sql, &stmt)) {
       std::string mailbox_id = msg.mailbox_id.empty() ? "default" : msg.mailbox_id;
       std::string ts = now_iso();
       sqlite3_bind_text(stmt, 1, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
@@ -399,30 +640,30 @@ public:
       sqlite3_bind_text(stmt, 5, ts.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_step(stmt);
     }
-    sqlite3_finalize(stmt);
+    finish(stmt);
 
     const char* legacy_sql =
       "INSERT OR IGNORE INTO processed (uid, message_id, from_addr, subject, date_iso)"
       " VALUES (?, ?, ?, ?, ?);";
     stmt = nullptr;
-    if (sqlite3_prepare_v2(db, legacy_sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, legacy_sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, msg.uid.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, msg.message_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, msg.from.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 4, msg.subject.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 5, msg.date_iso.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   void log_notification(const notification_log& rec) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "INSERT INTO notifications (uid, channel, status, error, ts_iso)"
       " VALUES (?, ?, ?, ?, ?);";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, rec.uid.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, rec.channel.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, rec.status.c_str(), -1, SQLITE_TRANSIENT);
@@ -430,11 +671,12 @@ public:
     std::string ts = rec.ts_iso.empty() ? now_iso() : rec.ts_iso;
     sqlite3_bind_text(stmt, 5, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   int processed_count() const override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return 0;
     const char* sql =
       "SELECT "
@@ -442,27 +684,28 @@ public:
       " (SELECT COUNT(*) FROM processed "
       "  WHERE uid NOT IN (SELECT message_uid FROM processed_message));";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return 0;
+    if (!prepare(db, sql, &stmt)) return 0;
     int rc = sqlite3_step(stmt);
     int count = (rc == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : 0;
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return count;
   }
 
   std::optional<mailbox_checkpoint> load_checkpoint(const std::string& mailbox_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
 
     const char* sql =
-      "SELECT mailbox_id, uid_validity, last_seen_uid, started_at, updated_at "
-      "FROM mailbox_checkpoint WHERE mailbox_id = ? LIMIT 1;";
+      "SELECT mailbox_id, uid_validity, last_seen_uid, started_at, updated_at, highest_modseq, "
+      "backfill_until_uid FROM mailbox_checkpoint WHERE mailbox_id = ? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
 
     int rc = sqlite3_step(stmt);
     if (rc != SQLITE_ROW) {
-      sqlite3_finalize(stmt);
+      finish(stmt);
       return std::nullopt;
     }
 
@@ -472,90 +715,136 @@ public:
     checkpoint.last_seen_uid = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 2));
     checkpoint.started_at = text_column(stmt, 3);
     checkpoint.updated_at = text_column(stmt, 4);
-    sqlite3_finalize(stmt);
+    checkpoint.highest_modseq = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 5));
+    checkpoint.backfill_until_uid = static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 6));
+    finish(stmt);
     return checkpoint;
   }
 
   void save_checkpoint(const mailbox_checkpoint& checkpoint) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
 
     const char* sql =
       "INSERT INTO mailbox_checkpoint "
-      "(mailbox_id, uid_validity, last_seen_uid, started_at, updated_at)"
-      " VALUES (?, ?, ?, ?, ?)"
+      "(mailbox_id, uid_validity, last_seen_uid, started_at, updated_at, highest_modseq,"
+      " backfill_until_uid)"
+      " VALUES (?, ?, ?, ?, ?, ?, ?)"
       " ON CONFLICT(mailbox_id) DO UPDATE SET"
       " uid_validity = excluded.uid_validity,"
       " last_seen_uid = excluded.last_seen_uid,"
-      " updated_at = excluded.updated_at;";
+      " updated_at = excluded.updated_at,"
+      " highest_modseq = excluded.highest_modseq;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, checkpoint.mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, checkpoint.uid_validity.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(checkpoint.last_seen_uid));
     sqlite3_bind_text(stmt, 4, checkpoint.started_at.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 5, checkpoint.updated_at.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(checkpoint.highest_modseq));
+    sqlite3_bind_int64(stmt, 7, static_cast<sqlite3_int64>(checkpoint.backfill_until_uid));
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
-  void append_event(const event_record& event, int limit) override {
-    std::lock_guard<std::mutex> lock(mu);
+  void set_checkpoint_backfill(const std::string& mailbox_id, std::uint64_t until_uid) override {
+    auto lock = write_lock();
     if (!db) return;
-    if (limit <= 0) limit = 200;
 
-    const char* insert_sql =
-      "INSERT INTO event_log(level, type, message, data_json, created_at) "
-      "VALUES (?, ?, ?, ?, ?);";
+    const char* sql = "UPDATE mailbox_checkpoint SET backfill_until_uid = ? WHERE mailbox_id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, insert_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-      std::string ts = event.created_at.empty() ? now_iso() : event.created_at;
-      std::string data = event.data_json.empty() ? "{}" : event.data_json;
-      sqlite3_bind_text(stmt, 1, event.level.c_str(), -1, SQLITE_TRANSIENT);
-      sqlite3_bind_text(stmt, 2, event.type.c_str(), -1, SQLITE_TRANSIENT);
-      sqlite3_bind_text(stmt, 3, event.message.c_str(), -1, SQLITE_TRANSIENT);
-      sqlite3_bind_text(stmt, 4, data.c_str(), -1, SQLITE_TRANSIENT);
-      sqlite3_bind_text(stmt, 5, ts.c_str(), -1, SQLITE_TRANSIENT);
-      sqlite3_step(stmt);
-    }
-    sqlite3_finalize(stmt);
-
-    const char* trim_sql =
-      "DELETE FROM event_log "
-      "WHERE id NOT IN (SELECT id FROM event_log ORDER BY id DESC LIMIT ?);";
-    stmt = nullptr;
-    if (sqlite3_prepare_v2(db, trim_sql, -1, &stmt, nullptr) != SQLITE_OK) return;
-    sqlite3_bind_int(stmt, 1, limit);
+    if (!prepare(db, sql, &stmt)) return;
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(until_uid));
+    sqlite3_bind_text(stmt, 2, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
+  }
+
+  // Events land in the in-memory ring, which serves last_events; the writer
+  // thread persists what the ring holds past persisted_id in one
+  // transaction and trims by id range instead of a NOT IN scan per event.
+  // The append path only locks to wake the writer once it is a batch behind.
+  void append_event(const event_record& event, int limit) override {
+    if (!db) return;
+    if (limit > 0) events_limit.store(limit, std::memory_order_relaxed);
+
+    event_record rec = event;
+    if (rec.created_at.empty()) rec.created_at = now_iso();
+    if (rec.data_json.empty()) rec.data_json = "{}";
+    long long id = events.push(std::move(rec)).id;
+
+    if (id - persisted_id.load() >= static_cast<long long>(k_event_batch)) {
+      std::lock_guard<std::mutex> lock(pending_mu);
+      pending_cv.notify_one();
+    }
   }
 
   std::vector<event_record> last_events(int limit) const override {
-    std::lock_guard<std::mutex> lock(mu);
-    std::vector<event_record> result;
-    if (!db) return result;
+    if (!db) return {};
     if (limit <= 0) limit = 200;
-
-    const char* sql =
-      "SELECT id, level, type, message, data_json, created_at "
-      "FROM event_log ORDER BY id DESC LIMIT ?;";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return result;
-    sqlite3_bind_int(stmt, 1, limit);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-      event_record event;
-      event.id = sqlite3_column_int64(stmt, 0);
-      event.level = text_column(stmt, 1);
-      event.type = text_column(stmt, 2);
-      event.message = text_column(stmt, 3);
-      event.data_json = text_column(stmt, 4);
-      event.created_at = text_column(stmt, 5);
-      result.push_back(std::move(event));
+    std::size_t wanted = static_cast<std::size_t>(std::min(limit, events_limit.load(std::memory_order_relaxed)));
+    std::vector<event_record> result = events.last(wanted);
+    if (result.size() < wanted && events.size() == events.capacity()) {
+      auto older = query_events(static_cast<int>(wanted - result.size()), events.oldest_id());
+      result.insert(result.end(), older.begin(), older.end());
     }
-    sqlite3_finalize(stmt);
     return result;
   }
 
+  void flush_events() override {
+    persist_events();
+  }
+
+  // The batch belongs to the thread that opened it: batch_mu is held until
+  // the outermost end_batch(), so writers on other threads wait for the
+  // commit instead of joining the transaction.
+  void begin_batch() override {
+    if (batch_owner.load() == std::this_thread::get_id()) {
+      ++batch_depth;
+      return;
+    }
+    batch_mu.lock();
+    batch_owner.store(std::this_thread::get_id());
+    batch_depth = 1;
+    std::lock_guard<std::mutex> lock(mu);
+    if (db) sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+  }
+
+  void end_batch() override {
+    if (batch_owner.load() != std::this_thread::get_id() || --batch_depth > 0) return;
+    {
+      std::lock_guard<std::mutex> lock(mu);
+      if (db && sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+    batch_owner.store(std::thread::id());
+    batch_mu.unlock();
+  }
+
+  void defer_writes() override {
+    std::lock_guard<std::mutex> guard(deferred_mu);
+    deferred.try_emplace(std::this_thread::get_id());
+  }
+
+  void flush_deferred_writes() override {
+    deferred_queue queue;
+    {
+      std::lock_guard<std::mutex> guard(deferred_mu);
+      auto it = deferred.find(std::this_thread::get_id());
+      if (it == deferred.end()) return;
+      queue = std::move(it->second);
+      deferred.erase(it);
+    }
+    if (queue.processed.empty() && queue.classifications.empty()) return;
+    begin_batch();
+    for (const auto& c : queue.classifications)
+      write_classification(c.email_id, c.classification_json, c.importance_level,
+                           c.importance_score, c.category, c.status);
+    for (const auto& [msg, status] : queue.processed) write_processed(msg, status);
+    end_batch();
+  }
+
   std::string create_form_session(const form_session& input) override {
     form_session session = input;
     if (session.id.empty()) session.id = random_id("form_");
@@ -563,7 +852,7 @@ public:
     if (session.updated_at.empty()) session.updated_at = session.created_at;
     if (session.auth_state_json.empty()) session.auth_state_json = "{}";
 
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return session.id;
 
     const char* sql =
@@ -574,15 +863,16 @@ public:
       " provider_debug_json, provider_error, captcha_required, created_at, updated_at)"
       " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return session.id;
+    if (!prepare(db, sql, &stmt)) return session.id;
     bind_form_session(stmt, session);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return session.id;
   }
 
   std::optional<form_session> get_form_session(const std::string& id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql =
       "SELECT id, mailbox_id, message_uid, status, form_url, form_type, title, fields_json, "
@@ -590,20 +880,21 @@ public:
       "api_form_id, public_form_id, provider_debug_json, provider_error, captcha_required, created_at, updated_at "
       "FROM active_form_session WHERE id = ? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
     int rc = sqlite3_step(stmt);
     if (rc != SQLITE_ROW) {
-      sqlite3_finalize(stmt);
+      finish(stmt);
       return std::nullopt;
     }
     form_session session = read_form_session(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return session;
   }
 
   std::vector<form_session> list_active_form_sessions(bool all = false) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     std::vector<form_session> result;
     if (!db) return result;
     const char* sql = all ?
@@ -619,16 +910,16 @@ public:
       "WHERE status IN ('waiting_user_review', 'waiting_auth', 'waiting_2fa', 'waiting_submit_confirm', 'manual_required', 'failed') "
       "ORDER BY updated_at DESC;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return result;
+    if (!prepare(db, sql, &stmt)) return result;
     while (sqlite3_step(stmt) == SQLITE_ROW) {
       result.push_back(read_form_session(stmt));
     }
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return result;
   }
 
   void update_form_session(const form_session& session) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE active_form_session SET "
@@ -638,24 +929,24 @@ public:
       "provider_debug_json=?, provider_error=?, captcha_required=?, updated_at=? "
       "WHERE id=?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     bind_form_session_update(stmt, session);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   void update_form_session_status(const std::string& id, const std::string& status) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql = "UPDATE active_form_session SET status = ?, updated_at = ? WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, status.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   void save_telegram_dialog(const telegram_dialog& input) override {
@@ -665,16 +956,16 @@ public:
     if (dialog.updated_at.empty()) dialog.updated_at = dialog.created_at;
     if (dialog.payload_json.empty()) dialog.payload_json = "{}";
 
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* clear_sql = "DELETE FROM telegram_dialog WHERE chat_id = ? AND id <> ?;";
     sqlite3_stmt* clear_stmt = nullptr;
-    if (sqlite3_prepare_v2(db, clear_sql, -1, &clear_stmt, nullptr) == SQLITE_OK) {
+    if (prepare(db, clear_sql, &clear_stmt)) {
       sqlite3_bind_text(clear_stmt, 1, dialog.chat_id.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_bind_text(clear_stmt, 2, dialog.id.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_step(clear_stmt);
     }
-    sqlite3_finalize(clear_stmt);
+    finish(clear_stmt);
 
     const char* sql =
       "INSERT INTO telegram_dialog (id, chat_id, session_id, state, payload_json, created_at, updated_at) "
@@ -682,7 +973,7 @@ public:
       "ON CONFLICT(id) DO UPDATE SET chat_id=excluded.chat_id, session_id=excluded.session_id, "
       "state=excluded.state, payload_json=excluded.payload_json, updated_at=excluded.updated_at;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, dialog.id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, dialog.chat_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, dialog.session_id.c_str(), -1, SQLITE_TRANSIENT);
@@ -691,21 +982,22 @@ public:
     sqlite3_bind_text(stmt, 6, dialog.created_at.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 7, dialog.updated_at.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   std::optional<telegram_dialog> get_telegram_dialog_by_chat(const std::string& chat_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql =
       "SELECT id, chat_id, session_id, state, payload_json, created_at, updated_at "
       "FROM telegram_dialog WHERE chat_id = ? ORDER BY updated_at DESC LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, chat_id.c_str(), -1, SQLITE_TRANSIENT);
     int rc = sqlite3_step(stmt);
     if (rc != SQLITE_ROW) {
-      sqlite3_finalize(stmt);
+      finish(stmt);
       return std::nullopt;
     }
     telegram_dialog dialog;
@@ -716,52 +1008,53 @@ public:
     dialog.payload_json = text_column(stmt, 4);
     dialog.created_at = text_column(stmt, 5);
     dialog.updated_at = text_column(stmt, 6);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return dialog;
   }
 
   void clear_telegram_dialog(const std::string& chat_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql = "DELETE FROM telegram_dialog WHERE chat_id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, chat_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   std::optional<std::string> get_runtime_value(const std::string& key) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql = "SELECT value FROM runtime_kv WHERE key = ? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
     int rc = sqlite3_step(stmt);
     if (rc != SQLITE_ROW) {
-      sqlite3_finalize(stmt);
+      finish(stmt);
       return std::nullopt;
     }
     std::string value = text_column(stmt, 0);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return value;
   }
 
   void set_runtime_value(const std::string& key, const std::string& value) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "INSERT INTO runtime_kv(key, value, updated_at) VALUES (?, ?, ?) "
       "ON CONFLICT(key) DO UPDATE SET value=excluded.value, updated_at=excluded.updated_at;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
 
@@ -770,37 +1063,46 @@ public:
     if (email.id.empty()) email.id = random_id("email_");
     if (email.created_at.empty()) email.created_at = now_iso();
     email.updated_at = now_iso();
+    if (!email.received_at) email.received_at = received_epoch(email.date_iso, email.created_at);
 
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return email.id;
 
     const char* sql =
       "INSERT INTO email_message "
       "(id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,body_text,"
       " links_json,attachments_json,classification_json,importance_level,importance_score,"
-      " category,status,read_at,archived_at,muted_until,created_at,updated_at) "
-      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
+      " category,status,read_at,archived_at,muted_until,created_at,updated_at,received_at) "
+      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
       "ON CONFLICT(mailbox_id,uid) DO UPDATE SET "
       " message_id=excluded.message_id,from_addr=excluded.from_addr,to_addr=excluded.to_addr,"
-      " subject=excluded.subject,date_iso=excluded.date_iso,"
+      " subject=excluded.subject,date_iso=excluded.date_iso,received_at=excluded.received_at,"
       " snippet=CASE WHEN excluded.snippet!='' THEN excluded.snippet ELSE email_message.snippet END,"
       " body_text=CASE WHEN excluded.body_text!='' THEN excluded.body_text ELSE email_message.body_text END,"
       " links_json=excluded.links_json,attachments_json=excluded.attachments_json,"
       " updated_at=excluded.updated_at;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return email.id;
+    if (!prepare(db, sql, &stmt)) return email.id;
+    sqlite3_exec(db, "SAVEPOINT save_email;", nullptr, nullptr, nullptr);
     bind_stored_email(stmt, email);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+    finish(stmt);
 
+    bool found = false;
     const char* sel = "SELECT id FROM email_message WHERE mailbox_id=? AND uid=? LIMIT 1;";
     stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sel, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (ok && prepare(db, sel, &stmt)) {
       sqlite3_bind_text(stmt, 1, email.mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_bind_text(stmt, 2, email.uid.c_str(), -1, SQLITE_TRANSIENT);
-      if (sqlite3_step(stmt) == SQLITE_ROW) email.id = text_column(stmt, 0);
-      sqlite3_finalize(stmt);
+      if (sqlite3_step(stmt) == SQLITE_ROW) {
+        email.id = text_column(stmt, 0);
+        found = true;
+      }
+      finish(stmt);
     }
+    if (ok && fts_enabled) ok = found && reindex_email(email.id);
+    if (!ok) sqlite3_exec(db, "ROLLBACK TO save_email;", nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "RELEASE save_email;", nullptr, nullptr, nullptr);
     return email.id;
   }
 
@@ -810,14 +1112,33 @@ public:
                                     double importance_score,
                                     const std::string& category,
                                     const std::string& status) override {
-    std::lock_guard<std::mutex> lock(mu);
+    {
+      std::lock_guard<std::mutex> guard(deferred_mu);
+      auto it = deferred.find(std::this_thread::get_id());
+      if (it != deferred.end()) {
+        it->second.classifications.push_back(
+            {email_id, classification_json, importance_level, importance_score, category, status});
+        return;
+      }
+    }
+    write_classification(email_id, classification_json, importance_level,
+                         importance_score, category, status);
+  }
+
+  void write_classification(const std::string& email_id,
+                            const std::string& classification_json,
+                            const std::string& importance_level,
+                            double importance_score,
+                            const std::string& category,
+                            const std::string& status) {
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE email_message SET "
       "classification_json=?,importance_level=?,importance_score=?,category=?,status=?,updated_at=? "
       "WHERE id=?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string cls = classification_json.empty() ? "{}" : classification_json;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, cls.c_str(), -1, SQLITE_TRANSIENT);
@@ -828,55 +1149,71 @@ public:
     sqlite3_bind_text(stmt, 6, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 7, email_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   std::optional<stored_email> get_email_message(const std::string& email_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql =
       "SELECT id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,body_text,"
       "links_json,attachments_json,classification_json,importance_level,importance_score,"
-      "category,status,read_at,archived_at,muted_until,created_at,updated_at "
+      "category,status,read_at,archived_at,muted_until,created_at,updated_at,received_at "
       "FROM email_message WHERE id=? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, email_id.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return std::nullopt; }
+    if (sqlite3_step(stmt) != SQLITE_ROW) { finish(stmt); return std::nullopt; }
     auto e = read_stored_email(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
+    std::lock_guard<std::mutex> guard(deferred_mu);
+    auto it = deferred.find(std::this_thread::get_id());
+    if (it == deferred.end()) return e;
+    for (const auto& c : it->second.classifications) {
+      if (c.email_id != email_id) continue;
+      e.classification_json = c.classification_json.empty() ? "{}" : c.classification_json;
+      e.importance_level = c.importance_level;
+      e.importance_score = c.importance_score;
+      e.category = c.category;
+      e.status = c.status;
+    }
     return e;
   }
 
   std::optional<stored_email> get_email_by_mailbox_uid(const std::string& mailbox_id,
                                                          const std::string& uid) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql =
       "SELECT id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,body_text,"
       "links_json,attachments_json,classification_json,importance_level,importance_score,"
-      "category,status,read_at,archived_at,muted_until,created_at,updated_at "
+      "category,status,read_at,archived_at,muted_until,created_at,updated_at,received_at "
       "FROM email_message WHERE mailbox_id=? AND uid=? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, uid.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return std::nullopt; }
+    if (sqlite3_step(stmt) != SQLITE_ROW) { finish(stmt); return std::nullopt; }
     auto e = read_stored_email(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return e;
   }
 
   std::vector<stored_email> list_emails(const email_list_filter& filter,
                                          int limit, int offset) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     std::vector<stored_email> result;
     if (!db) return result;
 
+    // Summary columns only: body, links and classification stay on disk and
+    // are read back as defaults.
     std::string sql =
-      "SELECT id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,body_text,"
-      "links_json,attachments_json,classification_json,importance_level,importance_score,"
-      "category,status,read_at,archived_at,muted_until,created_at,updated_at "
+      "SELECT id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,'',"
+      "'[]',attachments_json,'{}',importance_level,importance_score,"
+      "category,status,read_at,archived_at,muted_until,created_at,updated_at,received_at "
       "FROM email_message WHERE 1=1";
     std::vector<std::string> binds;
 
@@ -903,33 +1240,47 @@ public:
       sql += " AND (muted_until IS NULL OR muted_until<?)";
       binds.push_back(now);
     }
-    sql += " ORDER BY date_iso DESC LIMIT ? OFFSET ?";
+    if (filter.since > 0) {
+      sql += " AND received_at>=?";
+      binds.push_back(std::to_string(filter.since));
+    }
+    if (filter.until > 0) {
+      sql += " AND received_at<?";
+      binds.push_back(std::to_string(filter.until));
+    }
+    if (!filter.before_id.empty()) {
+      sql += " AND (received_at,id) < (SELECT received_at,id FROM email_message WHERE id=?)";
+      binds.push_back(filter.before_id);
+    }
+    sql += " ORDER BY received_at DESC, id DESC LIMIT ? OFFSET ?";
 
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return result;
+    if (!prepare(db, sql.c_str(), &stmt)) return result;
     int idx = 1;
     for (const auto& v : binds) sqlite3_bind_text(stmt, idx++, v.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, idx++, limit > 0 ? limit : 50);
     sqlite3_bind_int(stmt, idx,   offset >= 0 ? offset : 0);
     while (sqlite3_step(stmt) == SQLITE_ROW) result.push_back(read_stored_email(stmt));
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return result;
   }
 
   std::vector<stored_email> search_emails(const std::string& query,
                                            int limit, int offset) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     std::vector<stored_email> result;
     if (!db || query.empty()) return result;
+    if (fts_enabled) return search_email_fts(db, query, limit, offset);
     const char* sql =
       "SELECT id,mailbox_id,uid,message_id,from_addr,to_addr,subject,date_iso,snippet,body_text,"
       "links_json,attachments_json,classification_json,importance_level,importance_score,"
-      "category,status,read_at,archived_at,muted_until,created_at,updated_at "
+      "category,status,read_at,archived_at,muted_until,created_at,updated_at,received_at "
       "FROM email_message "
       "WHERE subject LIKE ? OR from_addr LIKE ? OR snippet LIKE ? OR body_text LIKE ? "
-      "ORDER BY date_iso DESC LIMIT ? OFFSET ?;";
+      "ORDER BY received_at DESC LIMIT ? OFFSET ?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return result;
+    if (!prepare(db, sql, &stmt)) return result;
     std::string pat = "%" + query + "%";
     sqlite3_bind_text(stmt, 1, pat.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, pat.c_str(), -1, SQLITE_TRANSIENT);
@@ -938,75 +1289,128 @@ public:
     sqlite3_bind_int(stmt, 5, limit > 0 ? limit : 20);
     sqlite3_bind_int(stmt, 6, offset >= 0 ? offset : 0);
     while (sqlite3_step(stmt) == SQLITE_ROW) result.push_back(read_stored_email(stmt));
-    sqlite3_finalize(stmt);
+    finish(stmt);
+    return result;
+  }
+
+  // bm25 weights favour subject and sender hits over body mentions; the
+  // highlight is taken from whichever column matched best.
+  std::vector<stored_email> search_email_fts(sqlite3* db, const std::string& query,
+                                             int limit, int offset) const {
+    std::vector<stored_email> result;
+    std::string expr = fts_match_expression(query);
+    if (expr.empty()) return result;
+    const char* sql =
+      "SELECT m.id,m.mailbox_id,m.uid,m.message_id,m.from_addr,m.to_addr,m.subject,m.date_iso,"
+      "m.snippet,m.body_text,m.links_json,m.attachments_json,m.classification_json,"
+      "m.importance_level,m.importance_score,m.category,m.status,m.read_at,m.archived_at,"
+      "m.muted_until,m.created_at,m.updated_at,m.received_at,"
+      "snippet(email_fts,-1,'[',']','…',12) "
+      "FROM email_fts JOIN email_message m ON m.id=email_fts.email_id "
+      "WHERE email_fts MATCH ? "
+      "ORDER BY bm25(email_fts,8.0,4.0,2.0,1.0,2.0,2.0), m.received_at DESC LIMIT ? OFFSET ?;";
+    sqlite3_stmt* stmt = nullptr;
+    if (!prepare(db, sql, &stmt)) return result;
+    sqlite3_bind_text(stmt, 1, expr.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, limit > 0 ? limit : 20);
+    sqlite3_bind_int(stmt, 3, offset >= 0 ? offset : 0);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      result.push_back(read_stored_email(stmt));
+      result.back().match_highlight = text_column(stmt, 23);
+    }
+    finish(stmt);
     return result;
   }
 
   void mark_email_read(const std::string& email_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE email_message SET read_at=?,updated_at=? WHERE id=? AND read_at IS NULL;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, email_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   void archive_email(const std::string& email_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE email_message SET archived_at=?,status='archived',updated_at=? "
       "WHERE id=? AND archived_at IS NULL;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, email_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
+  }
+
+  int set_emails_read_by_uid(const std::string& mailbox_id,
+                             const std::vector<std::string>& uids,
+                             bool read) override {
+    auto lock = write_lock();
+    // Reads made in the app are never pushed to the server, so only a
+    // \Seen the server reported earlier may be taken back.
+    const char* sql = read
+        ? "UPDATE email_message SET read_at=coalesce(read_at,?1),server_seen=1,updated_at=?1 "
+          "WHERE mailbox_id=?2 AND uid=?3 AND (read_at IS NULL OR server_seen=0);"
+        : "UPDATE email_message SET read_at=NULL,server_seen=0,updated_at=?1 "
+          "WHERE mailbox_id=?2 AND uid=?3 AND server_seen=1;";
+    return update_emails_by_uid(sql, mailbox_id, uids);
+  }
+
+  int archive_emails_by_uid(const std::string& mailbox_id,
+                            const std::vector<std::string>& uids) override {
+    auto lock = write_lock();
+    return update_emails_by_uid(
+        "UPDATE email_message SET archived_at=?1,status='archived',updated_at=?1 "
+        "WHERE mailbox_id=?2 AND uid=?3 AND archived_at IS NULL;",
+        mailbox_id, uids);
   }
 
   void mute_email(const std::string& email_id, const std::string& until_iso) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE email_message SET muted_until=?,updated_at=? WHERE id=?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     std::string ts = now_iso();
     sqlite3_bind_text(stmt, 1, until_iso.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, email_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
   int count_unread_important() override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return 0;
     const char* sql =
       "SELECT COUNT(*) FROM email_message "
       "WHERE read_at IS NULL AND archived_at IS NULL "
       "AND importance_level IN ('critical','high');";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return 0;
+    if (!prepare(db, sql, &stmt)) return 0;
     int count = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return count;
   }
 
 
   void save_email_attachments(const std::string& email_id,
                                const std::vector<stored_attachment>& attachments) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "INSERT OR IGNORE INTO email_attachment "
@@ -1015,7 +1419,7 @@ public:
       "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);";
     for (const auto& att : attachments) {
       sqlite3_stmt* stmt = nullptr;
-      if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) continue;
+      if (!prepare(db, sql, &stmt)) continue;
       std::string id = att.id.empty() ? random_id("att_") : att.id;
       std::string ts = now_iso();
       sqlite3_bind_text(stmt, 1,  id.c_str(), -1, SQLITE_TRANSIENT);
@@ -1034,12 +1438,13 @@ public:
       sqlite3_bind_text(stmt, 14, att.sha256.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_bind_text(stmt, 15, ts.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
+      finish(stmt);
     }
   }
 
   std::vector<stored_attachment> get_email_attachments(const std::string& email_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     std::vector<stored_attachment> result;
     if (!db) return result;
     const char* sql =
@@ -1047,43 +1452,44 @@ public:
       "content_id,disposition,safe_to_preview,downloaded,local_path,sha256,created_at "
       "FROM email_attachment WHERE email_id=? ORDER BY rowid;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return result;
+    if (!prepare(db, sql, &stmt)) return result;
     sqlite3_bind_text(stmt, 1, email_id.c_str(), -1, SQLITE_TRANSIENT);
     while (sqlite3_step(stmt) == SQLITE_ROW) result.push_back(read_stored_attachment(stmt));
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return result;
   }
 
   std::optional<stored_attachment> get_attachment(const std::string& attachment_id) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lease = reader();
+    sqlite3* db = lease.db;
     if (!db) return std::nullopt;
     const char* sql =
       "SELECT id,email_id,mailbox_id,uid,part_id,filename,mime_type,size_bytes,"
       "content_id,disposition,safe_to_preview,downloaded,local_path,sha256,created_at "
       "FROM email_attachment WHERE id=? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, attachment_id.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return std::nullopt; }
+    if (sqlite3_step(stmt) != SQLITE_ROW) { finish(stmt); return std::nullopt; }
     auto a = read_stored_attachment(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return a;
   }
 
   void update_attachment_download(const std::string& attachment_id,
                                    const std::string& local_path,
                                    const std::string& sha256) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     const char* sql =
       "UPDATE email_attachment SET downloaded=1,local_path=?,sha256=? WHERE id=?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, local_path.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, sha256.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, attachment_id.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
 
@@ -1094,67 +1500,138 @@ public:
     std::string ts      = now_iso();
     std::string expires = future_iso(ttl_seconds > 0 ? ttl_seconds : 300);
 
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return token;
     const char* sql =
       "INSERT INTO telegram_callback_token(token,action,payload_json,expires_at,created_at) "
       "VALUES(?,?,?,?,?);";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return token;
+    if (!prepare(db, sql, &stmt)) return token;
     sqlite3_bind_text(stmt, 1, token.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, action.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 3, payload_json.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 4, expires.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 5, ts.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
     return token;
   }
 
   std::optional<telegram_callback_token_record> resolve_telegram_callback_token(
       const std::string& token) override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return std::nullopt;
     std::string now = now_iso();
     const char* sql =
       "SELECT token,action,payload_json,expires_at,created_at "
       "FROM telegram_callback_token WHERE token=? AND expires_at>? LIMIT 1;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return std::nullopt;
+    if (!prepare(db, sql, &stmt)) return std::nullopt;
     sqlite3_bind_text(stmt, 1, token.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 2, now.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) != SQLITE_ROW) { sqlite3_finalize(stmt); return std::nullopt; }
+    if (sqlite3_step(stmt) != SQLITE_ROW) { finish(stmt); return std::nullopt; }
     telegram_callback_token_record rec;
     rec.token        = text_column(stmt, 0);
     rec.action       = text_column(stmt, 1);
     rec.payload_json = text_column(stmt, 2);
     rec.expires_at   = text_column(stmt, 3);
     rec.created_at   = text_column(stmt, 4);
-    sqlite3_finalize(stmt);
+    finish(stmt);
 
     const char* del = "DELETE FROM telegram_callback_token WHERE token=?;";
     stmt = nullptr;
-    if (sqlite3_prepare_v2(db, del, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (prepare(db, del, &stmt)) {
       sqlite3_bind_text(stmt, 1, rec.token.c_str(), -1, SQLITE_TRANSIENT);
       sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
+      finish(stmt);
     }
     return rec;
   }
 
   void cleanup_expired_callback_tokens() override {
-    std::lock_guard<std::mutex> lock(mu);
+    auto lock = write_lock();
     if (!db) return;
     std::string now = now_iso();
     const char* sql = "DELETE FROM telegram_callback_token WHERE expires_at<?;";
     sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+    if (!prepare(db, sql, &stmt)) return;
     sqlite3_bind_text(stmt, 1, now.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    finish(stmt);
   }
 
 private:
+  bool enable_wal() {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA journal_mode=WAL;", -1, &stmt, nullptr) != SQLITE_OK) return false;
+    bool wal = sqlite3_step(stmt) == SQLITE_ROW && text_column(stmt, 0) == "wal";
+    sqlite3_finalize(stmt);
+    if (wal) sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+    return wal;
+  }
+
+  // WAL lets read-only connections run beside the writer, so Web UI reads do
+  // not queue behind ingestion; in-memory databases keep the single handle.
+  void open_readers(const std::string& path, int count) {
+    for (int i = 0; i < count; ++i) {
+      auto conn = std::make_unique<sqlite_connection>();
+      if (sqlite3_open_v2(path.c_str(), &conn->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+        sqlite3_close(conn->db);
+        return;
+      }
+      tune_connection(conn->db);
+      readers.push_back(std::move(conn));
+    }
+  }
+
+  struct read_lease {
+    std::unique_lock<std::mutex> lock;
+    sqlite3* db = nullptr;
+  };
+
+  struct write_guard {
+    std::unique_lock<std::mutex> batch;
+    std::unique_lock<std::mutex> lock;
+  };
+
+  write_guard write_lock() {
+    write_guard guard;
+    if (batch_owner.load() != std::this_thread::get_id())
+      guard.batch = std::unique_lock<std::mutex>(batch_mu);
+    guard.lock = std::unique_lock<std::mutex>(mu);
+    return guard;
+  }
+
+  // The batch owner reads through the writer so it sees its own
+  // uncommitted rows; everyone else stays on the pool.
+  read_lease reader() const {
+    if (readers.empty() || batch_owner.load() == std::this_thread::get_id()) return {std::unique_lock<std::mutex>(mu), db};
+    std::size_t n = readers.size();
+    std::size_t start = next_reader.fetch_add(1, std::memory_order_relaxed) % n;
+    for (std::size_t i = 0; i < n; ++i) {
+      sqlite_connection& r = *readers[(start + i) % n];
+      std::unique_lock<std::mutex> lock(r.mu, std::try_to_lock);
+      if (lock.owns_lock()) return {std::move(lock), r.db};
+    }
+    sqlite_connection& r = *readers[start];
+    return {std::unique_lock<std::mutex>(r.mu), r.db};
+  }
+
+  statement_cache& cache_for(sqlite3* handle) const {
+    for (const auto& r : readers)
+      if (r->db == handle) return r->statements;
+    return writer_statements;
+  }
+
+  bool prepare(sqlite3* handle, const char* sql, sqlite3_stmt** out) const {
+    *out = cache_for(handle).take(handle, sql);
+    return *out != nullptr;
+  }
+
+  void finish(sqlite3_stmt* stmt) const {
+    if (stmt) cache_for(sqlite3_db_handle(stmt)).put_back(stmt);
+  }
+
   void ensure_active_form_session_columns() {
     const char* statements[] = {
         "ALTER TABLE active_form_session ADD COLUMN provider_type TEXT;",
@@ -1175,6 +1652,120 @@ private:
     }
   }
 
+  // Databases from before received_at get the column and have it filled
+  // once from the stored Date header text.
+  void ensure_email_message_columns() {
+    sqlite3_exec(db, "ALTER TABLE email_message ADD COLUMN server_seen INTEGER NOT NULL DEFAULT 0;",
+                 nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "ALTER TABLE email_message ADD COLUMN fts_rowid INTEGER;", nullptr, nullptr, nullptr);
+    if (sqlite3_exec(db, "ALTER TABLE email_message ADD COLUMN received_at INTEGER NOT NULL DEFAULT 0;",
+                     nullptr, nullptr, nullptr) != SQLITE_OK)
+      return;
+
+    std::vector<std::pair<std::string, std::int64_t>> updates;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT id,date_iso,created_at FROM email_message;", -1, &stmt, nullptr) != SQLITE_OK)
+      return;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+      updates.emplace_back(text_column(stmt, 0), received_epoch(text_column(stmt, 1), text_column(stmt, 2)));
+    sqlite3_finalize(stmt);
+
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    if (sqlite3_prepare_v2(db, "UPDATE email_message SET received_at=? WHERE id=?;", -1, &stmt, nullptr) == SQLITE_OK) {
+      for (const auto& u : updates) {
+        sqlite3_bind_int64(stmt, 1, u.second);
+        sqlite3_bind_text(stmt, 2, u.first.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+      }
+      sqlite3_finalize(stmt);
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+  }
+
+  // Creates the full-text index on first start and fills it from the
+  // emails already stored; builds without FTS5 keep the LIKE search. An
+  // index from before email_id was keyed on email_message.rowid and is
+  // rebuilt.
+  void ensure_email_fts() {
+    sqlite3_stmt* stmt = nullptr;
+    bool existed = false;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE name='email_fts' LIMIT 1;", -1, &stmt, nullptr) == SQLITE_OK) {
+      existed = sqlite3_step(stmt) == SQLITE_ROW;
+      sqlite3_finalize(stmt);
+      stmt = nullptr;
+    }
+    if (existed && sqlite3_prepare_v2(db, "SELECT email_id FROM email_fts LIMIT 0;", -1, &stmt, nullptr) != SQLITE_OK) {
+      sqlite3_exec(db, "DROP TABLE email_fts;", nullptr, nullptr, nullptr);
+      existed = false;
+    }
+    sqlite3_finalize(stmt);
+    if (sqlite3_exec(db, k_email_fts_ddl, nullptr, nullptr, nullptr) != SQLITE_OK) return;
+    fts_enabled = true;
+    if (existed) return;
+
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    if (sqlite3_exec(db, k_email_fts_backfill.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK) {
+      sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    } else {
+      sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+      sqlite3_exec(db, "DROP TABLE IF EXISTS email_fts;", nullptr, nullptr, nullptr);
+      fts_enabled = false;
+    }
+  }
+
+  bool reindex_email(const std::string& email_id) {
+    static const std::string insert = k_email_fts_insert + " WHERE id=?;";
+    const char* sqls[] = {
+        "DELETE FROM email_fts WHERE rowid=(SELECT fts_rowid FROM email_message WHERE id=?);",
+        insert.c_str(),
+        "UPDATE email_message SET fts_rowid=last_insert_rowid() WHERE id=?;"};
+    for (const char* sql : sqls) {
+      sqlite3_stmt* stmt = nullptr;
+      if (!prepare(db, sql, &stmt)) return false;
+      sqlite3_bind_text(stmt, 1, email_id.c_str(), -1, SQLITE_TRANSIENT);
+      bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+      finish(stmt);
+      if (!ok) return false;
+    }
+    return true;
+  }
+
+  void ensure_mailbox_checkpoint_columns() {
+    const char* statements[] = {
+      "ALTER TABLE mailbox_checkpoint ADD COLUMN highest_modseq INTEGER NOT NULL DEFAULT 0;",
+      "ALTER TABLE mailbox_checkpoint ADD COLUMN backfill_until_uid INTEGER NOT NULL DEFAULT 0;",
+    };
+    for (const char* sql : statements) {
+      char* alter_err = nullptr;
+      if (sqlite3_exec(db, sql, nullptr, nullptr, &alter_err) != SQLITE_OK) {
+        sqlite3_free(alter_err);
+      }
+    }
+  }
+
+  int update_emails_by_uid(const char* sql,
+                           const std::string& mailbox_id,
+                           const std::vector<std::string>& uids) {
+    if (!db || uids.empty()) return 0;
+    sqlite3_stmt* stmt = nullptr;
+    if (!prepare(db, sql, &stmt)) return 0;
+    std::string ts = now_iso();
+    int changed = 0;
+    sqlite3_exec(db, "SAVEPOINT update_emails;", nullptr, nullptr, nullptr);
+    for (const auto& uid : uids) {
+      sqlite3_bind_text(stmt, 1, ts.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(stmt, 2, mailbox_id.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(stmt, 3, uid.c_str(), -1, SQLITE_TRANSIENT);
+      if (sqlite3_step(stmt) == SQLITE_DONE) changed += sqlite3_changes(db);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+    sqlite3_exec(db, "RELEASE update_emails;", nullptr, nullptr, nullptr);
+    finish(stmt);
+    return changed;
+  }
+
   static std::string text_column(sqlite3_stmt* stmt, int index) {
     const unsigned char* text = sqlite3_column_text(stmt, index);
     return text ? reinterpret_cast<const char*>(text) : "";
@@ -1304,6 +1895,7 @@ private:
     e.muted_until      = text_column(stmt, 19);
     e.created_at       = text_column(stmt, 20);
     e.updated_at       = text_column(stmt, 21);
+    e.received_at      = sqlite3_column_int64(stmt, 22);
     return e;
   }
 
@@ -1359,6 +1951,7 @@ private:
     else sqlite3_bind_text(stmt, 20, e.muted_until.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 21, e.created_at.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 22, e.updated_at.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 23, e.received_at);
   }
 
   static std::string future_iso(int seconds) {
@@ -1384,13 +1977,135 @@ private:
     return ss.str();
   }
 
+  std::vector<event_record> query_events(int limit, long long before_id) const {
+    auto lease = reader();
+    sqlite3* db = lease.db;
+    std::vector<event_record> result;
+    if (!db) return result;
+    const char* sql =
+      "SELECT id, level, type, message, data_json, created_at "
+      "FROM event_log WHERE (?1 = 0 OR id < ?1) ORDER BY id DESC LIMIT ?2;";
+    sqlite3_stmt* stmt = nullptr;
+    if (!prepare(db, sql, &stmt)) return result;
+    sqlite3_bind_int64(stmt, 1, before_id);
+    sqlite3_bind_int(stmt, 2, limit);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      event_record event;
+      event.id = sqlite3_column_int64(stmt, 0);
+      event.level = text_column(stmt, 1);
+      event.type = text_column(stmt, 2);
+      event.message = text_column(stmt, 3);
+      event.data_json = text_column(stmt, 4);
+      event.created_at = text_column(stmt, 5);
+      result.push_back(std::move(event));
+    }
+    finish(stmt);
+    return result;
+  }
+
+  void write_events(const std::vector<event_record>& batch) {
+    if (batch.empty()) return;
+    auto lock = write_lock();
+    if (!db) return;
+    sqlite3_exec(db, "SAVEPOINT write_events;", nullptr, nullptr, nullptr);
+
+    const char* insert_sql =
+      "INSERT OR REPLACE INTO event_log(id, level, type, message, data_json, created_at) "
+      "VALUES (?, ?, ?, ?, ?, ?);";
+    sqlite3_stmt* stmt = nullptr;
+    long long newest = 0;
+    if (prepare(db, insert_sql, &stmt)) {
+      for (const auto& event : batch) {
+        sqlite3_bind_int64(stmt, 1, event.id);
+        sqlite3_bind_text(stmt, 2, event.level.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, event.type.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 4, event.message.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 5, event.data_json.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 6, event.created_at.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        newest = std::max(newest, event.id);
+      }
+    }
+    finish(stmt);
+
+    long long keep_from = newest - events_limit.load(std::memory_order_relaxed) + 1;
+    if (keep_from > trimmed_below) {
+      stmt = nullptr;
+      if (prepare(db, "DELETE FROM event_log WHERE id < ?;", &stmt)) {
+        sqlite3_bind_int64(stmt, 1, keep_from);
+        sqlite3_step(stmt);
+      }
+      finish(stmt);
+      trimmed_below = keep_from;
+    }
+    sqlite3_exec(db, "RELEASE write_events;", nullptr, nullptr, nullptr);
+  }
+
+  void persist_events() {
+    std::lock_guard<std::mutex> lock(persist_mu);
+    std::vector<event_record> batch = events.since(persisted_id.load());
+    if (batch.empty()) return;
+    write_events(batch);
+    persisted_id.store(batch.back().id);
+  }
+
+  void run_event_writer() {
+    std::unique_lock<std::mutex> lock(pending_mu);
+    for (;;) {
+      pending_cv.wait_for(lock, k_event_flush_interval, [this]() {
+        return stopping || events.newest_id() - persisted_id.load() >= static_cast<long long>(k_event_batch);
+      });
+      bool stop = stopping;
+      lock.unlock();
+      persist_events();
+      lock.lock();
+      if (stop) return;
+    }
+  }
+
+  static constexpr std::size_t k_event_batch = 64;
+  static constexpr std::chrono::milliseconds k_event_flush_interval{250};
+
   sqlite3* db = nullptr;
   mutable std::mutex mu;
+  mutable statement_cache writer_statements;
+  std::vector<std::unique_ptr<sqlite_connection>> readers;
+  mutable std::atomic<std::size_t> next_reader{0};
+  bool fts_enabled = false;
+  std::mutex batch_mu;
+  std::atomic<std::thread::id> batch_owner{};
+  int batch_depth = 0;
+
+  struct deferred_classification {
+    std::string email_id;
+    std::string classification_json;
+    std::string importance_level;
+    double importance_score = 0.0;
+    std::string category;
+    std::string status;
+  };
+  struct deferred_queue {
+    std::vector<std::pair<message, std::string>> processed;
+    std::vector<deferred_classification> classifications;
+  };
+  std::mutex deferred_mu;
+  std::unordered_map<std::thread::id, deferred_queue> deferred;
+
+  event_ring events;
+  std::atomic<int> events_limit;
+  std::atomic<long long> persisted_id{0};
+  long long trimmed_below = 0;
+  std::mutex persist_mu;
+  std::mutex pending_mu;
+  std::condition_variable pending_cv;
+  bool stopping = false;
+  std::thread event_writer;
 };
 
-storage* make_sqlite_storage(const std::string& path, std::string* err) {
+storage* make_sqlite_storage(const std::string& path, std::string* err, int read_connections, int events_limit) {
   std::string e;
-  auto* ptr = new sqlite_storage(path, e);
+  auto* ptr = new sqlite_storage(path, read_connections, events_limit, e);
   if (!e.empty()) {
     if (err) *err = e;
     delete ptr;
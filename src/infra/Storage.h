@@ -21,6 +21,8 @@ struct mailbox_checkpoint {
   std::string mailbox_id;
   std::string uid_validity;
   std::uint64_t last_seen_uid = 0;
+  std::uint64_t highest_modseq = 0;
+  std::uint64_t backfill_until_uid = 0;
   std::string started_at;
   std::string updated_at;
 };
@@ -50,6 +52,11 @@ struct email_list_filter {
   std::string mailbox_id;
   bool archived = false;
   bool muted = false;
+  // received_at range in epoch seconds, since inclusive, until exclusive; 0 = open.
+  std::int64_t since = 0;
+  std::int64_t until = 0;
+  // Keyset cursor: only emails ordered after this one (received_at, then id).
+  std::string before_id;
 };
 
 struct stored_email {
@@ -75,6 +82,10 @@ struct stored_email {
   std::string muted_until;
   std::string created_at;
   std::string updated_at;
+  // Epoch seconds; save_email_message derives it from date_iso when left 0.
+  std::int64_t received_at = 0;
+  // Filled by search_emails only: matched text with hits wrapped in [ ].
+  std::string match_highlight;
 };
 
 struct stored_attachment {
@@ -108,13 +119,33 @@ public:
   virtual ~storage() = default;
   virtual bool is_processed(const std::string& mailbox_id, const std::string& uid) = 0;
   virtual void mark_processed(const message& msg, const std::string& status) = 0;
+  // The uids (in input order) that is_processed() would report as new.
+  virtual std::vector<std::string> filter_unprocessed(const std::string& mailbox_id,
+                                                      const std::vector<std::string>& uids) {
+    std::vector<std::string> result;
+    for (const auto& uid : uids)
+      if (!is_processed(mailbox_id, uid)) result.push_back(uid);
+    return result;
+  }
   virtual void log_notification(const notification_log& rec) = 0;
   virtual int processed_count() const = 0;
 
   virtual std::optional<mailbox_checkpoint> load_checkpoint(const std::string& mailbox_id) = 0;
   virtual void save_checkpoint(const mailbox_checkpoint& checkpoint) = 0;
+  virtual void set_checkpoint_backfill(const std::string& mailbox_id, std::uint64_t until_uid) {}
   virtual void append_event(const event_record& event, int limit) = 0;
   virtual std::vector<event_record> last_events(int limit) const = 0;
+  virtual void flush_events() {}
+  // Writes made by this thread between begin_batch() and the matching
+  // end_batch() commit together; nested batches join the outermost one.
+  // Writes from other threads wait until the batch ends.
+  virtual void begin_batch() {}
+  virtual void end_batch() {}
+  // Between defer_writes() and flush_deferred_writes() this thread's
+  // processed marks and classification updates are queued; reads on the
+  // same thread see them. The flush writes the queue in one batch.
+  virtual void defer_writes() {}
+  virtual void flush_deferred_writes() {}
   virtual std::string create_form_session(const form_session& session) = 0;
   virtual std::optional<form_session> get_form_session(const std::string& id) = 0;
   virtual std::vector<form_session> list_active_form_sessions(bool all = false) = 0;
@@ -146,6 +177,11 @@ public:
   virtual void mark_email_read(const std::string& email_id) = 0;
   virtual void archive_email(const std::string& email_id) = 0;
   virtual void mute_email(const std::string& email_id, const std::string& until_iso) = 0;
+  virtual int set_emails_read_by_uid(const std::string& mailbox_id,
+                                     const std::vector<std::string>& uids,
+                                     bool read) = 0;
+  virtual int archive_emails_by_uid(const std::string& mailbox_id,
+                                    const std::vector<std::string>& uids) = 0;
   virtual int count_unread_important() = 0;
 
 
@@ -174,4 +210,34 @@ public:
   }
 };
 
-storage* make_sqlite_storage(const std::string& path, std::string* err);
+// Scoped unit of work: everything this thread writes while it is alive
+// commits once, when it goes out of scope. Keep network and LLM calls
+// outside of it, other writers are blocked meanwhile.
+class storage_batch {
+public:
+  explicit storage_batch(storage& store) : store(store) { store.begin_batch(); }
+  ~storage_batch() { store.end_batch(); }
+  storage_batch(const storage_batch&) = delete;
+  storage_batch& operator=(const storage_batch&) = delete;
+
+private:
+  storage& store;
+};
+
+// Queues processed marks and classification updates until flush() or the
+// end of the scope, so they can share the batch that saves the checkpoint.
+class storage_deferral {
+public:
+  explicit storage_deferral(storage& store) : store(store) { store.defer_writes(); }
+  ~storage_deferral() { store.flush_deferred_writes(); }
+  storage_deferral(const storage_deferral&) = delete;
+  storage_deferral& operator=(const storage_deferral&) = delete;
+
+  void flush() { store.flush_deferred_writes(); }
+
+private:
+  storage& store;
+};
+
+storage* make_sqlite_storage(const std::string& path, std::string* err, int read_connections = 3,
+                             int events_limit = 200);
@@ -0,0 +1,288 @@
+#include "TransferDecode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CTL_DECODE_X86 1
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+constexpr unsigned char b64_skip = 0x40;
+constexpr unsigned char b64_stop = 0x80;
+
+struct base64_table {
+  unsigned char value[256];
+
+  base64_table() {
+    static const char* alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (auto& v : value) v = b64_skip;
+    for (int i = 0; i < 64; ++i) value[static_cast<unsigned char>(alphabet[i])] = static_cast<unsigned char>(i);
+    value[static_cast<unsigned char>('=')] = b64_stop;
+  }
+};
+
+struct hex_table {
+  signed char value[256];
+
+  hex_table() {
+    for (auto& v : value) v = -1;
+    for (int i = 0; i < 10; ++i) value['0' + i] = static_cast<signed char>(i);
+    for (int i = 0; i < 6; ++i) {
+      value['a' + i] = static_cast<signed char>(10 + i);
+      value['A' + i] = static_cast<signed char>(10 + i);
+    }
+  }
+};
+
+const base64_table g_base64;
+const hex_table g_hex;
+
+
+using base64_block_fn = std::size_t (*)(const unsigned char* in, std::size_t len,
+                                        unsigned char* out, std::size_t& used);
+
+#ifdef CTL_DECODE_X86
+
+// Muła's nibble-lookup translation: a block is decoded only if all of its
+// bytes are alphabet symbols; whitespace or padding ends the SIMD run and the
+// scalar loop takes over until the next aligned quad.
+__attribute__((target("ssse3")))
+std::size_t base64_blocks_ssse3(const unsigned char* in, std::size_t len,
+                                unsigned char* out, std::size_t& used) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble   = _mm_set1_epi8(0x0F);
+  const __m128i slash    = _mm_set1_epi8(0x2F);
+  const __m128i zero     = _mm_setzero_si128();
+  const __m128i pack_ab  = _mm_set1_epi32(0x01400140);
+  const __m128i pack_abc = _mm_set1_epi32(0x00011000);
+  const __m128i order    = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  std::size_t written = 0;
+  used = 0;
+  while (len - used >= 16) {
+    __m128i src    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + used));
+    __m128i hi_nib = _mm_and_si128(_mm_srli_epi32(src, 4), nibble);
+    __m128i lo     = _mm_shuffle_epi8(lut_lo, _mm_and_si128(src, nibble));
+    __m128i hi     = _mm_shuffle_epi8(lut_hi, hi_nib);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) != 0xFFFF) break;
+
+    __m128i roll   = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(src, slash), hi_nib));
+    __m128i values = _mm_add_epi8(src, roll);
+    __m128i packed = _mm_madd_epi16(_mm_maddubs_epi16(values, pack_ab), pack_abc);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + written), _mm_shuffle_epi8(packed, order));
+    used    += 16;
+    written += 12;
+  }
+  return written;
+}
+
+__attribute__((target("avx2")))
+std::size_t base64_blocks_avx2(const unsigned char* in, std::size_t len,
+                               unsigned char* out, std::size_t& used) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble   = _mm256_set1_epi8(0x0F);
+  const __m256i slash    = _mm256_set1_epi8(0x2F);
+  const __m256i zero     = _mm256_setzero_si256();
+  const __m256i pack_ab  = _mm256_set1_epi32(0x01400140);
+  const __m256i pack_abc = _mm256_set1_epi32(0x00011000);
+  const __m256i order    = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes    = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+  std::size_t written = 0;
+  used = 0;
+  while (len - used >= 32) {
+    __m256i src    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + used));
+    __m256i hi_nib = _mm256_and_si256(_mm256_srli_epi32(src, 4), nibble);
+    __m256i lo     = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(src, nibble));
+    __m256i hi     = _mm256_shuffle_epi8(lut_hi, hi_nib);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero)) != -1) break;
+
+    __m256i roll   = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(src, slash), hi_nib));
+    __m256i values = _mm256_add_epi8(src, roll);
+    __m256i packed = _mm256_madd_epi16(_mm256_maddubs_epi16(values, pack_ab), pack_abc);
+    packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, order), lanes);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + written), packed);
+    used    += 32;
+    written += 24;
+  }
+  return written;
+}
+
+#endif
+
+struct decode_dispatch {
+  base64_block_fn base64_blocks = nullptr;
+  std::size_t block = 0;
+  const char* isa = "scalar";
+};
+
+decode_dispatch detect_dispatch() {
+  decode_dispatch d;
+#ifdef CTL_DECODE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    d.base64_blocks = base64_blocks_avx2;
+    d.block = 32;
+    d.isa = "avx2";
+  } else if (__builtin_cpu_supports("ssse3")) {
+    d.base64_blocks = base64_blocks_ssse3;
+    d.block = 16;
+    d.isa = "ssse3";
+  }
+#endif
+  return d;
+}
+
+const decode_dispatch& dispatch() {
+  static const decode_dispatch d = detect_dispatch();
+  return d;
+}
+
+
+std::size_t qp_plain_run(const char* p, std::size_t n, bool header_mode) {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i eq = _mm_set1_epi8('=');
+  const __m128i us = _mm_set1_epi8(header_mode ? '_' : '=');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, eq), _mm_cmpeq_epi8(v, us)));
+    if (mask) return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+  }
+#endif
+  for (; i < n; ++i) {
+    if (p[i] == '=' || (header_mode && p[i] == '_')) break;
+  }
+  return i;
+}
+
+}
+
+
+std::string base64_decode(std::string_view input, bool allow_simd) {
+  const auto* in = reinterpret_cast<const unsigned char*>(input.data());
+  const std::size_t n = input.size();
+  const unsigned char* table = g_base64.value;
+
+  std::string out;
+  out.resize(n / 4 * 3 + 32);
+  auto* dst = reinterpret_cast<unsigned char*>(&out[0]);
+
+  const decode_dispatch& simd = dispatch();
+  base64_block_fn blocks = allow_simd ? simd.base64_blocks : nullptr;
+
+  std::size_t i = 0, w = 0;
+  std::uint32_t acc = 0;
+  int count = 0;
+  while (i < n) {
+    if (count == 0) {
+      if (blocks && n - i >= simd.block) {
+        std::size_t used = 0;
+        w += blocks(in + i, n - i, dst + w, used);
+        i += used;
+        if (i >= n) break;
+      }
+      if (i + 4 <= n) {
+        unsigned a = table[in[i]], b = table[in[i + 1]], c = table[in[i + 2]], d = table[in[i + 3]];
+        if ((a | b | c | d) < 64) {
+          std::uint32_t v = a << 18 | b << 12 | c << 6 | d;
+          dst[w]     = static_cast<unsigned char>(v >> 16);
+          dst[w + 1] = static_cast<unsigned char>(v >> 8);
+          dst[w + 2] = static_cast<unsigned char>(v);
+          w += 3;
+          i += 4;
+          continue;
+        }
+      }
+    }
+
+    unsigned char v = table[in[i++]];
+    if (v == b64_stop) break;
+    if (v == b64_skip) continue;
+    acc = acc << 6 | v;
+    if (++count == 4) {
+      dst[w]     = static_cast<unsigned char>(acc >> 16);
+      dst[w + 1] = static_cast<unsigned char>(acc >> 8);
+      dst[w + 2] = static_cast<unsigned char>(acc);
+      w += 3;
+      acc = 0;
+      count = 0;
+    }
+  }
+  if (count == 2) {
+    dst[w++] = static_cast<unsigned char>(acc >> 4);
+  } else if (count == 3) {
+    dst[w++] = static_cast<unsigned char>(acc >> 10);
+    dst[w++] = static_cast<unsigned char>(acc >> 2);
+  }
+  out.resize(w);
+  return out;
+}
+
+std::string quoted_printable_decode(std::string_view input, bool header_mode) {
+  const char* in = input.data();
+  const std::size_t n = input.size();
+  std::string out;
+  if (n == 0) return out;
+  out.resize(n);
+  char* dst = &out[0];
+
+  std::size_t i = 0, w = 0;
+  while (i < n) {
+    std::size_t run = qp_plain_run(in + i, n - i, header_mode);
+    std::memcpy(dst + w, in + i, run);
+    w += run;
+    i += run;
+    if (i >= n) break;
+
+    if (in[i] == '_') {
+      dst[w++] = ' ';
+      ++i;
+      continue;
+    }
+    if (i + 2 < n) {
+      if (in[i + 1] == '\r' && in[i + 2] == '\n') { i += 3; continue; }
+      if (in[i + 1] == '\n') { i += 2; continue; }
+      int hi = g_hex.value[static_cast<unsigned char>(in[i + 1])];
+      int lo = g_hex.value[static_cast<unsigned char>(in[i + 2])];
+      if (hi >= 0 && lo >= 0) {
+        dst[w++] = static_cast<char>((hi << 4) | lo);
+        i += 3;
+        continue;
+      }
+    }
+    dst[w++] = '=';
+    ++i;
+  }
+  out.resize(w);
+  return out;
+}
+
+const char* transfer_decode_isa() {
+  return dispatch().isa;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+
+std::string base64_decode(std::string_view input, bool allow_simd = true);
+
+std::string quoted_printable_decode(std::string_view input, bool header_mode);
+
+
+const char* transfer_decode_isa();
@@ -1,5 +1,7 @@
 #include "UrlPolicy.h"
 
+#include "../util/CaseFold.h"
+
 #include <algorithm>
 #include <cctype>
 #include <cstring>
@@ -12,12 +14,6 @@
 
 namespace {
 
-std::string to_lower(std::string s) {
-  std::transform(s.begin(), s.end(), s.begin(),
-                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-  return s;
-}
-
 bool ends_with(const std::string& value, const std::string& suffix) {
   return value.size() >= suffix.size() &&
          value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
@@ -34,8 +30,8 @@ bool parse_url(const std::string& url, parsed_url& out) {
   static const std::regex re(R"(^([A-Za-z][A-Za-z0-9+.-]*):\/\/(\[[^\]]+\]|[^\/:?#]+)([^?#]*)?(\?.*)?$)");
   std::smatch m;
   if (!std::regex_search(url, m, re)) return false;
-  out.scheme = to_lower(m[1].str());
-  out.host = to_lower(m[2].str());
+  out.scheme = ascii_lower(m[1].str());
+  out.host = ascii_lower(m[2].str());
   out.path = m[3].matched ? m[3].str() : "";
   out.has_query = m[4].matched;
   if (!out.host.empty() && out.host.front() == '[' && out.host.back() == ']') {
@@ -46,7 +42,7 @@ bool parse_url(const std::string& url, parsed_url& out) {
 }
 
 bool domain_matches(const std::string& host, const std::string& domain) {
-  std::string d = to_lower(domain);
+  std::string d = ascii_lower(domain);
   return host == d || ends_with(host, "." + d);
 }
 
@@ -222,7 +218,7 @@ bool is_allowed_url(const std::string& url, const security_config& cfg, std::str
     return false;
   }
 
-  if (to_lower(cfg.mode) == "strict" && !in_list(parsed.host, cfg.allowed_domains)) {
+  if (ascii_lower(cfg.mode) == "strict" && !in_list(parsed.host, cfg.allowed_domains)) {
     reason = "domain is not in allowed_domains";
     return false;
   }
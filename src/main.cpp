@@ -342,7 +342,7 @@ int main(int argc, char** argv) {
     twilio_ptr = std::make_unique<twilio_notifier>(cfg.twilio);
   }
 
-  std::unique_ptr<storage> store(make_sqlite_storage(cfg.storage.path, &err));
+  std::unique_ptr<storage> store(make_sqlite_storage(cfg.storage.path, &err, cfg.storage.read_connections, cfg.events_limit));
   if (!store) {
     std::cerr << "storage error: " << err << std::endl;
     return 1;
@@ -356,7 +356,8 @@ int main(int argc, char** argv) {
     handlers.get_status_json = [&application]() { return application.status_json(); };
     handlers.get_dashboard_json = [&application]() { return application.status_json(); };
     handlers.get_events_json = [&application](int limit) { return application.events_json(limit); };
-    handlers.get_rules_json = [&application]() { return application.rules_json(); };
+    handlers.get_rules_json = [&application](bool stats) { return application.rules_json(stats); };
+    handlers.get_rules_stats_json = [&application]() { return application.rules_stats_json(); };
     handlers.set_rules_json = [&application](const std::string& text, std::string& e) {
       return application.update_rules_json(text, e);
     };
@@ -436,8 +437,10 @@ int main(int argc, char** argv) {
     handlers.apply_profile_expansion_json = [&application](const std::string& body, std::string& e) {
       return application.apply_profile_expansion_json(body, e);
     };
-    handlers.mail_list_json = [&application](const std::string& filter, int limit, int offset) {
-      return application.mail_list_json(filter, limit, offset);
+    handlers.mail_list_json = [&application](const std::string& filter, int limit, int offset,
+                                             const std::string& before, const std::string& since,
+                                             const std::string& until) {
+      return application.mail_list_json(filter, limit, offset, before, since, until);
     };
     handlers.mail_get_json = [&application](const std::string& id) {
       return application.mail_get_json(id);
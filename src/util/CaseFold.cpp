@@ -0,0 +1,218 @@
+#include "CaseFold.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define CTL_FOLD_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Folded code point for every two-byte UTF-8 sequence (U+0080..U+07FF); all
+// targets stay below U+0800, so folding never changes the encoded length.
+struct fold_table {
+  std::array<std::uint16_t, 0x800> cp{};
+
+  fold_table() {
+    for (std::size_t c = 0; c < cp.size(); ++c) cp[c] = static_cast<std::uint16_t>(c);
+    auto shift = [&](std::uint16_t first, std::uint16_t last, std::uint16_t delta) {
+      for (std::uint16_t c = first; c <= last; ++c) cp[c] = static_cast<std::uint16_t>(c + delta);
+    };
+    auto pairs = [&](std::uint16_t first, std::uint16_t last) {
+      for (std::uint16_t c = first; c < last; c += 2) cp[c] = static_cast<std::uint16_t>(c + 1);
+    };
+
+    shift(0x00C0, 0x00D6, 0x20);
+    shift(0x00D8, 0x00DE, 0x20);
+    pairs(0x0100, 0x012F);
+    pairs(0x0132, 0x0137);
+    pairs(0x0139, 0x0148);
+    pairs(0x014A, 0x0177);
+    cp[0x0178] = 0x00FF;
+    pairs(0x0179, 0x017E);
+
+    shift(0x0400, 0x040F, 0x50);
+    shift(0x0410, 0x042F, 0x20);
+    pairs(0x0460, 0x0481);
+    pairs(0x048A, 0x04BF);
+    cp[0x04C0] = 0x04CF;
+    pairs(0x04C1, 0x04CE);
+    pairs(0x04D0, 0x052F);
+  }
+};
+
+const fold_table& table() {
+  static const fold_table t;
+  return t;
+}
+
+inline unsigned char lower_byte(unsigned char c) {
+  return static_cast<unsigned char>(c + (static_cast<unsigned>(c - 'A') < 26u ? 0x20 : 0));
+}
+
+inline std::size_t fold_one(const unsigned char* in, std::size_t i, std::size_t n,
+                            unsigned char* out, const fold_table& t) {
+  unsigned char c = in[i];
+  if (c < 0x80) {
+    out[i] = lower_byte(c);
+    return 1;
+  }
+  if ((c & 0xE0) == 0xC0 && i + 1 < n && (in[i + 1] & 0xC0) == 0x80) {
+    std::uint16_t f = t.cp[((c & 0x1Fu) << 6) | (in[i + 1] & 0x3Fu)];
+    out[i] = static_cast<unsigned char>(0xC0 | (f >> 6));
+    out[i + 1] = static_cast<unsigned char>(0x80 | (f & 0x3F));
+    return 2;
+  }
+  out[i] = c;
+  return 1;
+}
+
+// Runs of non-ASCII bytes (a Cyrillic word) are folded scalar before the
+// vector loop resumes, so mixed text does not reload a block per letter.
+inline std::size_t fold_run(const unsigned char* in, std::size_t i, std::size_t n,
+                            unsigned char* out, const fold_table& t) {
+  while (i < n && in[i] >= 0x80) i += fold_one(in, i, n, out, t);
+  return i;
+}
+
+#ifdef CTL_FOLD_X86
+
+// 'A'..'Z' shifted to -128..-103; bytes >= 0x80 never land in that range.
+inline __m128i lower16(__m128i v) {
+  __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+  __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + 26)));
+  return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+std::size_t fold_blocks_sse2(const unsigned char* in, std::size_t n, unsigned char* out,
+                             const fold_table& t) {
+  std::size_t i = 0;
+  while (i + 16 <= n) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), lower16(v));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(v));
+    if (mask == 0) {
+      i += 16;
+      continue;
+    }
+    i = fold_run(in, i + static_cast<std::size_t>(__builtin_ctz(mask)), n, out, t);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+std::size_t fold_blocks_avx2(const unsigned char* in, std::size_t n, unsigned char* out,
+                             const fold_table& t) {
+  const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80 - 'A'));
+  const __m256i limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+  const __m256i bit = _mm256_set1_epi8(0x20);
+  std::size_t i = 0;
+  while (i + 32 <= n) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    __m256i upper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(v, _mm256_and_si256(upper, bit)));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(v));
+    if (mask == 0) {
+      i += 32;
+      continue;
+    }
+    i = fold_run(in, i + static_cast<std::size_t>(__builtin_ctz(mask)), n, out, t);
+  }
+  return i;
+}
+
+std::size_t ascii_blocks_sse2(unsigned char* s, std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i), lower16(v));
+  }
+  return i;
+}
+
+#endif
+
+struct fold_dispatch {
+  std::size_t (*fold_blocks)(const unsigned char*, std::size_t, unsigned char*, const fold_table&) = nullptr;
+  const char* isa = "scalar";
+};
+
+fold_dispatch detect() {
+  fold_dispatch d;
+#ifdef CTL_FOLD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    d.fold_blocks = fold_blocks_avx2;
+    d.isa = "avx2";
+  } else {
+    d.fold_blocks = fold_blocks_sse2;
+    d.isa = "sse2";
+  }
+#endif
+  return d;
+}
+
+const fold_dispatch& dispatch() {
+  static const fold_dispatch d = detect();
+  return d;
+}
+
+void fold_into(const char* src, char* dst, std::size_t n) {
+  const auto* in = reinterpret_cast<const unsigned char*>(src);
+  auto* out = reinterpret_cast<unsigned char*>(dst);
+  const fold_table& t = table();
+  const fold_dispatch& d = dispatch();
+  std::size_t i = d.fold_blocks ? d.fold_blocks(in, n, out, t) : 0;
+  while (i < n) i += fold_one(in, i, n, out, t);
+}
+
+}
+
+
+void case_fold_in_place(std::string& text) {
+  fold_into(text.data(), text.data(), text.size());
+}
+
+void case_fold_append(std::string& out, std::string_view text) {
+  std::size_t at = out.size();
+  out.resize(at + text.size());
+  fold_into(text.data(), out.data() + at, text.size());
+}
+
+std::string case_fold(std::string_view text) {
+  std::string out;
+  case_fold_append(out, text);
+  return out;
+}
+
+void ascii_lower_in_place(std::string& text) {
+  auto* s = reinterpret_cast<unsigned char*>(text.data());
+  std::size_t i = 0;
+#ifdef CTL_FOLD_X86
+  i = ascii_blocks_sse2(s, text.size());
+#endif
+  for (; i < text.size(); ++i) s[i] = lower_byte(s[i]);
+}
+
+std::string ascii_lower(std::string_view text) {
+  std::string out(text);
+  ascii_lower_in_place(out);
+  return out;
+}
+
+bool ascii_istarts_with(std::string_view text, std::size_t pos, std::string_view lower_prefix) {
+  if (pos > text.size() || text.size() - pos < lower_prefix.size()) return false;
+  for (std::size_t i = 0; i < lower_prefix.size(); ++i)
+    if (ascii_lower(text[pos + i]) != lower_prefix[i]) return false;
+  return true;
+}
+
+const char* case_fold_isa() {
+  return dispatch().isa;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// Lower-cases ASCII, Latin-1/Latin Extended-A and Cyrillic letters in UTF-8
+// text. Every mapping keeps the encoded length, so the in-place and
+// into-buffer variants produce byte-for-byte the same output; anything else
+// (including malformed sequences) is copied through unchanged.
+void case_fold_in_place(std::string& text);
+
+void case_fold_append(std::string& out, std::string_view text);
+
+std::string case_fold(std::string_view text);
+
+// ASCII-only variant for protocol tokens, hosts and header names.
+void ascii_lower_in_place(std::string& text);
+
+std::string ascii_lower(std::string_view text);
+
+inline char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+// True when text has lower_prefix at pos, ignoring ASCII case in text;
+// lower_prefix must already be lower case.
+bool ascii_istarts_with(std::string_view text, std::size_t pos, std::string_view lower_prefix);
+
+
+const char* case_fold_isa();
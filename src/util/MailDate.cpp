@@ -0,0 +1,204 @@
+#include "MailDate.h"
+#include "CaseFold.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+
+// Days from 1970-01-01 to the given civil date (proleptic Gregorian).
+std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = static_cast<unsigned>(y - era * 400);
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+bool lower_equals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && ascii_istarts_with(a, 0, b);
+}
+
+int month_index(std::string_view name) {
+  static const char* months[] = {"jan", "feb", "mar", "apr", "may", "jun",
+                                 "jul", "aug", "sep", "oct", "nov", "dec"};
+  if (name.size() < 3) return 0;
+  for (int i = 0; i < 12; ++i)
+    if (lower_equals(name.substr(0, 3), months[i])) return i + 1;
+  return 0;
+}
+
+bool read_int(std::string_view s, std::size_t& pos, std::size_t max_digits, int& out) {
+  std::size_t start = pos;
+  out = 0;
+  while (pos < s.size() && pos - start < max_digits && std::isdigit(static_cast<unsigned char>(s[pos])))
+    out = out * 10 + (s[pos++] - '0');
+  return pos > start;
+}
+
+bool all_digits(std::string_view s) {
+  if (s.empty()) return false;
+  for (char c : s)
+    if (!std::isdigit(static_cast<unsigned char>(c))) return false;
+  return true;
+}
+
+// "+0300", "-07:00", "Z", "GMT", "EST"...; unknown military letters count
+// as UTC, as RFC 2822 asks.
+bool zone_offset(std::string_view z, int& seconds) {
+  seconds = 0;
+  if (z.empty()) return true;
+  if (z[0] == '+' || z[0] == '-') {
+    std::string digits;
+    for (char c : z.substr(1))
+      if (c != ':') digits += c;
+    if (digits.size() != 4 || !all_digits(digits)) return false;
+    int value = ((digits[0] - '0') * 10 + (digits[1] - '0')) * 3600 +
+                ((digits[2] - '0') * 10 + (digits[3] - '0')) * 60;
+    seconds = z[0] == '-' ? -value : value;
+    return true;
+  }
+  struct named { const char* name; int hours; };
+  static const named zones[] = {{"ut", 0}, {"utc", 0}, {"gmt", 0}, {"z", 0},
+                                {"est", -5}, {"edt", -4}, {"cst", -6}, {"cdt", -5},
+                                {"mst", -7}, {"mdt", -6}, {"pst", -8}, {"pdt", -7}};
+  for (const auto& zone : zones) {
+    if (lower_equals(z, zone.name)) {
+      seconds = zone.hours * 3600;
+      return true;
+    }
+  }
+  return z.size() == 1 && std::isalpha(static_cast<unsigned char>(z[0]));
+}
+
+std::int64_t to_epoch(int year, int month, int day, int hour, int minute, int second, int offset) {
+  if (year < 1970 || year > 9999 || month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour > 23 || minute > 59 || second > 60)
+    return 0;
+  std::int64_t epoch = days_from_civil(year, static_cast<unsigned>(month), static_cast<unsigned>(day)) * 86400 +
+                       hour * 3600 + minute * 60 + second - offset;
+  return epoch > 0 ? epoch : 0;
+}
+
+// 2026-05-05, 2026-05-05T09:00, 2026-05-05 09:00:00.123+03:00
+std::int64_t parse_iso(std::string_view s) {
+  std::size_t pos = 0;
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  if (!read_int(s, pos, 4, year) || pos != 4 || pos >= s.size() || s[pos++] != '-') return 0;
+  if (!read_int(s, pos, 2, month) || pos >= s.size() || s[pos++] != '-') return 0;
+  if (!read_int(s, pos, 2, day)) return 0;
+  int offset = 0;
+  if (pos < s.size() && (s[pos] == 'T' || s[pos] == 't' || s[pos] == ' ')) {
+    ++pos;
+    if (!read_int(s, pos, 2, hour) || pos >= s.size() || s[pos++] != ':') return 0;
+    if (!read_int(s, pos, 2, minute)) return 0;
+    if (pos < s.size() && s[pos] == ':') {
+      ++pos;
+      if (!read_int(s, pos, 2, second)) return 0;
+    }
+    if (pos < s.size() && (s[pos] == '.' || s[pos] == ',')) {
+      ++pos;
+      while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) ++pos;
+    }
+    std::string_view zone = s.substr(pos);
+    while (!zone.empty() && zone.front() == ' ') zone.remove_prefix(1);
+    if (!zone_offset(zone, offset)) return 0;
+  } else if (pos != s.size()) {
+    return 0;
+  }
+  return to_epoch(year, month, day, hour, minute, second, offset);
+}
+
+}
+
+
+std::int64_t parse_mail_date(std::string_view text) {
+  std::string cleaned;
+  cleaned.reserve(text.size());
+  int depth = 0;
+  for (char c : text) {
+    if (c == '(') ++depth;
+    else if (c == ')' && depth > 0) --depth;
+    else if (depth == 0) cleaned += c;
+  }
+  std::size_t first = cleaned.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) return 0;
+  std::size_t last = cleaned.find_last_not_of(" \t\r\n");
+  std::string_view s(cleaned.data() + first, last - first + 1);
+
+  if (s.size() >= 10 && all_digits(s.substr(0, 4)) && s[4] == '-') return parse_iso(s);
+
+  std::vector<std::string_view> tokens;
+  std::size_t pos = 0;
+  while (pos < s.size()) {
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == ',' || s[pos] == '\r' || s[pos] == '\n')) ++pos;
+    std::size_t start = pos;
+    while (pos < s.size() && s[pos] != ' ' && s[pos] != '\t' && s[pos] != ',' && s[pos] != '\r' && s[pos] != '\n') ++pos;
+    if (pos > start) tokens.push_back(s.substr(start, pos - start));
+  }
+
+  std::size_t i = 0;
+  if (i < tokens.size() && std::isalpha(static_cast<unsigned char>(tokens[i][0])) && month_index(tokens[i]) == 0) ++i;
+
+  std::array<std::string_view, 3> ymd;
+  if (i < tokens.size() && tokens[i].find('-') != std::string_view::npos) {
+    std::string_view dmy = tokens[i++];
+    std::size_t a = dmy.find('-');
+    std::size_t b = dmy.find('-', a + 1);
+    if (b == std::string_view::npos) return 0;
+    ymd = {dmy.substr(0, a), dmy.substr(a + 1, b - a - 1), dmy.substr(b + 1)};
+  } else {
+    if (i + 3 > tokens.size()) return 0;
+    ymd = {tokens[i], tokens[i + 1], tokens[i + 2]};
+    i += 3;
+  }
+  if (!all_digits(ymd[0]) || !all_digits(ymd[2]) || ymd[0].size() > 2 || ymd[2].size() > 4) return 0;
+  int day = std::stoi(std::string(ymd[0]));
+  int month = month_index(ymd[1]);
+  int year = std::stoi(std::string(ymd[2]));
+  if (ymd[2].size() <= 2) year += year < 50 ? 2000 : 1900;
+  else if (ymd[2].size() == 3) year += 1900;
+
+  int hour = 0, minute = 0, second = 0;
+  if (i < tokens.size()) {
+    std::string_view t = tokens[i++];
+    std::size_t p = 0;
+    if (!read_int(t, p, 2, hour) || p >= t.size() || t[p++] != ':' || !read_int(t, p, 2, minute)) return 0;
+    if (p < t.size() && t[p] == ':') {
+      ++p;
+      if (!read_int(t, p, 2, second)) return 0;
+    }
+    if (p != t.size()) return 0;
+  }
+  int offset = 0;
+  if (i < tokens.size() && !zone_offset(tokens[i], offset)) return 0;
+  return to_epoch(year, month, day, hour, minute, second, offset);
+}
+
+std::string format_epoch_iso(std::int64_t epoch) {
+  std::int64_t days = epoch >= 0 ? epoch / 86400 : (epoch - 86399) / 86400;
+  std::int64_t rem = epoch - days * 86400;
+  std::int64_t z = days + 719468;
+  std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = static_cast<unsigned>(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  std::int64_t y = static_cast<std::int64_t>(yoe) + era * 400 + (m <= 2);
+  int year = static_cast<int>(std::min<std::int64_t>(std::max<std::int64_t>(y, 0), 9999));
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%04d-%02u-%02uT%02d:%02d:%02dZ", year, m, d,
+                static_cast<int>(rem / 3600), static_cast<int>(rem % 3600 / 60), static_cast<int>(rem % 60));
+  return buf;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+// Seconds since the Unix epoch for an RFC 2822 Date header
+// ("Tue, 5 May 2026 09:00:00 +0300", obsolete zone names and two-digit
+// years included), an IMAP INTERNALDATE ("05-May-2026 09:00:00 +0300") or
+// an ISO 8601 date/date-time. Returns 0 when the text is not a date.
+std::int64_t parse_mail_date(std::string_view text);
+
+// "2026-05-05T06:00:00Z"
+std::string format_epoch_iso(std::int64_t epoch);
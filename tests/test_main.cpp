@@ -4,13 +4,32 @@
 #include "app/EmailDecisionEngine.h"
 #include "domain/EmailAnalysis.h"
 #include "domain/Message.h"
+#include "domain/RuleEngine.h"
+#include "infra/EventRing.h"
+#include "infra/HtmlText.h"
 #include "infra/ImapParse.h"
+#include "infra/LinkScan.h"
 #include "infra/LlmClient.h"
+#include "infra/MimeParse.h"
 #include "infra/Storage.h"
+#include "infra/TransferDecode.h"
+#include "util/CaseFold.h"
+#include "util/MailDate.h"
 
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 
@@ -167,6 +186,29 @@ static void test_noop_llm_client() {
     auto a = client->analyze_email(m);
     EXPECT(true);
   }
+
+
+  {
+    message m = make_msg("office@example.org", "\xD0\xAD\xD0\x9A\xD0\x97\xD0\x90\xD0\x9C\xD0\x95\xD0\x9D 12.06", "");
+    auto a = client->analyze_email(m);
+    EXPECT(a.category == email_category::academic);
+    EXPECT(a.reasons.size() == 1 && a.reasons[0] == "academic_keyword");
+
+    message urgent = make_msg("boss@example.org", "Reply ASAP", "");
+    EXPECT(client->analyze_email(urgent).reasons == std::vector<std::string>{"urgency_keyword"});
+  }
+
+
+  {
+    llm_config cfg;
+    cfg.keyword_groups["urgency"] = {"\xD0\x93\xD0\x9E\xD0\xA0\xD0\x98\xD0\xA2"};
+    auto custom = make_noop_llm_client(cfg);
+    message m = make_msg("boss@example.org", "\xD0\xB3\xD0\xBE\xD1\x80\xD0\xB8\xD1\x82 \xD1\x81\xD1\x80\xD0\xBE\xD0\xBA", "");
+    EXPECT(custom->analyze_email(m).reasons == std::vector<std::string>{"urgency_keyword"});
+    message urgent = make_msg("boss@example.org", "Reply ASAP", "");
+    EXPECT(custom->analyze_email(urgent).kind == message_kind::ignored);
+    EXPECT(client->analyze_email(m).kind == message_kind::ignored);
+  }
 }
 
 
@@ -216,6 +258,50 @@ static void test_sqlite_storage() {
   f.status = "all";
   auto list = store->list_emails(f, 10, 0);
   EXPECT(list.size() >= 1);
+  EXPECT(!list.empty() && list.front().body_text.empty() && list.front().subject == email.subject);
+
+  std::unique_ptr<storage> paged(make_sqlite_storage(":memory:", &err));
+  for (int i = 0; i < 7; ++i) {
+    stored_email p = email;
+    p.uid = std::to_string(500 + i);
+    p.date_iso = i < 3 ? "2026-05-01T09:00:00Z" : "2026-05-0" + std::to_string(i) + "T09:00:00Z";
+    paged->save_email_message(p);
+  }
+  email_list_filter cursor;
+  cursor.status = "unread";
+  std::vector<std::string> walked;
+  for (int pages = 0; pages < 10; ++pages) {
+    auto rows = paged->list_emails(cursor, 3, 0);
+    for (const auto& r : rows) walked.push_back(r.date_iso + r.id);
+    if (rows.size() < 3) break;
+    cursor.before_id = rows.back().id;
+  }
+  EXPECT(walked.size() == 7);
+  EXPECT(std::is_sorted(walked.rbegin(), walked.rend()));
+  EXPECT(std::adjacent_find(walked.begin(), walked.end()) == walked.end());
+  cursor.before_id = "email_missing";
+  EXPECT(paged->list_emails(cursor, 3, 0).empty());
+
+  std::unique_ptr<storage> dated(make_sqlite_storage(":memory:", &err));
+  const char* dates[] = {"Wed, 6 May 2026 08:00:00 +0000", "Tue, 5 May 2026 09:00:00 +0000",
+                         "Thu, 7 May 2026 07:00:00 +0000", "not a date"};
+  for (int i = 0; i < 4; ++i) {
+    stored_email d = email;
+    d.uid = std::to_string(600 + i);
+    d.date_iso = dates[i];
+    d.created_at = "2026-05-01T00:00:00Z";
+    dated->save_email_message(d);
+  }
+  email_list_filter by_time;
+  by_time.status = "all";
+  auto newest = dated->list_emails(by_time, 10, 0);
+  EXPECT(newest.size() == 4);
+  EXPECT(newest.size() == 4 && newest[0].uid == "602" && newest[1].uid == "600" && newest[2].uid == "601");
+  EXPECT(newest.size() == 4 && newest[3].received_at == parse_mail_date("2026-05-01T00:00:00Z"));
+  by_time.since = parse_mail_date("2026-05-05T12:00:00Z");
+  by_time.until = parse_mail_date("2026-05-07T00:00:00Z");
+  auto window = dated->list_emails(by_time, 10, 0);
+  EXPECT(window.size() == 1 && window.front().uid == "600");
 
 
   auto results = store->search_emails("exam", 10, 0);
@@ -257,6 +343,13 @@ static void test_sqlite_storage() {
   store->mark_processed(m, "archived");
   EXPECT(store->is_processed("inbox", "100"));
   EXPECT(store->processed_count() >= 1);
+  m.uid = "103";
+  store->mark_processed(m, "processed");
+  auto fresh_uids = store->filter_unprocessed("inbox", {"104", "100", "101", "103", "102"});
+  EXPECT((fresh_uids == std::vector<std::string>{"104", "101", "102"}));
+  EXPECT(store->filter_unprocessed("other", {"100"}).empty());
+  EXPECT(store->filter_unprocessed("inbox", {}).empty());
+  EXPECT(store->filter_unprocessed("inbox", {"a\"b", "101"}).size() == 2);
 
 
   std::string token = store->save_telegram_callback_token(
@@ -310,6 +403,200 @@ static void test_sqlite_storage() {
   EXPECT(events[0].type == "test_event" || events.back().type == "test_event");
 
 
+  {
+    event_ring ring(4);
+    for (int i = 0; i < 6; ++i) {
+      event_record e;
+      e.type = "ring_" + std::to_string(i);
+      ring.push(e);
+    }
+    auto newest = ring.last(10);
+    EXPECT(newest.size() == 4);
+    EXPECT(newest.front().id == 6 && newest.front().type == "ring_5");
+    EXPECT(newest.back().id == 3);
+    EXPECT(ring.size() == 4 && ring.oldest_id() == 3);
+
+    event_ring seeded(8);
+    seeded.restore(newest);
+    EXPECT(seeded.size() == 4);
+    EXPECT(seeded.push(event_record{}).id == 7);
+    EXPECT(seeded.last(2).back().type == "ring_5");
+    auto tail = seeded.since(5);
+    EXPECT(tail.size() == 2 && tail.front().id == 6 && tail.back().id == 7);
+    EXPECT(seeded.since(seeded.newest_id()).empty());
+  }
+
+
+  {
+    std::string path = (std::filesystem::temp_directory_path() / "ctl_test_events.db").string();
+    std::filesystem::remove(path);
+    {
+      std::string e2;
+      std::unique_ptr<storage> file_store(make_sqlite_storage(path, &e2));
+      EXPECT(file_store != nullptr);
+      for (int i = 1; i <= 300; ++i) {
+        event_record e;
+        e.level = "info";
+        e.type = "bulk_" + std::to_string(i);
+        file_store->append_event(e, 100);
+      }
+      auto recent = file_store->last_events(1000);
+      EXPECT(recent.size() == 100);
+      EXPECT(recent.front().type == "bulk_300" && recent.front().id == 300);
+      EXPECT(recent.back().id == 201);
+    }
+    {
+      std::string e2;
+      std::unique_ptr<storage> file_store(make_sqlite_storage(path, &e2));
+      auto reloaded = file_store->last_events(1000);
+      EXPECT(reloaded.size() == 100);
+      EXPECT(!reloaded.empty() && reloaded.front().type == "bulk_300" && reloaded.back().id == 201);
+      std::unique_ptr<storage> narrow_store(make_sqlite_storage(path, &e2, 0, 40));
+      EXPECT(narrow_store != nullptr && narrow_store->last_events(1000).size() == 40);
+      narrow_store.reset();
+      event_record e;
+      e.type = "after_reopen";
+      file_store->append_event(e, 100);
+      file_store->flush_events();
+      EXPECT(file_store->last_events(1).front().id == 301);
+
+      std::string saved = file_store->save_email_message(email);
+      auto via_reader = file_store->get_email_message(saved);
+      EXPECT(via_reader.has_value() && via_reader->subject == email.subject);
+      file_store->mark_email_read(saved);
+      auto reread = file_store->get_email_message(saved);
+      EXPECT(reread.has_value() && !reread->read_at.empty());
+      EXPECT(std::filesystem::exists(path + "-wal"));
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + "-wal");
+    std::filesystem::remove(path + "-shm");
+  }
+
+
+  {
+    std::string path = (std::filesystem::temp_directory_path() / "ctl_test_batch.db").string();
+    std::filesystem::remove(path);
+    std::string e2;
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &e2));
+    EXPECT(file_store != nullptr);
+    sqlite3* outside = nullptr;
+    sqlite3_open(path.c_str(), &outside);
+    auto committed_emails = [&]() {
+      int count = -1;
+      sqlite3_stmt* stmt = nullptr;
+      if (sqlite3_prepare_v2(outside, "SELECT COUNT(*) FROM email_message;", -1, &stmt, nullptr) == SQLITE_OK &&
+          sqlite3_step(stmt) == SQLITE_ROW)
+        count = sqlite3_column_int(stmt, 0);
+      sqlite3_finalize(stmt);
+      return count;
+    };
+
+    mailbox_checkpoint batch_cp;
+    batch_cp.mailbox_id = "batch";
+    batch_cp.last_seen_uid = 10;
+    {
+      std::optional<storage_batch> batch;
+      batch.emplace(*file_store);
+      stored_email first = email;
+      first.mailbox_id = "batch";
+      first.uid = "11";
+      std::string first_id = file_store->save_email_message(first);
+      message processed_msg;
+      processed_msg.mailbox_id = "batch";
+      processed_msg.uid = "11";
+      file_store->mark_processed(processed_msg, "processed");
+      {
+        storage_batch nested(*file_store);
+        stored_email second = first;
+        second.uid = "12";
+        file_store->save_email_message(second);
+      }
+      event_record e;
+      e.type = "inside_batch";
+      file_store->append_event(e, 100);
+      file_store->flush_events();
+      EXPECT(file_store->is_processed("batch", "11"));
+      EXPECT(file_store->get_email_message(first_id).has_value());
+      EXPECT(file_store->set_emails_read_by_uid("batch", {"11"}, true) == 1);
+      EXPECT(committed_emails() == 0);
+
+      std::atomic<bool> other_saw_uncommitted{true};
+      std::atomic<bool> other_wrote{false};
+      std::thread other([&]() {
+        other_saw_uncommitted = file_store->get_email_message(first_id).has_value();
+        batch_cp.last_seen_uid = 12;
+        file_store->save_checkpoint(batch_cp);
+        other_wrote = true;
+      });
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      EXPECT(!other_wrote);
+      EXPECT(!other_saw_uncommitted);
+      stored_email third = first;
+      third.uid = "13";
+      file_store->save_email_message(third);
+      EXPECT(committed_emails() == 0);
+      batch.reset();
+      other.join();
+      EXPECT(other_wrote);
+      EXPECT(committed_emails() == 3);
+    }
+    EXPECT(committed_emails() == 3);
+    auto batch_loaded = file_store->load_checkpoint("batch");
+    EXPECT(batch_loaded.has_value() && batch_loaded->last_seen_uid == 12);
+
+    auto committed_processed = [&]() {
+      int count = -1;
+      sqlite3_stmt* stmt = nullptr;
+      if (sqlite3_prepare_v2(outside, "SELECT COUNT(*) FROM processed_message WHERE mailbox_id='batch';",
+                             -1, &stmt, nullptr) == SQLITE_OK &&
+          sqlite3_step(stmt) == SQLITE_ROW)
+        count = sqlite3_column_int(stmt, 0);
+      sqlite3_finalize(stmt);
+      return count;
+    };
+    int processed_before = committed_processed();
+    std::string fourth_id;
+    {
+      storage_deferral deferred(*file_store);
+      stored_email fourth = email;
+      fourth.mailbox_id = "batch";
+      fourth.uid = "14";
+      fourth_id = file_store->save_email_message(fourth);
+      file_store->update_email_classification(fourth_id, "{}", "high", 0.9, "other", "new");
+      file_store->update_email_classification(fourth_id, "{}", "high", 0.9, "other", "important_notified");
+      message fourth_msg;
+      fourth_msg.mailbox_id = "batch";
+      fourth_msg.uid = "14";
+      file_store->mark_processed(fourth_msg, "important_notified");
+      EXPECT(file_store->is_processed("batch", "14"));
+      auto queued = file_store->get_email_message(fourth_id);
+      EXPECT(queued && queued->importance_level == "high" && queued->status == "important_notified");
+      EXPECT(committed_processed() == processed_before);
+
+      std::atomic<bool> other_saw_processed{true};
+      std::thread other([&]() { other_saw_processed = file_store->is_processed("batch", "14"); });
+      other.join();
+      EXPECT(!other_saw_processed);
+
+      storage_batch batch(*file_store);
+      deferred.flush();
+      batch_cp.last_seen_uid = 14;
+      file_store->save_checkpoint(batch_cp);
+      EXPECT(committed_processed() == processed_before);
+    }
+    EXPECT(committed_processed() == processed_before + 1);
+    auto flushed = file_store->get_email_message(fourth_id);
+    EXPECT(flushed && flushed->importance_level == "high" && flushed->status == "important_notified");
+    EXPECT(file_store->load_checkpoint("batch")->last_seen_uid == 14);
+    sqlite3_close(outside);
+    file_store.reset();
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + "-wal");
+    std::filesystem::remove(path + "-shm");
+  }
+
+
   mailbox_checkpoint cp;
   cp.mailbox_id = "inbox";
   cp.last_seen_uid = 100;
@@ -319,6 +606,54 @@ static void test_sqlite_storage() {
   EXPECT(loaded_cp.has_value());
   EXPECT(loaded_cp->last_seen_uid == 100);
   EXPECT(loaded_cp->uid_validity == "12345");
+  EXPECT(loaded_cp->highest_modseq == 0);
+
+  cp.highest_modseq = 987654321012ULL;
+  store->save_checkpoint(cp);
+  auto modseq_cp = store->load_checkpoint("inbox");
+  EXPECT(modseq_cp.has_value() && modseq_cp->highest_modseq == 987654321012ULL);
+
+  mailbox_checkpoint fresh;
+  fresh.mailbox_id = "backfill";
+  fresh.last_seen_uid = 4200;
+  fresh.backfill_until_uid = 4200;
+  fresh.started_at = "2026-01-01T00:00:00Z";
+  fresh.updated_at = fresh.started_at;
+  store->save_checkpoint(fresh);
+  fresh.backfill_until_uid = 0;
+  fresh.last_seen_uid = 4210;
+  store->save_checkpoint(fresh);
+  auto backfill_cp = store->load_checkpoint("backfill");
+  EXPECT(backfill_cp.has_value() && backfill_cp->last_seen_uid == 4210);
+  EXPECT(backfill_cp.has_value() && backfill_cp->backfill_until_uid == 4200);
+  store->set_checkpoint_backfill("backfill", 0);
+  auto backfill_done = store->load_checkpoint("backfill");
+  EXPECT(backfill_done.has_value() && backfill_done->backfill_until_uid == 0);
+
+
+  stored_email synced = email;
+  synced.uid = "200";
+  synced.message_id = "<sync@test>";
+  std::string synced_id = store->save_email_message(synced);
+  EXPECT(store->set_emails_read_by_uid("inbox", {"200", "999"}, true) == 1);
+  EXPECT(store->set_emails_read_by_uid("inbox", {"200"}, true) == 0);
+  auto after_seen = store->get_email_message(synced_id);
+  EXPECT(after_seen.has_value() && !after_seen->read_at.empty());
+  EXPECT(store->set_emails_read_by_uid("inbox", {"200"}, false) == 1);
+  auto after_unseen = store->get_email_message(synced_id);
+  EXPECT(after_unseen.has_value() && after_unseen->read_at.empty());
+  stored_email local = synced;
+  local.uid = "201";
+  local.message_id = "<local@test>";
+  std::string local_id = store->save_email_message(local);
+  store->mark_email_read(local_id);
+  EXPECT(store->set_emails_read_by_uid("inbox", {"201"}, false) == 0);
+  auto local_after = store->get_email_message(local_id);
+  EXPECT(local_after.has_value() && !local_after->read_at.empty());
+  EXPECT(store->archive_emails_by_uid("other", {"200"}) == 0);
+  EXPECT(store->archive_emails_by_uid("inbox", {"200"}) == 1);
+  auto after_expunge = store->get_email_message(synced_id);
+  EXPECT(after_expunge.has_value() && after_expunge->status == "archived");
 
 
   store->set_runtime_value("test_key", "test_value");
@@ -327,6 +662,148 @@ static void test_sqlite_storage() {
 }
 
 
+static void test_email_search() {
+  begin_suite("EmailSearch");
+
+  std::string err;
+  std::unique_ptr<storage> store(make_sqlite_storage(":memory:", &err));
+  EXPECT(store != nullptr);
+  if (!store) return;
+
+  auto save = [&](const std::string& uid, const std::string& subject, const std::string& body,
+                  const std::string& date) {
+    stored_email e;
+    e.mailbox_id = "inbox";
+    e.uid = uid;
+    e.from_addr = "Деканат <dean@hse.ru>";
+    e.subject = subject;
+    e.date_iso = date;
+    e.snippet = body.substr(0, 40);
+    e.body_text = body;
+    return store->save_email_message(e);
+  };
+
+  std::string exam = save("1", "Расписание ЭКЗАМЕНОВ", "Экзамен по алгебре в понедельник.", "2026-05-01T09:00:00Z");
+  std::string body_only = save("2", "Новости недели", "Напоминаем: экзамены перенесены.", "2026-05-03T09:00:00Z");
+  save("3", "Ёлка в холле", "Праздник для студентов.", "2026-05-02T09:00:00Z");
+
+  auto ranked = store->search_emails("экзамен", 10, 0);
+  EXPECT(ranked.size() == 2);
+  EXPECT(!ranked.empty() && ranked.front().id == exam);
+  EXPECT(!ranked.empty() && ranked.front().match_highlight.find("[") != std::string::npos);
+
+  auto both_words = store->search_emails("экзамены перенесены", 10, 0);
+  EXPECT(both_words.size() == 1 && both_words.front().id == body_only);
+
+  EXPECT(store->search_emails("ЕЛКА", 10, 0).size() == 1);
+  EXPECT(store->search_emails("ёлк", 10, 0).size() == 1);
+  EXPECT(store->search_emails("dean hse", 10, 0).size() == 3);
+  EXPECT(store->search_emails("\"AND (* NEAR", 10, 0).empty());
+  EXPECT(store->search_emails("!!!", 10, 0).empty());
+
+  stored_email linked;
+  linked.mailbox_id = "inbox";
+  linked.uid = "4";
+  linked.subject = "Form";
+  linked.links_json = "[{\"url\":\"https://forms.yandex.ru/u/1\",\"domain\":\"forms.yandex.ru\"}]";
+  linked.attachments_json = "[{\"filename\":\"zayavlenie.pdf\",\"mime_type\":\"application/pdf\"}]";
+  std::string linked_id = store->save_email_message(linked);
+  auto by_domain = store->search_emails("yandex", 10, 0);
+  EXPECT(by_domain.size() == 1 && by_domain.front().id == linked_id);
+  EXPECT(store->search_emails("zayavlenie", 10, 0).size() == 1);
+
+  linked.subject = "Renamed";
+  linked.links_json = "[]";
+  store->save_email_message(linked);
+  EXPECT(store->search_emails("yandex", 10, 0).empty());
+  EXPECT(store->search_emails("renamed", 10, 0).size() == 1);
+
+  EXPECT(store->search_emails("экзамен", 1, 1).size() == 1);
+
+  std::string path = (std::filesystem::temp_directory_path() / "ctl_test_fts.db").string();
+  std::filesystem::remove(path);
+  {
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &err));
+    stored_email old_mail;
+    old_mail.mailbox_id = "inbox";
+    old_mail.uid = "1";
+    old_mail.subject = "Стипендия за май";
+    file_store->save_email_message(old_mail);
+  }
+  sqlite3* raw = nullptr;
+  sqlite3_open(path.c_str(), &raw);
+  sqlite3_exec(raw, "DROP TABLE email_fts;", nullptr, nullptr, nullptr);
+  sqlite3_close(raw);
+  {
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &err));
+    EXPECT(file_store->search_emails("стипендия", 10, 0).size() == 1);
+    stored_email other_mail;
+    other_mail.mailbox_id = "inbox";
+    other_mail.uid = "2";
+    other_mail.subject = "Общежитие";
+    file_store->save_email_message(other_mail);
+  }
+  sqlite3_open(path.c_str(), &raw);
+  sqlite3_exec(raw, "UPDATE email_message SET rowid=rowid+1000 WHERE uid='1';"
+                    "UPDATE email_message SET rowid=1 WHERE uid='2';", nullptr, nullptr, nullptr);
+  sqlite3_close(raw);
+  {
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &err));
+    auto renumbered = file_store->search_emails("стипендия", 10, 0);
+    EXPECT(renumbered.size() == 1 && renumbered.front().uid == "1");
+    stored_email renamed;
+    renamed.mailbox_id = "inbox";
+    renamed.uid = "1";
+    renamed.subject = "Стипендия за июнь";
+    file_store->save_email_message(renamed);
+    EXPECT(file_store->search_emails("стипендия", 10, 0).size() == 1);
+    EXPECT(file_store->search_emails("июнь", 10, 0).size() == 1);
+    EXPECT(file_store->search_emails("май", 10, 0).empty());
+    EXPECT(file_store->search_emails("общежитие", 10, 0).size() == 1);
+  }
+  sqlite3_open(path.c_str(), &raw);
+  sqlite3_exec(raw, "DROP TABLE email_fts;"
+                    "CREATE VIRTUAL TABLE email_fts USING fts5(subject, sender, snippet, body,"
+                    " link_domains, attachment_names);", nullptr, nullptr, nullptr);
+  sqlite3_close(raw);
+  {
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &err));
+    auto rebuilt = file_store->search_emails("июнь", 10, 0);
+    EXPECT(rebuilt.size() == 1 && rebuilt.front().uid == "1");
+  }
+  std::filesystem::remove(path);
+  std::filesystem::remove(path + "-wal");
+  std::filesystem::remove(path + "-shm");
+
+  sqlite3_open(path.c_str(), &raw);
+  sqlite3_exec(raw,
+      "CREATE TABLE email_message (id TEXT PRIMARY KEY, mailbox_id TEXT NOT NULL, uid TEXT NOT NULL,"
+      " message_id TEXT, from_addr TEXT, to_addr TEXT, subject TEXT, date_iso TEXT, snippet TEXT,"
+      " body_text TEXT, links_json TEXT NOT NULL DEFAULT '[]', attachments_json TEXT NOT NULL DEFAULT '[]',"
+      " classification_json TEXT NOT NULL DEFAULT '{}', importance_level TEXT NOT NULL DEFAULT 'low',"
+      " importance_score REAL NOT NULL DEFAULT 0.0, category TEXT NOT NULL DEFAULT 'other',"
+      " status TEXT NOT NULL DEFAULT 'new', read_at TEXT, archived_at TEXT, muted_until TEXT,"
+      " created_at TEXT NOT NULL, updated_at TEXT NOT NULL, UNIQUE(mailbox_id, uid));"
+      "INSERT INTO email_message (id,mailbox_id,uid,subject,date_iso,created_at,updated_at) VALUES"
+      " ('old_1','inbox','1','Tuesday','Tue, 5 May 2026 09:00:00 +0000','x','x'),"
+      " ('old_2','inbox','2','Wednesday','Wed, 6 May 2026 09:00:00 +0000','x','x');",
+      nullptr, nullptr, nullptr);
+  sqlite3_close(raw);
+  {
+    std::unique_ptr<storage> file_store(make_sqlite_storage(path, &err));
+    EXPECT(file_store != nullptr && err.empty());
+    email_list_filter all;
+    all.status = "all";
+    auto migrated = file_store->list_emails(all, 10, 0);
+    EXPECT(migrated.size() == 2 && migrated[0].id == "old_2" && migrated[1].id == "old_1");
+    EXPECT(!migrated.empty() && migrated[0].received_at == parse_mail_date("Wed, 6 May 2026 09:00:00 +0000"));
+    EXPECT(file_store->search_emails("wednesday", 10, 0).size() == 1);
+  }
+  std::filesystem::remove(path);
+  std::filesystem::remove(path + "-wal");
+  std::filesystem::remove(path + "-shm");
+}
+
 static void test_telegram_auth_logic() {
   begin_suite("Telegram auth logic");
 
@@ -755,6 +1232,222 @@ static void test_url_based_fetch_and_incomplete_literal() {
 }
 
 
+static void test_imap_session_framing() {
+  begin_suite("IMAP session: tagged response framing");
+
+
+  {
+    std::string partial = "* 3 FETCH (UID 7 BODY[] {10}\r\nabc";
+    std::size_t end = 0;
+    std::string status;
+    EXPECT(imap_response_line_end(partial, 0) == std::string::npos);
+    EXPECT(!imap_tagged_response_end(partial, "ctl1", end, status));
+  }
+
+
+  {
+
+    std::string literal = "line\r\nctl2 OK";
+    std::string resp =
+        "* 3 FETCH (UID 7 BODY[] {" + std::to_string(literal.size()) + "}\r\n" +
+        literal + ")\r\nctl2 OK FETCH completed\r\n* 4 EXISTS\r\n";
+    std::size_t end = 0;
+    std::string status;
+    EXPECT(imap_tagged_response_end(resp, "ctl2", end, status));
+    EXPECT(status == "OK FETCH completed");
+    EXPECT(resp.substr(end) == "* 4 EXISTS\r\n");
+  }
+
+
+  {
+    std::string resp = "ctl3 NO [NONEXISTENT] Unknown mailbox\r\n";
+    std::size_t end = 0;
+    std::string status;
+    EXPECT(imap_tagged_response_end(resp, "ctl3", end, status));
+    EXPECT(status.rfind("NO", 0) == 0);
+    EXPECT(end == resp.size());
+  }
+
+
+  {
+    std::string resp =
+        "* SEARCH 12 15 200\r\n"
+        "* 1 EXISTS\r\n"
+        "ctl4 OK SEARCH completed (took 2 ms)\r\n";
+    auto uids = imap_parse_search_uids(resp);
+    EXPECT(uids.size() == 3);
+    EXPECT(!uids.empty() && uids.front() == "12");
+    EXPECT(!uids.empty() && uids.back() == "200");
+    EXPECT(imap_parse_search_uids("* SEARCH\r\nctl5 OK\r\n").empty());
+
+    auto esearch = imap_parse_search_uids("* ESEARCH (TAG \"ctl6\") UID ALL 4:6,9\r\nctl6 OK\r\n");
+    EXPECT(esearch.size() == 4);
+    EXPECT(!esearch.empty() && esearch.front() == "4" && esearch.back() == "9");
+    auto esearch_max = imap_parse_search_uids("* ESEARCH (TAG \"ctl7\") UID COUNT 3 MAX 812\r\nctl7 OK\r\n");
+    EXPECT(esearch_max.size() == 1 && esearch_max.front() == "812");
+    EXPECT(imap_parse_search_uids("* ESEARCH (TAG \"ctl8\") UID\r\nctl8 OK\r\n").empty());
+
+    std::string status_resp = "* STATUS \"INBOX\" (MESSAGES 80211 UIDNEXT 91234 UIDVALIDITY 17)\r\nctl9 OK\r\n";
+    EXPECT(imap_status_value(status_resp, "UIDNEXT") == "91234");
+    EXPECT(imap_status_value(status_resp, "MESSAGES") == "80211");
+    EXPECT(imap_status_value(status_resp, "UIDVALIDITY") == "17");
+  }
+
+
+  {
+    EXPECT(imap_is_mailbox_change("* 42 EXISTS\r\n"));
+    EXPECT(imap_is_mailbox_change("* 7 expunge"));
+    EXPECT(!imap_is_mailbox_change("* 3 RECENT\r\n"));
+    EXPECT(!imap_is_mailbox_change("* OK Still here\r\n"));
+    EXPECT(!imap_is_mailbox_change("+ idling\r\n"));
+    EXPECT(imap_has_capability("IMAP4rev1 UIDPLUS IDLE ENABLE", "IDLE"));
+    EXPECT(!imap_has_capability("IMAP4rev1 IDLEX", "IDLE"));
+  }
+
+
+  {
+    EXPECT(imap_quote_string("INBOX") == "\"INBOX\"");
+    EXPECT(imap_quote_string("a\"b\\c") == "\"a\\\"b\\\\c\"");
+  }
+}
+
+
+static void test_imap_batch_fetch_split() {
+  begin_suite("IMAP batched UID FETCH: multi-literal split");
+
+
+  {
+    auto expanded = imap_expand_uid_set("3:5,9,12:11");
+    EXPECT(expanded.size() == 6);
+    EXPECT(!expanded.empty() && expanded.front() == "3" && expanded.back() == "12");
+    EXPECT(imap_expand_uid_set("1:1000000", 10).size() == 10);
+
+    auto vanished = imap_parse_vanished(
+        "* VANISHED (EARLIER) 41,43:45\r\n* 5 FETCH (UID 7 FLAGS (\\Seen) MODSEQ (12))\r\nctl9 OK\r\n");
+    EXPECT(vanished.size() == 4);
+    EXPECT(!vanished.empty() && vanished.front() == "41");
+
+    EXPECT(imap_status_value("* STATUS \"INBOX\" (UIDVALIDITY 5 HIGHESTMODSEQ 7001)\r\n",
+                             "HIGHESTMODSEQ") == "7001");
+    EXPECT(imap_status_value("* OK [HIGHESTMODSEQ 42] ok\r\n", "highestmodseq") == "42");
+    EXPECT(imap_status_value("* STATUS INBOX (UIDVALIDITY 5)\r\n", "HIGHESTMODSEQ").empty());
+
+    EXPECT(imap_flags_contain("(\\Answered \\Seen)", "\\Seen"));
+    EXPECT(imap_flags_contain("(\\seen)", "\\Seen"));
+    EXPECT(!imap_flags_contain("(\\Flagged $Seen)", "\\Seen"));
+    EXPECT(!imap_flags_contain("()", "\\Seen"));
+  }
+
+
+  {
+    EXPECT(imap_compress_uid_set({"5", "3", "4", "9", "11", "12"}) == "3:5,9,11:12");
+    EXPECT(imap_compress_uid_set({"7"}) == "7");
+    EXPECT(imap_compress_uid_set({}).empty());
+  }
+
+
+  {
+    std::string m1 = "From: a@b.com\r\nSubject: one\r\n\r\nBody {3} one)\r\n";
+    std::string m2 = "From: c@d.com\r\nSubject: two\r\n\r\nsecond";
+    std::string resp =
+        "* 1 FETCH (UID 10 RFC822.SIZE " + std::to_string(m1.size()) +
+        " BODY[] {" + std::to_string(m1.size()) + "}\r\n" + m1 + ")\r\n"
+        "* 2 FETCH (FLAGS (\\Seen))\r\n"
+        "* 2 FETCH (UID 12 BODY[] {" + std::to_string(m2.size()) + "}\r\n" + m2 +
+        " RFC822.SIZE " + std::to_string(m2.size()) + ")\r\n"
+        "* 3 FETCH (UID 13 BODY[] NIL)\r\n"
+        "ctl7 OK FETCH completed\r\n";
+
+    auto items = imap_parse_fetch_items(resp);
+    EXPECT(items.size() == 3);
+    if (items.size() == 3) {
+      EXPECT(items[0].attrs["UID"] == "10");
+      EXPECT(items[0].attrs["BODY[]"] == m1);
+      EXPECT(items[0].attrs["RFC822.SIZE"] == std::to_string(m1.size()));
+      EXPECT(items[1].attrs["UID"] == "12");
+      EXPECT(items[1].attrs["BODY[]"] == m2);
+      EXPECT(items[1].attrs["FLAGS"] == "(\\Seen)");
+      EXPECT(items[1].attrs.count("RFC822.SIZE") == 1);
+      EXPECT(items[2].attrs["UID"] == "13");
+      EXPECT(items[2].attrs.count("BODY[]") == 0);
+    }
+  }
+
+
+  {
+    std::string resp =
+        "* 4 FETCH (UID 20 BODY[HEADER.FIELDS (FROM SUBJECT)] {9}\r\nFrom: x\r\n"
+        " ENVELOPE (NIL \"quoted ) paren\" NIL))\r\n";
+    auto items = imap_parse_fetch_items(resp);
+    EXPECT(items.size() == 1);
+    if (!items.empty()) {
+      EXPECT(items[0].attrs["BODY[HEADER.FIELDS (FROM SUBJECT)]"] == "From: x\r\n");
+      EXPECT(items[0].attrs["ENVELOPE"] == "(NIL \"quoted ) paren\" NIL)");
+    }
+  }
+}
+
+
+static void test_imap_bodystructure() {
+  begin_suite("IMAP header-first fetch: BODYSTRUCTURE parts");
+
+
+  {
+    std::string bs =
+        "((\"TEXT\" \"PLAIN\" (\"CHARSET\" \"utf-8\") NIL NIL \"QUOTED-PRINTABLE\" 120 4 NIL NIL NIL)"
+        "(\"TEXT\" \"HTML\" (\"CHARSET\" \"utf-8\") NIL NIL \"BASE64\" 400 6 NIL NIL NIL) \"ALTERNATIVE\" "
+        "(\"BOUNDARY\" \"a1\") NIL NIL)";
+    std::string mixed =
+        "(" + bs +
+        "(\"APPLICATION\" \"PDF\" (\"NAME\" \"plan.pdf\") \"<pdf1@x>\" NIL \"BASE64\" 4000 NIL "
+        "(\"ATTACHMENT\" (\"FILENAME\" \"=?UTF-8?B?0L/Qu9Cw0L0ucGRm?=\")) NIL)"
+        " \"MIXED\" (\"BOUNDARY\" \"m1\") NIL NIL)";
+
+    auto parts = imap_parse_bodystructure(mixed);
+    EXPECT(parts.size() == 3);
+    if (parts.size() == 3) {
+      EXPECT(parts[0].part_id == "1.1");
+      EXPECT(parts[0].subtype == "plain");
+      EXPECT(parts[0].encoding == "quoted-printable");
+      EXPECT(parts[0].charset == "utf-8");
+      EXPECT(parts[1].part_id == "1.2");
+      EXPECT(parts[1].subtype == "html");
+      EXPECT(parts[2].part_id == "2");
+      EXPECT(parts[2].disposition == "attachment");
+      EXPECT(parts[2].filename == "\xd0\xbf\xd0\xbb\xd0\xb0\xd0\xbd.pdf");
+      EXPECT(parts[2].size == 4000);
+    }
+
+    auto atts = imap_attachments_from_parts(parts);
+    EXPECT(atts.size() == 1);
+    if (!atts.empty()) {
+      EXPECT(atts[0].part_id == "2");
+      EXPECT(atts[0].mime_type == "application/pdf");
+      EXPECT(atts[0].size_bytes == 3000);
+      EXPECT(atts[0].content_id == "pdf1@x");
+      EXPECT(atts[0].safe_to_preview);
+    }
+  }
+
+
+  {
+    auto parts = imap_parse_bodystructure(
+        "(\"TEXT\" \"PLAIN\" (\"CHARSET\" \"us-ascii\") NIL NIL \"7BIT\" 13 1 NIL NIL NIL NIL)");
+    EXPECT(parts.size() == 1);
+    EXPECT(!parts.empty() && parts[0].part_id == "1");
+    EXPECT(imap_attachments_from_parts(parts).empty());
+    EXPECT(imap_parse_bodystructure("(\"TEXT\" \"PLAIN\"").empty());
+  }
+
+
+  {
+    EXPECT(imap_decode_part("SGVsbG8=", "BASE64") == "Hello");
+    EXPECT(imap_decode_part("a=3Db=\r\nc", "quoted-printable") == "a=bc");
+    EXPECT(imap_decode_part("plain", "7bit") == "plain");
+  }
+}
+
+
 static void test_regression_form_email_pipeline() {
   begin_suite("Regression: form email must produce form_fill decision");
 
@@ -839,10 +1532,441 @@ static void test_regression_checkpoint_logic() {
 }
 
 
+static void test_mime_parser() {
+  begin_suite("MIME parser: part tree, offsets, decoded sizes");
+
+
+  {
+    std::string raw =
+        "From: dean@uni.edu\r\n"
+        "Subject: Plan\r\n"
+        "Content-Type: multipart/mixed;\r\n boundary=\"mix\"\r\n"
+        "\r\n"
+        "preamble\r\n"
+        "--mix\r\n"
+        "Content-Type: multipart/alternative; boundary=alt\r\n"
+        "\r\n"
+        "--alt\r\n"
+        "Content-Type: text/plain; charset=\"UTF-8\"\r\n"
+        "Content-Transfer-Encoding: quoted-printable\r\n"
+        "\r\n"
+        "Fill https://forms.yandex.ru/u/abc/ =\r\n"
+        "by Friday=2E\r\n"
+        "--alt-not-a-boundary\r\n"
+        "--alt\r\n"
+        "Content-Type: text/html; charset=utf-8\r\n"
+        "Content-Transfer-Encoding: base64\r\n"
+        "\r\n"
+        "PHA+SGk8L3A+\r\n"
+        "--alt--\r\n"
+        "--mix\r\n"
+        "Content-Type: application/pdf; name=\"ignored.pdf\"\r\n"
+        "Content-Disposition: attachment; filename*=utf-8''%D0%BF%D0%BB%D0%B0%D0%BD.pdf\r\n"
+        "Content-ID: <pdf1@x>\r\n"
+        "Content-Transfer-Encoding: base64\r\n"
+        "\r\n"
+        "JVBERi0xLjQK\r\n"
+        "AAECAw==\r\n"
+        "--mix--\r\n"
+        "epilogue\r\n";
+
+    mime_tree tree = mime_parse(raw);
+    EXPECT(tree.parts.size() == 5);
+    if (tree.parts.size() == 5) {
+      EXPECT(tree.parts[0].content_type == "multipart/mixed");
+      EXPECT(tree.parts[0].boundary == "mix");
+      EXPECT(tree.parts[0].children.size() == 2);
+      EXPECT(tree.parts[1].part_id == "1" && tree.parts[1].content_type == "multipart/alternative");
+      EXPECT(tree.parts[2].part_id == "1.1" && tree.parts[2].charset == "utf-8");
+      EXPECT(tree.parts[2].encoding == "quoted-printable");
+      EXPECT(tree.parts[3].part_id == "1.2" && tree.parts[3].content_type == "text/html");
+      EXPECT(tree.parts[4].part_id == "2" && tree.parts[4].parent == 0);
+      EXPECT(raw.compare(tree.parts[3].body_offset, tree.parts[3].body_end - tree.parts[3].body_offset,
+                         "PHA+SGk8L3A+") == 0);
+      for (std::size_t i = 2; i < tree.parts.size(); ++i)
+        EXPECT(tree.parts[i].decoded_size == mime_decode_part(raw, tree.parts[i]).size());
+    }
+
+    EXPECT(mime_part_text(raw, tree, "text/plain") ==
+           "Fill https://forms.yandex.ru/u/abc/ by Friday.\r\n--alt-not-a-boundary");
+    EXPECT(mime_part_text(raw, tree, "text/html") == "<p>Hi</p>");
+
+    auto atts = mime_attachments(tree);
+    EXPECT(atts.size() == 1);
+    if (!atts.empty()) {
+      EXPECT(atts[0].part_id == "2");
+      EXPECT(atts[0].filename == "\xd0\xbf\xd0\xbb\xd0\xb0\xd0\xbd.pdf");
+      EXPECT(atts[0].mime_type == "application/pdf");
+      EXPECT(atts[0].size_bytes == 13);
+      EXPECT(atts[0].content_id == "pdf1@x");
+      EXPECT(atts[0].safe_to_preview);
+    }
+  }
+
+
+  {
+    std::string raw =
+        "Subject: single\n"
+        "Content-Transfer-Encoding: quoted-printable\n"
+        "\n"
+        "caf=C3=A9 =\n"
+        "line two=3D=\n";
+    mime_tree tree = mime_parse(raw);
+    EXPECT(tree.parts.size() == 1);
+    if (!tree.parts.empty()) {
+      EXPECT(tree.parts[0].part_id == "1");
+      EXPECT(tree.parts[0].content_type == "text/plain");
+      EXPECT(tree.parts[0].body_end == raw.size());
+      EXPECT(tree.parts[0].decoded_size == mime_decode_part(raw, tree.parts[0]).size());
+    }
+    EXPECT(mime_part_text(raw, tree, "text/plain") == "caf\xc3\xa9 line two==");
+    EXPECT(mime_attachments(tree).empty());
+  }
+
+
+  {
+    mime_tree tree = mime_parse("Subject: no body\r\nFrom: a@b.c\r\n");
+    EXPECT(tree.parts.size() == 1);
+    EXPECT(!tree.parts.empty() && tree.parts[0].headers.size() == 2);
+    EXPECT(!tree.parts.empty() && tree.parts[0].decoded_size == 0);
+  }
+
+
+  {
+    message m;
+    m.raw = std::make_shared<const std::string>("Subject: x\r\n\r\nraw body text");
+    m.raw_body_offset = 14;
+    EXPECT(message_body(m) == "raw body text");
+    EXPECT(message_text(m) == "raw body text");
+    m.body_text = "decoded";
+    EXPECT(message_text(m) == "decoded");
+    EXPECT(message_body(m) == "raw body text");
+    m.body = "explicit";
+    EXPECT(message_body(m) == "explicit");
+    message copy = m;
+    EXPECT(copy.raw.get() == m.raw.get());
+    EXPECT(snippet_from_body(message_body(m).substr(0, 4), 240) == "expl");
+  }
+}
+
+
+static void test_transfer_decode() {
+  begin_suite("Transfer decoding: base64 / quoted-printable");
+
+  EXPECT(base64_decode("SGVsbG8=") == "Hello");
+  EXPECT(base64_decode("SGVsbG8") == "Hello");
+  EXPECT(base64_decode("SGVs\r\nbG8h") == "Hello!");
+  EXPECT(base64_decode("S*G-V\tz") == "Hes");
+  EXPECT(base64_decode("SGk=SGk=") == "Hi");
+  EXPECT(base64_decode("").empty());
+  EXPECT(base64_decode("+/+/") == "\xfb\xff\xbf");
+
+
+  {
+    std::string bytes;
+    for (int i = 0; i < 3000; ++i) bytes.push_back(static_cast<char>((i * 151 + 7) & 0xFF));
+    static const char* alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    std::size_t line = 0;
+    for (std::size_t i = 0; i + 2 < bytes.size(); i += 3) {
+      unsigned v = static_cast<unsigned char>(bytes[i]) << 16 |
+                   static_cast<unsigned char>(bytes[i + 1]) << 8 |
+                   static_cast<unsigned char>(bytes[i + 2]);
+      for (int shift = 18; shift >= 0; shift -= 6) encoded.push_back(alphabet[(v >> shift) & 63]);
+      if ((line += 4) >= 76) { encoded += "\r\n"; line = 0; }
+    }
+    EXPECT(base64_decode(encoded) == bytes);
+    EXPECT(base64_decode(encoded, false) == bytes);
+    std::string unwrapped;
+    for (char c : encoded) if (c != '\r' && c != '\n') unwrapped.push_back(c);
+    EXPECT(base64_decode(unwrapped) == bytes);
+    EXPECT(base64_decode(unwrapped.substr(1)) == base64_decode(unwrapped.substr(1), false));
+    EXPECT(base64_decode(unwrapped.substr(0, 1001)) == base64_decode(unwrapped.substr(0, 1001), false));
+  }
+
+  EXPECT(quoted_printable_decode("caf=C3=A9", false) == "caf\xc3\xa9");
+  EXPECT(quoted_printable_decode("soft =\r\nbreak =\nhere", false) == "soft break here");
+  EXPECT(quoted_printable_decode("bad =ZZ and tail =", false) == "bad =ZZ and tail =");
+  EXPECT(quoted_printable_decode("tail =4", false) == "tail =4");
+  EXPECT(quoted_printable_decode("a_b=5Fc", false) == "a_b_c");
+  EXPECT(quoted_printable_decode("a_b=5Fc", true) == "a b_c");
+  EXPECT(quoted_printable_decode("", true).empty());
+  EXPECT(quoted_printable_decode("a long plain run without escapes, well past sixteen=21", false) ==
+         "a long plain run without escapes, well past sixteen!");
+}
+
+
+static void test_mail_date() {
+  begin_suite("MailDate");
+
+  EXPECT(parse_mail_date("Tue, 5 May 2026 09:00:00 +0300") == 1777960800);
+  EXPECT(parse_mail_date("5 May 2026 06:00:00 GMT") == 1777960800);
+  EXPECT(parse_mail_date("Tue, 05 May 2026 06:00 +0000 (UTC)") == 1777960800);
+  EXPECT(parse_mail_date("Mon, 4 May 2026 23:00:00 -0700") == 1777960800);
+  EXPECT(parse_mail_date("Mon, 4 May 2026 23:00:00 PDT") == 1777960800);
+  EXPECT(parse_mail_date("Tue, 5 May 26 06:00:00 Z") == 1777960800);
+  EXPECT(parse_mail_date("05-May-2026 09:00:00 +0300") == 1777960800);
+  EXPECT(parse_mail_date(" 5-May-2026 06:00:00 +0000") == 1777960800);
+  EXPECT(parse_mail_date("2026-05-05T06:00:00Z") == 1777960800);
+  EXPECT(parse_mail_date("2026-05-05T09:00:00.250+03:00") == 1777960800);
+  EXPECT(parse_mail_date("2026-05-05") == 1777939200);
+  EXPECT(parse_mail_date("") == 0);
+  EXPECT(parse_mail_date("yesterday") == 0);
+  EXPECT(parse_mail_date("Tue, 5 Foo 2026 09:00:00 +0300") == 0);
+  EXPECT(parse_mail_date("Tue, 5 May 2026 25:00:00 +0300") == 0);
+  EXPECT(format_epoch_iso(1777960800) == "2026-05-05T06:00:00Z");
+  EXPECT(format_epoch_iso(0) == "1970-01-01T00:00:00Z");
+}
+
+static void test_case_fold() {
+  begin_suite("Case folding: UTF-8 / Cyrillic / Latin-1");
+
+  EXPECT(case_fold("Hello, WORLD [@]") == "hello, world [@]");
+  EXPECT(case_fold("\xD0\x9F\xD0\xA0\xD0\x98\xD0\x92\xD0\x95\xD0\xA2 \xD0\x81\xD0\xB6") ==
+         "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82 \xD1\x91\xD0\xB6");
+  EXPECT(case_fold("\xC3\x80\xC3\x97\xC3\x96 \xC5\x81 \xC5\xB8") == "\xC3\xA0\xC3\x97\xC3\xB6 \xC5\x82 \xC3\xBF");
+  EXPECT(case_fold("\xE2\x82\xAC \x9F A\xD0") == "\xE2\x82\xAC \x9F a\xD0");
+  EXPECT(case_fold("").empty());
+  EXPECT(ascii_lower("ESEARCH \xD0\x9F") == "esearch \xD0\x9F");
+  EXPECT(ascii_lower('Q') == 'q' && ascii_lower('\xD0') == '\xD0');
+  EXPECT(ascii_istarts_with("<A HREF=x>", 3, "href"));
+  EXPECT(!ascii_istarts_with("<a hr", 3, "href"));
+  EXPECT(!ascii_istarts_with("http", 5, ""));
+  EXPECT(case_fold_isa() != nullptr);
+
+
+  {
+    const std::string upper = "\xD0\x97\xD0\x90\xD0\xA7\xD0\x81\xD0\xA2 Exam \xC3\x89T\xC3\x89 \xE2\x80\x94 ";
+    const std::string lower = "\xD0\xB7\xD0\xB0\xD1\x87\xD1\x91\xD1\x82 exam \xC3\xA9t\xC3\xA9 \xE2\x80\x94 ";
+    std::string text, expected;
+    for (int k = 0; k < 64; ++k) {
+      text += std::string(static_cast<std::size_t>(k % 37), 'Q') + upper;
+      expected += std::string(static_cast<std::size_t>(k % 37), 'q') + lower;
+    }
+    EXPECT(case_fold(text) == expected);
+
+    std::string in_place = text;
+    case_fold_in_place(in_place);
+    EXPECT(in_place == expected);
+
+    std::string appended = "prefix:";
+    case_fold_append(appended, text);
+    EXPECT(appended == "prefix:" + expected);
+
+    std::string ascii = text;
+    ascii_lower_in_place(ascii);
+    EXPECT(ascii.size() == text.size());
+    EXPECT(ascii.find("QQ") == std::string::npos);
+    EXPECT(ascii.find("\xD0\x97") != std::string::npos);
+  }
+}
+
+
+static void test_link_scan() {
+  begin_suite("Link scanner: bare URLs, href, form-link confidence");
+
+  {
+    std::string text = "See https://forms.yandex.ru/u/abc/. Also HTTP://Example.com/a?x=1&amp;y=2, "
+                       "and again https://forms.yandex.ru/u/abc/ plus http:// nothing.";
+    std::string html = "<a href = 'https://docs.google.com/forms/d/e/1/viewform?a=1&amp;b=2'>go</a>"
+                       "<a HREF=\"https://lms.hse.ru/course view\">lms</a>"
+                       "<img src=\"https://cdn.example.com/logo.png\">";
+    auto links = extract_links(text, html);
+    EXPECT(links.size() == 5);
+    if (links.size() == 5) {
+      EXPECT(links[0].url == "https://forms.yandex.ru/u/abc/");
+      EXPECT(links[0].domain == "forms.yandex.ru");
+      EXPECT(links[0].confidence == 0.95);
+      EXPECT(links[1].url == "HTTP://Example.com/a?x=1&y=2");
+      EXPECT(links[1].domain == "example.com");
+      EXPECT(links[2].url == "https://docs.google.com/forms/d/e/1/viewform?a=1&b=2");
+      EXPECT(links[2].confidence == 0.95);
+      EXPECT(links[3].url == "https://lms.hse.ru/course view");
+      EXPECT(links[3].confidence == 0.85);
+      EXPECT(links[4].domain == "cdn.example.com");
+      EXPECT(links[4].confidence == 0.2);
+    }
+  }
+
+  EXPECT(form_link_confidence("https://forms.yandex.com/admin/123") == 0.0);
+  EXPECT(form_link_confidence("https://Forms.Yandex.ru/u/1/SUCCESS") == 0.0);
+  EXPECT(form_link_confidence("https://docs.google.com/forms/d/1/closedform") == 0.0);
+  EXPECT(form_link_confidence("https://docs.google.com/document/d/1") == 0.2);
+  EXPECT(form_link_confidence("https://forms.gle/xyz") == 0.95);
+  EXPECT(form_link_confidence("https://portal.hse.ru:443/poll/7") == 0.9);
+  EXPECT(form_link_confidence("https://smartlms.hse.ru/x") == 0.85);
+  EXPECT(form_link_confidence("https://notforms.gle/x") == 0.6);
+  EXPECT(form_link_confidence("https://example.com/survey-poll") == 0.6);
+  EXPECT(url_host("https://user.Example.com:8080/path") == "user.example.com");
+  EXPECT(url_host("ftp://example.com").empty());
+  EXPECT(bare_url_length("x https://a.b/c\"d", 2) == 13);
+  EXPECT(bare_url_length("https://", 0) == 0);
+}
+
+
+static void test_html_text() {
+  begin_suite("HTML to text: streaming converter");
+
+  {
+    std::string html =
+        "<html><head><title>Notice</title>"
+        "<style type=\"text/css\">p { color: red; } a > b {}</style>"
+        "<script>var s = '</p>'; if (a < b) {}</script></head>"
+        "<body><p>Hello,&nbsp;<b>student</b>!</p>"
+        "<p>Fill   the\r\n form: <a href=\"https://forms.yandex.ru/u/1/?a=1&amp;b=2\" title='x>y'>here</a></p>"
+        "<!-- https://hidden.example.com/comment -->"
+        "<table><tr><td>A</td><td>B</td></tr></table>"
+        "Price &lt; 5&#8364; &#x41;&mdash;ok &bogus; 1 < 2<br>end</body></html>";
+    link_collector links;
+    html_text_result r = html_to_text(html, &links, 20);
+    EXPECT(r.text ==
+           "Notice\n\nHello, student!\n\nFill the form: here\n\nA B\n\n"
+           "Price < 5\xE2\x82\xAC A\xE2\x80\x94ok &bogus; 1 < 2\nend");
+    EXPECT(r.snippet == "Notice Hello, studen");
+    EXPECT(links.links.size() == 2);
+    if (links.links.size() == 2) {
+      EXPECT(links.links[0].url == "https://forms.yandex.ru/u/1/?a=1&b=2");
+      EXPECT(links.links[1].domain == "hidden.example.com");
+    }
+  }
+
+  EXPECT(strip_html_tags("<div>one</div><div>two</div>") == "one\n\ntwo");
+  EXPECT(strip_html_tags("  plain  text  ") == "plain text");
+  EXPECT(strip_html_tags("<script>never closed https://x.y").empty());
+  EXPECT(html_to_text("\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", nullptr, 3).snippet == "\xD0\x9F");
+}
+
+
+static void test_rule_engine() {
+  begin_suite("RuleEngine: compiled rule plans");
+
+  auto cond = [](const std::string& field, cond_op op, const std::string& value,
+                 std::vector<std::string> values = {}) {
+    condition c;
+    c.field = field;
+    c.op = op;
+    c.value = value;
+    c.values = std::move(values);
+    return c;
+  };
+  auto make_rule = [](const std::string& id, match_mode mode, std::vector<condition> conds) {
+    rule r;
+    r.id = id;
+    r.match = mode;
+    r.conditions = std::move(conds);
+    action a;
+    a.type = "notify";
+    a.channel = "console";
+    a.text = id;
+    r.actions.push_back(a);
+    return r;
+  };
+
+  message m = make_msg("Dean Office <dean@University.edu>", "Deadline: Exam SCHEDULE", "Upload by Friday");
+  m.raw = std::make_shared<const std::string>("Subject: x\r\n\r\nraw part body");
+  m.raw_body_offset = 14;
+  message_link link;
+  link.url = "https://forms.yandex.ru/u/1/";
+  link.domain = "Forms.Yandex.RU";
+  m.links.push_back(link);
+  attachment att;
+  att.filename = "plan.pdf";
+  att.size_bytes = 2048;
+  m.attachments.push_back(att);
+
+  std::vector<rule> rules;
+  rules.push_back(make_rule("ci", match_mode::all, {cond("subject", cond_op::contains_i, "exam schedule"),
+                                                    cond("from", cond_op::contains, "dean@")}));
+  rules.push_back(make_rule("any_i", match_mode::any, {cond("body", cond_op::contains_any_i, "", {"NOPE", "PART BODY"})}));
+  rules.push_back(make_rule("regex_i", match_mode::all, {cond("subject", cond_op::regex_i, "^deadline:\\s+exam")}));
+  rules.push_back(make_rule("bad_regex", match_mode::any, {cond("subject", cond_op::regex, "([")}));
+  rules.push_back(make_rule("domain", match_mode::all, {cond("links.domain", cond_op::domain_in, "", {"YANDEX.ru"})}));
+  rules.push_back(make_rule("size", match_mode::all, {cond("attachments.size_bytes", cond_op::equals, "2048"),
+                                                      cond("labels", cond_op::not_contains, "spam")}));
+  rules.push_back(make_rule("miss", match_mode::all, {cond("subject", cond_op::contains, "exam schedule")}));
+  rules.push_back(make_rule("unknown_field", match_mode::any, {cond("x-header", cond_op::exists, "")}));
+  rules.push_back(make_rule("empty", match_mode::any, {}));
+  rule disabled = make_rule("disabled", match_mode::any, {cond("subject", cond_op::exists, "")});
+  disabled.enabled = false;
+  rules.push_back(disabled);
+
+  auto plan = compile_rules(rules);
+  EXPECT(plan->rules.size() == rules.size());
+  EXPECT(plan->compiled.size() == 8);
+  EXPECT(plan->errors.size() == 1);
+
+  rule_engine engine;
+  EXPECT(engine.plan()->compiled.empty());
+  engine.load(plan);
+  EXPECT(engine.plan().get() == plan.get());
+
+  match_result res = engine.apply(m, *engine.plan());
+  EXPECT(res.matched);
+  EXPECT((res.matched_rule_ids == std::vector<std::string>{"ci", "any_i", "regex_i", "domain", "size"}));
+  EXPECT(res.actions.size() == 5);
+
+  match_result legacy = engine.apply(m, rules);
+  EXPECT(legacy.matched_rule_ids == res.matched_rule_ids);
+
+  message other = make_msg("noreply@shop.com", "Sale");
+  EXPECT(!engine.apply(other, *plan).matched);
+
+  auto direct = compile_rules(rules, false);
+  EXPECT(direct->matchers.empty());
+  EXPECT(!plan->matchers.empty());
+  EXPECT(engine.apply(m, *direct).matched_rule_ids == res.matched_rule_ids);
+
+  EXPECT(plan->stats_for(0).evaluations.load() == 2);
+  EXPECT(plan->stats_for(0).hits.load() == 1);
+  EXPECT(plan->stats_for(0, 0).evaluations.load() == 2);
+  EXPECT(plan->stats_for(0, 0).hits.load() == 1);
+  EXPECT(plan->stats_for(0, 1).evaluations.load() == 1);
+  EXPECT(plan->stats_for(6).evaluations.load() == 2);
+  EXPECT(plan->stats_for(6).hits.load() == 0);
+  EXPECT(plan->stats_for(9).evaluations.load() == 0);
+  EXPECT(direct->stats_for(0).evaluations.load() == 1);
+
+  {
+    aho_corasick ac(true);
+    ac.add("he", 0);
+    ac.add("She", 1);
+    ac.add("hers", 2);
+    ac.add("", 3);
+    ac.build();
+    std::vector<std::pair<std::uint32_t, std::size_t>> found;
+    ac.scan("uSHERS", [&](std::uint32_t id, std::size_t end) { found.emplace_back(id, end); });
+    EXPECT((found == std::vector<std::pair<std::uint32_t, std::size_t>>{{1, 4}, {0, 4}, {2, 6}}));
+
+    aho_corasick exact;
+    exact.add("ab", 7);
+    exact.build();
+    int hits = 0;
+    exact.scan("AB xab ab", [&](std::uint32_t, std::size_t) { ++hits; });
+    EXPECT(hits == 2);
+  }
+
+
+  {
+    message ru = make_msg("office@example.org", "\xD0\x9F\xD0\x95\xD0\xA0\xD0\x95\xD0\xA1\xD0\x94\xD0\x90\xD0\xA7\xD0\x90 12.06");
+    std::vector<rule> ru_rules;
+    ru_rules.push_back(make_rule("retake", match_mode::all,
+                                 {cond("subject", cond_op::contains_i, "\xD0\x9F\xD0\xB5\xD1\x80\xD0\xB5\xD1\x81\xD0\xB4\xD0\xB0\xD1\x87")}));
+    ru_rules.push_back(make_rule("any", match_mode::all,
+                                 {cond("subject", cond_op::contains_any_i, "", {"exam", "\xD0\xBF\xD0\xB5\xD1\x80\xD0\xB5\xD1\x81\xD0\xB4\xD0\xB0\xD1\x87\xD0\xB0"})}));
+    auto multi = compile_rules(ru_rules);
+    auto single = compile_rules(ru_rules, false);
+    EXPECT((engine.apply(ru, *multi).matched_rule_ids == std::vector<std::string>{"retake", "any"}));
+    EXPECT((engine.apply(ru, *single).matched_rule_ids == std::vector<std::string>{"retake", "any"}));
+  }
+}
+
+
 int main() {
   test_email_decision_engine();
   test_noop_llm_client();
   test_sqlite_storage();
+  test_email_search();
   test_telegram_auth_logic();
   test_regression_ignored_kind_high_importance();
   test_regression_academic_classification();
@@ -852,5 +1976,15 @@ int main() {
   test_regression_form_email_pipeline();
   test_regression_checkpoint_logic();
   test_url_based_fetch_and_incomplete_literal();
+  test_imap_session_framing();
+  test_imap_batch_fetch_split();
+  test_imap_bodystructure();
+  test_mime_parser();
+  test_transfer_decode();
+  test_mail_date();
+  test_case_fold();
+  test_link_scan();
+  test_html_text();
+  test_rule_engine();
   return finish();
 }